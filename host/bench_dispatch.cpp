@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host microbenchmark of the command lookup: linear strncmp scan versus perfect hash.
+ *
+ * Build and run on a workstation:
+ *
+ *     g++ -O2 -std=c++14 -Isrc host/bench_dispatch.cpp -o bench_dispatch && ./bench_dispatch
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include "comm_dispatch.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ITERATIONS 10000000
+
+typedef struct {
+    char cmd[16];
+} benchCommand_t;
+
+// Current power_settings[] commands
+static constexpr benchCommand_t current_commands[] = {
+    {"_l"}, {"_c"}, {"_v"}, {"_b"}, {"_t"}, {"_r"}, {"_d"},
+};
+
+// Grown table, as expected with dozens of commands
+static constexpr benchCommand_t grown_commands[] = {
+    {"_a"}, {"_b"}, {"_c"}, {"_d"}, {"_e"}, {"_f"}, {"_g"}, {"_h"}, {"_i"}, {"_j"}, {"_k"}, {"_l"}, {"_m"},
+    {"_n"}, {"_o"}, {"_p"}, {"_q"}, {"_r"}, {"_s"}, {"_t"}, {"_u"}, {"_v"}, {"_w"}, {"_x"}, {"_y"}, {"_z"},
+};
+
+static constexpr uint8_t command_key(const benchCommand_t &entry, uint16_t seed) { return opcode_hash(entry.cmd[1], seed); }
+
+static constexpr commHashTable_t current_hash = hash_table_build(current_commands, command_key);
+static constexpr commHashTable_t grown_hash = hash_table_build(grown_commands, command_key);
+
+static_assert(current_hash.perfect, "current_commands[] collide");
+static_assert(grown_hash.perfect, "grown_commands[] collide");
+
+// Prevents the compiler from optimizing the lookups away
+static volatile uint32_t sink;
+
+template <size_t N>
+static uint8_t linear_find(const benchCommand_t (&commands)[N], const char *command)
+{
+    for (uint8_t i = 0; i < N; i++)
+    {
+        if (strncmp(command, commands[i].cmd, strlen(commands[i].cmd)) == 0) return i;
+    }
+    return COMM_HASH_EMPTY;
+}
+
+template <size_t N>
+static uint8_t hash_find(const benchCommand_t (&commands)[N], const commHashTable_t &table, const char *command)
+{
+    uint8_t i = table.slot[opcode_hash(command[1], table.seed)];
+    return (i != COMM_HASH_EMPTY && commands[i].cmd[1] == command[1]) ? i : COMM_HASH_EMPTY;
+}
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+template <size_t N>
+static void bench_table(const char *name, const benchCommand_t (&commands)[N], const commHashTable_t &table)
+{
+    // The received commands cycle through the whole table
+    char received[N][3];
+    for (size_t i = 0; i < N; i++) memcpy(received[i], commands[i].cmd, 3);
+    char (*volatile received_commands)[3] = received;
+
+    double start = now_ns();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) sink = linear_find(commands, received_commands[i % N]);
+    double linear = (now_ns() - start) / BENCH_ITERATIONS;
+
+    start = now_ns();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) sink = hash_find(commands, table, received_commands[i % N]);
+    double hashed = (now_ns() - start) / BENCH_ITERATIONS;
+
+    printf("%-8s %3zu commands: linear %6.2f ns/lookup, hash %6.2f ns/lookup\n", name, N, linear, hashed);
+}
+
+int main()
+{
+    bench_table("current", current_commands, current_hash);
+    bench_table("grown", grown_commands, grown_hash);
+    return 0;
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host benchmark of the parse and dispatch time of the protocol handlers.
+ *
+ * Each handler is called in a loop on a typical command and the time per call is reported as JSON on
+ * the standard output, the messages of the handlers being discarded. The receiver is also fed adversarial
+ * streams, lines of the maximal length and random bytes, whose time per byte must stay bounded whatever
+ * the input: the benchmark fails if the slowest repetition of a case fed to the receiver exceeds
+ * max_ns_per_byte, BENCH_MAX_NS_PER_BYTE by default. The bound holds for an optimized build on a workstation,
+ * where the receiver takes 10 to 25 ns per byte, and leaves room for the noise of a shared machine, not for
+ * a parse time growing with the length of the input.
+ *
+ *     g++ -O2 -std=gnu++17 -Ihost/include -Isrc src/comm_*.cpp host/bench_protocol.cpp -o bench_protocol
+ *     ./bench_protocol [iterations] [max_ns_per_byte]
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include "comm_protocol.h"
+#include "comm_frame.h"
+#include "comm_receiver.h"
+#include "comm_registry.h"
+#include "comm_parse.h"
+
+#include <zephyr/drivers/uart.h>
+
+#include <algorithm>
+#include <errno.h>
+#include <stdlib.h>
+
+SpinAPI spin;
+TaskAPI task;
+DataAPI data;
+
+float32_t V1_low_value;
+float32_t V2_low_value;
+float32_t I1_low_value;
+float32_t I2_low_value;
+float32_t I_high_value;
+float32_t V_high_value;
+
+#define BENCH_REPETITIONS 7
+#define BENCH_MAX_NS_PER_BYTE 100.0
+
+int console_getchar() { return '\n'; }
+int console_putchar(char c) { return c; }
+int printk(const char *, ...) { return 0; }
+int uart_config_get(const struct device *, struct uart_config *) { return -ENOSYS; }
+int uart_configure(const struct device *, const struct uart_config *) { return -ENOSYS; }
+
+typedef struct {
+    const char *name;       /**< Name of the benchmark in the report */
+    const char *line;       /**< Command line, without its first character */
+    void (*run)();          /**< Function called at each iteration */
+    size_t bytes;           /**< Bytes received at each iteration, 0 if the case does not use the receiver */
+} benchCase_t;
+
+#define BENCH_NOISE_SIZE 4096
+#define BENCH_LONG_LINE_SIZE (sizeof(bufferstr) + 1)
+
+static uint8_t frame_raw[COMM_FRAME_MAX_SIZE];
+static size_t frame_size;
+static uint8_t noise[BENCH_NOISE_SIZE];
+static uint8_t long_line[BENCH_LONG_LINE_SIZE];
+static commTokens_t tokens;
+
+static void run_tokens() { parse_tokens(bufferstr, &tokens); }
+static void run_duty() { dutyHandler(LEG1, 6, &tokens); }
+static void run_duty_scaled() { dutyScaledHandler(LEG1, 7, &tokens); }
+static void run_reference() { referenceHandler(LEG1, 5, &tokens); }
+static void run_calibration() { calibrationHandler(&tokens); }
+static void run_bool_settings() { boolSettingsHandler(LEG1, BOOL_CAPA, &tokens); }
+static void run_power_line() { lineHandler('s'); }
+
+static void run_receiver_line()
+{
+    static const char line[] = "s_LEG1_d_0.02233\r\n";
+    for (size_t i = 0; i < sizeof(line) - 1; i++) receiver_push(line[i]);
+    while (receiver_poll() == false && ring_count(&rx_ring) > 0) {}
+}
+
+static void run_frame()
+{
+    if (frame_decode(frame_raw, frame_size, &rx_frame)) frameHandler(&rx_frame);
+}
+
+static void run_receiver_frame()
+{
+    for (size_t i = 0; i < frame_size; i++) receiver_push(frame_raw[i]);
+    while (receiver_poll() == false && ring_count(&rx_ring) > 0) {}
+}
+
+static void run_receiver_bytes(const uint8_t *bytes, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        receiver_push(bytes[i]);
+        if (ring_count(&rx_ring) >= COMM_RX_BYTES_PER_POLL) while (ring_count(&rx_ring) > 0) receiver_poll();
+    }
+    while (ring_count(&rx_ring) > 0) receiver_poll();
+}
+
+static void run_receiver_long_line() { run_receiver_bytes(long_line, sizeof(long_line)); }
+static void run_receiver_noise() { run_receiver_bytes(noise, sizeof(noise)); }
+
+/**
+ * @brief Builds the adversarial streams: random bytes, and a calibration line made of separators which fills
+ * bufferstr.
+ */
+static void build_streams()
+{
+    uint32_t state = 2463534242u;
+    for (size_t i = 0; i < sizeof(noise); i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        noise[i] = (uint8_t)state;
+    }
+    memset(long_line, '_', sizeof(long_line));
+    long_line[0] = 'k';
+    long_line[sizeof(long_line) - 1] = '\n';
+}
+
+static const benchCase_t bench_cases[] = {
+    {"parse_tokens", "_V1_g_22.03409353_o_0.11349874", run_tokens, 0},
+    {"dutyHandler", "_LEG1_d_0.02233", run_duty, 0},
+    {"dutyScaledHandler", "_LEG1_p_2233", run_duty_scaled, 0},
+    {"referenceHandler", "_LEG1_r_V1_12.50000", run_reference, 0},
+    {"calibrationHandler", "_V1_g_22.03409353_o_0.11349874", run_calibration, 0},
+    {"boolSettingsHandler", "_LEG1_c_on", run_bool_settings, 0},
+    {"lineHandler_duty", "_LEG1_d_0.02233", run_power_line, 0},
+    {"receiver_duty_line", NULL, run_receiver_line, 18},
+    {"frameHandler_duty", NULL, run_frame, 0},
+    {"receiver_duty_frame", NULL, run_receiver_frame, 0},
+    {"receiver_long_line", NULL, run_receiver_long_line, BENCH_LONG_LINE_SIZE},
+    {"receiver_noise", NULL, run_receiver_noise, BENCH_NOISE_SIZE},
+};
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t iterations = (argc > 1) ? atoi(argv[1]) : 100000;
+    double max_ns_per_byte = (argc > 2) ? atof(argv[2]) : BENCH_MAX_NS_PER_BYTE;
+    bool bounded = true;
+    registry_init();
+
+    commFrame_t frame = {'d', 0, COMM_NO_INDEX, 0, {}};
+    frame_put_float(&frame, 0, 0.02233);
+    frame_size = frame_encode(&frame, frame_raw, sizeof(frame_raw));
+    build_streams();
+
+    size_t cases = sizeof(bench_cases) / sizeof(bench_cases[0]);
+    printf("{\n  \"iterations\": %u,\n  \"handlers\": {\n", iterations);
+    for (size_t c = 0; c < cases; c++)
+    {
+        const benchCase_t *bench = &bench_cases[c];
+        if (bench->line != NULL)
+        {
+            strcpy(bufferstr, bench->line);
+            parse_tokens(bufferstr, &tokens);
+        }
+
+        double times[BENCH_REPETITIONS];
+        for (uint8_t r = 0; r < BENCH_REPETITIONS; r++)
+        {
+            double start = now_ns();
+            for (uint32_t i = 0; i < iterations; i++) bench->run();
+            times[r] = (now_ns() - start) / iterations;
+        }
+        std::sort(times, times + BENCH_REPETITIONS);
+        printf("    \"%s\": {\"ns_per_call_min\": %.1f, \"ns_per_call_median\": %.1f, \"ns_per_call_max\": %.1f",
+               bench->name, times[0], times[BENCH_REPETITIONS / 2], times[BENCH_REPETITIONS - 1]);
+        if (bench->bytes > 0)
+        {
+            double ns_per_byte = times[BENCH_REPETITIONS - 1] / bench->bytes;
+            printf(", \"ns_per_byte_max\": %.2f", ns_per_byte);
+            if (ns_per_byte > max_ns_per_byte)
+            {
+                fprintf(stderr, "%s: %.2f ns per byte, above the bound of %.2f\n", bench->name, ns_per_byte,
+                        max_ns_per_byte);
+                bounded = false;
+            }
+        }
+        printf("}%s\n", (c + 1 < cases) ? "," : "");
+    }
+    printf("  }\n}\n");
+    return bounded ? 0 : 1;
+}
@@ -0,0 +1,505 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host fuzzer of the protocol parsers and handlers.
+ *
+ * Each input is the byte stream received by the board. It is fed to the receiver (see comm_receiver.h), one
+ * control period being run after each poll, then to the blocking initial_handle(), so every line and frame
+ * handler is reached from both reception paths. The board keeps its state from one input to the next, like
+ * a board receiving the inputs one after the other.
+ *
+ * The seed corpus holds every text command of the README and a frame with a valid CRC for each opcode of the
+ * protocol. The standalone driver replays the seeds and the given files, then mutates them: bytes are erased,
+ * inserted or replaced, and the frames are re-encoded with a valid CRC once their header or payload is
+ * mutated, so that the mutations reach the handlers instead of the CRC check. It stops at the first error
+ * reported by the sanitizers:
+ *
+ *     g++ -O1 -g -std=gnu++17 -fsanitize=address,undefined -fno-sanitize-recover=all -Ihost/include -Isrc \
+ *         src/comm_*.cpp host/fuzz_protocol.cpp -o fuzz_protocol
+ *     ./fuzz_protocol [-n iterations] [-r seed] [file ...]
+ *     ./fuzz_protocol -w corpus_directory
+ *
+ * -w writes the seed corpus, for instance for libFuzzer, which brings its own main():
+ *
+ *     clang++ -O1 -g -std=gnu++17 -fsanitize=fuzzer,address,undefined -DFUZZ_LIBFUZZER -Ihost/include -Isrc \
+ *         src/comm_*.cpp host/fuzz_protocol.cpp -o fuzz_protocol
+ *     ./fuzz_protocol corpus_directory
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include "comm_protocol.h"
+#include "comm_frame.h"
+#include "comm_receiver.h"
+#include "comm_transmitter.h"
+#include "comm_registry.h"
+#include "comm_setpoints.h"
+#include "comm_sequence.h"
+#include "comm_capture.h"
+#include "comm_telemetry.h"
+#include "comm_calibration.h"
+#include "comm_link.h"
+#include "comm_events.h"
+#include "comm_stats.h"
+
+#include <zephyr/fs/nvs.h>
+#include <zephyr/drivers/uart.h>
+
+#include <random>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+SpinAPI spin;
+TaskAPI task;
+DataAPI data;
+
+float32_t V1_low_value;
+float32_t V2_low_value;
+float32_t I1_low_value;
+float32_t I2_low_value;
+float32_t I_high_value;
+float32_t V_high_value;
+static float32_t P_high_value;
+
+#define FUZZ_CONTROL_PERIOD_US 100
+#define FUZZ_DEFAULT_ITERATIONS 100000
+#define FUZZ_MAX_INSERTION 300
+
+// Input read by the blocking reception path, which reads ends of line once it is exhausted
+static const uint8_t *console_input;
+static size_t console_length;
+static size_t console_position;
+static uint32_t console_baud = 115200;
+
+int console_getchar() { return (console_position < console_length) ? console_input[console_position++] : '\n'; }
+int console_putchar(char c) { return c; }
+int printk(const char *, ...) { return 0; }
+
+int uart_config_get(const struct device *, struct uart_config *cfg)
+{
+    cfg->baudrate = console_baud;
+    return 0;
+}
+
+int uart_configure(const struct device *, const struct uart_config *cfg)
+{
+    console_baud = cfg->baudrate;
+    return 0;
+}
+
+
+/**
+ * @brief Starts the protocol like the firmware, the saved calibrations being discarded.
+ */
+static void fuzz_init()
+{
+    host_nvs_path = "/dev/null";
+    comm_init(FUZZ_CONTROL_PERIOD_US);
+    registry_add_derived("PH", &P_high_value);
+    calibration_restore();
+    setpoints_init();
+}
+
+
+/**
+ * @brief Runs one period of the control task, the measurements sweeping their range so that the captures
+ * trigger and the telemetry changes.
+ */
+static void control_period()
+{
+    static uint32_t period = 0;
+    float32_t phase = (float32_t)(period++ % 64) / 64;
+    V1_low_value = 24 * phase;
+    V2_low_value = 24 * (1 - phase);
+    V_high_value = 48 * phase;
+    I1_low_value = 2 * phase - 1;
+    I2_low_value = 1 - 2 * phase;
+    I_high_value = phase;
+    P_high_value = V_high_value * I_high_value;
+
+    setpoints_acquire();
+    sequence_tick();
+    telemetry_tick();
+    capture_sample();
+}
+
+
+/**
+ * @brief Runs comm_background_task() once, then a control period.
+ */
+static void background_step()
+{
+    receiver_poll();
+    transmitter_flush();
+    link_step();
+    control_period();
+}
+
+
+/**
+ * @brief Feeds the bytes to the receiver, handling them as comm_background_task() does.
+ */
+static void receive_polled(const uint8_t *bytes, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        receiver_push(bytes[i]);
+        if (ring_count(&rx_ring) < COMM_RX_BYTES_PER_POLL) continue;
+        while (ring_count(&rx_ring) > 0) background_step();
+    }
+    // The responses spanning several frames, such as a capture dump, are also written. The telemetry queued
+    // by the control task is not waited for, it never stops while streaming.
+    do
+    {
+        background_step();
+    }
+    while (ring_count(&rx_ring) > 0 || ring_count(&response_ring) > 0);
+}
+
+
+/**
+ * @brief Feeds the bytes to the blocking initial_handle().
+ */
+static void receive_blocking(const uint8_t *bytes, size_t length)
+{
+    console_input = bytes;
+    console_length = length;
+    console_position = 0;
+    while (console_position < console_length)
+    {
+        initial_handle(console_getchar());
+        transmitter_flush();
+        control_period();
+    }
+}
+
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *bytes, size_t length)
+{
+    static bool initialized = false;
+    if (!initialized)
+    {
+        fuzz_init();
+        initialized = true;
+    }
+    receive_polled(bytes, length);
+    receive_blocking(bytes, length);
+    return 0;
+}
+
+
+#ifndef FUZZ_LIBFUZZER
+
+typedef std::vector<uint8_t> fuzzInput_t;
+
+static std::vector<fuzzInput_t> seeds;
+static commFrame_t seed_frame;
+
+// The text commands of the README, as sent by Twist_Device
+static const char *const seed_lines[] = {
+    "d_i\n", "d_f\n", "d_o\n",
+    "s_LEG1_l_on\n", "s_LEG2_l_off\n", "s_LEG1_c_on\n", "s_LEG2_v_on\n", "s_LEG1_b_on\n", "s_LEG2_t_off\n",
+    "s_LEG1_r_V1_12.50000\n", "s_LEG2_r_IH_-1.25000\n",
+    "s_LEG1_d_0.02233\n", "s_LEG2_d_1.50000\n", "s_LEG1_p_2233\n",
+    "k_V1_g_22.03409353_o_0.11349874\n", "k_IH_g_-0.00500000_o_12.50000000\n",
+    "s_LEG1_d_0.5#42\r\n", "d_o#65535\n",
+};
+
+static void seed_begin(uint8_t opcode, uint8_t leg, uint8_t variable)
+{
+    seed_frame.opcode = opcode;
+    seed_frame.leg = leg;
+    seed_frame.variable = variable;
+    seed_frame.length = 0;
+}
+
+static void put_u8(uint8_t value) { seed_frame.payload[seed_frame.length++] = value; }
+
+static void put_u16(uint16_t value)
+{
+    memcpy(seed_frame.payload + seed_frame.length, &value, sizeof(value));
+    seed_frame.length += sizeof(value);
+}
+
+static void put_u32(uint32_t value)
+{
+    memcpy(seed_frame.payload + seed_frame.length, &value, sizeof(value));
+    seed_frame.length += sizeof(value);
+}
+
+static void put_f32(float32_t value) { frame_put_float(&seed_frame, seed_frame.length, value); }
+
+static void seed_end()
+{
+    uint8_t raw[COMM_FRAME_MAX_SIZE];
+    size_t size = frame_encode(&seed_frame, raw, sizeof(raw));
+    seeds.push_back(fuzzInput_t(raw, raw + size));
+}
+
+/**
+ * @brief Builds the seed corpus: the README commands, then a valid frame for each opcode.
+ */
+static void build_seeds()
+{
+    for (const char *line : seed_lines) seeds.push_back(fuzzInput_t(line, line + strlen(line)));
+
+    for (uint8_t opcode : {'i', 'f', 'o'})
+    {
+        seed_begin(opcode, COMM_NO_INDEX, COMM_NO_INDEX);
+        seed_end();
+    }
+    for (uint8_t opcode : {'l', 'c', 'v', 'b', 't'})
+    {
+        seed_begin(opcode, 0, COMM_NO_INDEX);
+        put_f32(1.0);
+        seed_end();
+    }
+    seed_begin('r', 1, 0);
+    put_f32(12.5);
+    seed_end();
+    seed_begin('d', 0, COMM_NO_INDEX);
+    put_f32(0.02233);
+    seed_end();
+    seed_begin('d' | COMM_FRAME_SEQUENCED, 1, COMM_NO_INDEX);
+    put_u16(42);
+    put_f32(0.3);
+    seed_end();
+    seed_begin(COMM_OP_CALIBRATION, COMM_NO_INDEX, 0);
+    put_f32(22.03409353);
+    put_f32(0.11349874);
+    seed_end();
+
+    seed_begin(COMM_OP_BATCH | COMM_FRAME_SEQUENCED, COMM_NO_INDEX, COMM_NO_INDEX);
+    put_u16(7);
+    put_u8('l'); put_u8(0); put_u8(COMM_NO_INDEX); put_f32(1.0);
+    put_u8('d'); put_u8(0); put_u8(COMM_NO_INDEX); put_f32(0.3);
+    put_u8('o'); put_u8(COMM_NO_INDEX); put_u8(COMM_NO_INDEX); put_f32(0.0);
+    seed_end();
+
+    seed_begin(COMM_OP_TELEMETRY, COMM_NO_INDEX, COMM_NO_INDEX);
+    put_u16(1);
+    seed_end();
+    seed_begin(COMM_OP_SUBSCRIBE, COMM_NO_INDEX, COMM_NO_INDEX);
+    put_u32(0x0F);
+    seed_end();
+    seed_begin(COMM_OP_COMPRESSED, COMM_NO_INDEX, COMM_NO_INDEX);
+    put_u8(8); put_u8(3);
+    seed_end();
+    seed_begin(COMM_OP_EVENTS, COMM_NO_INDEX, COMM_NO_INDEX);
+    put_u8(0xFF);
+    seed_end();
+    seed_begin(COMM_OP_STATS, COMM_NO_INDEX, COMM_NO_INDEX);
+    put_u8(1);
+    seed_end();
+
+    seed_begin(COMM_OP_CAPTURE, COMM_NO_INDEX, COMM_NO_INDEX);
+    put_u8(CAPTURE_CMD_ARM); put_u8(0x03); put_u8(CAPTURE_TRIGGER_RISING); put_u8(0); put_f32(1.0);
+    put_u16(16); put_u16(16);
+    seed_end();
+    for (uint8_t command : {CAPTURE_CMD_TRIGGER, CAPTURE_CMD_STATUS, CAPTURE_CMD_DUMP})
+    {
+        seed_begin(COMM_OP_CAPTURE, COMM_NO_INDEX, COMM_NO_INDEX);
+        put_u8(command);
+        seed_end();
+    }
+
+    seed_begin(COMM_OP_SEQUENCE, COMM_NO_INDEX, COMM_NO_INDEX);
+    put_u8(SEQUENCE_CMD_LOAD); put_u16(0);
+    put_u32(0); put_u16(0); put_u8('d'); put_u8(0); put_u8(COMM_NO_INDEX); put_f32(0.2);
+    put_u32(0); put_u16(0); put_u8('l'); put_u8(1); put_u8(COMM_NO_INDEX); put_f32(1.0);
+    put_u32(10); put_u16(5); put_u8('d'); put_u8(0); put_u8(COMM_NO_INDEX); put_f32(0.5);
+    put_u32(12); put_u16(0); put_u8('r'); put_u8(1); put_u8(2); put_f32(24.0);
+    seed_end();
+    seed_begin(COMM_OP_SEQUENCE, COMM_NO_INDEX, COMM_NO_INDEX);
+    put_u8(SEQUENCE_CMD_START); put_u16(2);
+    seed_end();
+    for (uint8_t command : {SEQUENCE_CMD_STATUS, SEQUENCE_CMD_STOP, SEQUENCE_CMD_CLEAR})
+    {
+        seed_begin(COMM_OP_SEQUENCE, COMM_NO_INDEX, COMM_NO_INDEX);
+        put_u8(command);
+        seed_end();
+    }
+
+    seed_begin(COMM_OP_CALIBRATIONS, COMM_NO_INDEX, COMM_NO_INDEX);
+    put_u8(CALIBRATION_CMD_GET); put_u8(0);
+    seed_end();
+    seed_begin(COMM_OP_CALIBRATIONS, COMM_NO_INDEX, COMM_NO_INDEX);
+    put_u8(CALIBRATION_CMD_SET); put_u8(4); put_f32(1.5); put_f32(-0.25); put_f32(2.0); put_f32(0.0);
+    seed_end();
+    for (uint8_t command : {CALIBRATION_CMD_COMMIT, CALIBRATION_CMD_ERASE})
+    {
+        seed_begin(COMM_OP_CALIBRATIONS, COMM_NO_INDEX, COMM_NO_INDEX);
+        put_u8(command);
+        seed_end();
+    }
+
+    seed_begin(COMM_OP_LINK, COMM_NO_INDEX, COMM_NO_INDEX);
+    put_u8(LINK_CMD_INFO);
+    seed_end();
+    seed_begin(COMM_OP_LINK, COMM_NO_INDEX, COMM_NO_INDEX);
+    put_u8(LINK_CMD_RATE); put_u32(1000);
+    seed_end();
+    seed_begin(COMM_OP_LINK, COMM_NO_INDEX, COMM_NO_INDEX);
+    put_u8(LINK_CMD_BAUD); put_u32(921600);
+    seed_end();
+}
+
+/**
+ * @brief Mutates an input. A valid frame is re-encoded after the mutation of its decoded fields.
+ */
+static void mutate(fuzzInput_t *input, std::mt19937 *rng)
+{
+    static const char alphabet[] = "_#.-+0123456789eVIHLEGdskoilfcvbtrp\r\n\xa5";
+    commFrame_t frame = {};
+    if (frame_decode(input->data(), input->size(), &frame) && (*rng)() % 2 == 0)
+    {
+        uint8_t *header[] = {&frame.opcode, &frame.leg, &frame.variable, &frame.length};
+        uint8_t mutations = 1 + (*rng)() % 4;
+        for (uint8_t m = 0; m < mutations; m++)
+        {
+            uint32_t choice = (*rng)() % 8;
+            if (choice < 4) *header[choice] = (*rng)() % 8 == 0 ? (*rng)() : *header[choice] ^ (1 << ((*rng)() % 8));
+            else if (frame.length > 0) frame.payload[(*rng)() % frame.length] = (*rng)();
+            if (frame.length > COMM_FRAME_MAX_PAYLOAD) frame.length = (*rng)() % (COMM_FRAME_MAX_PAYLOAD + 1);
+        }
+        uint8_t raw[COMM_FRAME_MAX_SIZE];
+        size_t size = frame_encode(&frame, raw, sizeof(raw));
+        input->assign(raw, raw + size);
+        return;
+    }
+
+    uint8_t mutations = 1 + (*rng)() % 6;
+    for (uint8_t m = 0; m < mutations; m++)
+    {
+        size_t position = input->empty() ? 0 : (*rng)() % input->size();
+        switch ((*rng)() % 5)
+        {
+        case 0:
+            if (!input->empty()) input->erase(input->begin() + position);
+            break;
+        case 1:
+            input->insert(input->begin() + position, alphabet[(*rng)() % (sizeof(alphabet) - 1)]);
+            break;
+        case 2:
+            input->insert(input->begin() + position, (*rng)() % FUZZ_MAX_INSERTION,
+                          alphabet[(*rng)() % (sizeof(alphabet) - 1)]);
+            break;
+        case 3:
+            if (!input->empty()) (*input)[position] = (*rng)();
+            break;
+        default:
+        {
+            // Splice another seed, so the stream holds several commands
+            const fuzzInput_t &other = seeds[(*rng)() % seeds.size()];
+            input->insert(input->begin() + position, other.begin(), other.end());
+            break;
+        }
+        }
+    }
+}
+
+static bool read_file(const char *path, fuzzInput_t *input)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return false;
+    uint8_t buffer[4096];
+    size_t size;
+    input->clear();
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) input->insert(input->end(), buffer, buffer + size);
+    fclose(file);
+    return true;
+}
+
+static bool write_seeds(const char *directory)
+{
+    for (size_t i = 0; i < seeds.size(); i++)
+    {
+        std::string path = std::string(directory) + "/seed_" + std::to_string(i);
+        FILE *file = fopen(path.c_str(), "wb");
+        if (file == NULL) return false;
+        fwrite(seeds[i].data(), 1, seeds[i].size(), file);
+        fclose(file);
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t iterations = FUZZ_DEFAULT_ITERATIONS;
+    uint32_t seed = 1;
+    const char *corpus_directory = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "n:r:w:")) != -1)
+    {
+        switch (option)
+        {
+        case 'n':
+            iterations = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        case 'w':
+            corpus_directory = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-r seed] [file ...]\n       %s -w corpus_directory\n",
+                    argv[0], argv[0]);
+            return 1;
+        }
+    }
+
+    build_seeds();
+    if (corpus_directory != NULL)
+    {
+        if (write_seeds(corpus_directory)) return 0;
+        perror(corpus_directory);
+        return 1;
+    }
+
+    for (int i = optind; i < argc; i++)
+    {
+        fuzzInput_t input;
+        if (!read_file(argv[i], &input))
+        {
+            perror(argv[i]);
+            return 1;
+        }
+        seeds.push_back(input);
+    }
+
+    for (const fuzzInput_t &input : seeds) LLVMFuzzerTestOneInput(input.data(), input.size());
+
+    std::mt19937 rng(seed);
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        fuzzInput_t input = seeds[rng() % seeds.size()];
+        mutate(&input, &rng);
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+    printf("%zu inputs replayed, %u mutated inputs run\n", seeds.size(), iterations);
+    return 0;
+}
+
+#endif  // FUZZ_LIBFUZZER
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host stand-in of the OwnTech DataAPI, used by the simulation build of the protocol.
+ *
+ * The calibration parameters are stored so that the simulation applies them to its measurements.
+ */
+
+
+#ifndef DATAAPI_H
+#define DATAAPI_H
+
+#include "arm_math.h"
+
+typedef enum
+{
+    V1_LOW, V2_LOW, V_HIGH, I1_LOW, I2_LOW, I_HIGH, CHANNELS_NUMBER
+} channel_t;
+
+class DataAPI
+{
+public:
+    void setParameters(channel_t channel, float32_t channel_gain, float32_t channel_offset)
+    {
+        gain[channel] = channel_gain;
+        offset[channel] = channel_offset;
+    }
+
+    float32_t gain[CHANNELS_NUMBER] = {1, 1, 1, 1, 1, 1};
+    float32_t offset[CHANNELS_NUMBER] = {};
+};
+
+extern DataAPI data;
+
+#endif  //DATAAPI_H
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host stand-in of the OwnTech SpinAPI, used by the simulation build of the protocol.
+ *
+ * The GPIOs only record their state so that the simulation can report the switches.
+ */
+
+
+#ifndef SPINAPI_H
+#define SPINAPI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "arm_math.h"
+
+typedef uint8_t pin_t;
+
+#define SIM_PINS_NUMBER 64
+
+class GpioHAL
+{
+public:
+    void setPin(pin_t pin) { state[pin % SIM_PINS_NUMBER] = true; }
+    void resetPin(pin_t pin) { state[pin % SIM_PINS_NUMBER] = false; }
+    bool readPin(pin_t pin) { return state[pin % SIM_PINS_NUMBER]; }
+
+    bool state[SIM_PINS_NUMBER] = {};
+};
+
+class SpinAPI
+{
+public:
+    GpioHAL gpio;
+};
+
+extern SpinAPI spin;
+
+#endif  //SPINAPI_H
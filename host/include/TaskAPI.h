@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host stand-in of the OwnTech TaskAPI, used by the simulation build of the protocol.
+ *
+ * The simulation runs its own threads, background tasks are only recorded. Suspending a background task
+ * sleeps the calling thread.
+ */
+
+
+#ifndef TASKAPI_H
+#define TASKAPI_H
+
+#include <stdint.h>
+#include <unistd.h>
+
+#define TASK_BACKGROUND_MAX 4
+
+typedef void (*task_function_t)();
+
+class TaskAPI
+{
+public:
+    int8_t createBackground(task_function_t routine)
+    {
+        if (background_number >= TASK_BACKGROUND_MAX) return -1;
+        background[background_number] = routine;
+        return background_number++;
+    }
+    void startBackground(uint8_t) {}
+    void suspendBackgroundUs(uint32_t duration_us) { usleep(duration_us); }
+
+    task_function_t background[TASK_BACKGROUND_MAX] = {};
+    uint8_t background_number = 0;
+};
+
+extern TaskAPI task;
+
+#endif  //TASKAPI_H
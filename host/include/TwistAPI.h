@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host stand-in of the OwnTech TwistAPI, used by the simulation build of the protocol.
+ */
+
+
+#ifndef TWISTAPI_H
+#define TWISTAPI_H
+
+#include "SpinAPI.h"
+
+typedef enum
+{
+    LEG1, LEG2
+} leg_t;
+
+// Switch pins of the Twist board
+#define LEG1_CAPA_DGND      1
+#define LEG2_CAPA_DGND      2
+#define LEG1_DRIVER_SWITCH  3
+#define LEG2_DRIVER_SWITCH  4
+
+#endif  //TWISTAPI_H
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host stand-in of the CMSIS core registers, used by the simulation build of the protocol.
+ *
+ * Only the DWT cycle counter is provided. Reading DWT->CYCCNT returns the monotonic clock in nanoseconds,
+ * so the statistics of the simulation are in nanoseconds instead of cycles.
+ */
+
+
+#ifndef CMSIS_CORE_H
+#define CMSIS_CORE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+
+/**
+ * @brief Timer-based cycle counter, which ignores writes.
+ */
+struct HostCycleCounter
+{
+    operator uint32_t() const
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+    }
+    HostCycleCounter &operator=(uint32_t) { return *this; }
+};
+
+struct HostDwt
+{
+    uint32_t CTRL;
+    HostCycleCounter CYCCNT;
+};
+
+struct HostCoreDebug
+{
+    uint32_t DEMCR;
+};
+
+inline HostDwt host_dwt;
+inline HostCoreDebug host_core_debug;
+
+#define DWT (&host_dwt)
+#define CoreDebug (&host_core_debug)
+
+#endif  //CMSIS_CORE_H
@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host stand-in of the Zephyr console API, used by the simulation build of the protocol.
+ *
+ * The simulated console is the master side of a pseudo-terminal, see host/twist_sim.cpp.
+ */
+
+
+#ifndef ZEPHYR_CONSOLE_CONSOLE_H
+#define ZEPHYR_CONSOLE_CONSOLE_H
+
+#include <stdint.h>
+
+int console_getchar();
+int console_putchar(char c);
+
+#endif  //ZEPHYR_CONSOLE_CONSOLE_H
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host stand-in of the Zephyr device API, used by the simulation build of the protocol.
+ */
+
+
+#ifndef ZEPHYR_DEVICE_H
+#define ZEPHYR_DEVICE_H
+
+struct device
+{
+    const char *name;
+};
+
+// Devicetree lookups: the chosen nodes are plain tokens naming a host_<node>_device defined by the stand-in of
+// their driver, and no node matches a compatible
+#define DT_CHOSEN(name) name
+#define DT_NODE_HAS_COMPAT(node, compatible) 0
+#define DEVICE_DT_GET(node) HOST_DEVICE_DT_GET(node)
+#define HOST_DEVICE_DT_GET(node) (&host_##node##_device)
+
+static inline bool device_is_ready(const struct device *dev)
+{
+    return dev != nullptr;
+}
+
+#endif  //ZEPHYR_DEVICE_H
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host stand-in of the Zephyr flash driver API, used by the simulation build of the protocol.
+ */
+
+
+#ifndef ZEPHYR_DRIVERS_FLASH_H
+#define ZEPHYR_DRIVERS_FLASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <zephyr/device.h>
+
+#define HOST_FLASH_PAGE_SIZE 2048
+
+struct flash_pages_info
+{
+    off_t start_offset;
+    size_t size;
+    uint32_t index;
+};
+
+static inline int flash_get_page_info_by_offs(const struct device *, off_t offset, struct flash_pages_info *info)
+{
+    info->index = offset / HOST_FLASH_PAGE_SIZE;
+    info->start_offset = info->index * HOST_FLASH_PAGE_SIZE;
+    info->size = HOST_FLASH_PAGE_SIZE;
+    return 0;
+}
+
+#endif  //ZEPHYR_DRIVERS_FLASH_H
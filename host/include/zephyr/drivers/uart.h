@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host stand-in of the Zephyr UART driver API, used by the simulation build of the protocol.
+ *
+ * The chosen console is the pseudo-terminal of host/twist_sim.cpp, which implements the configuration functions.
+ */
+
+
+#ifndef ZEPHYR_DRIVERS_UART_H
+#define ZEPHYR_DRIVERS_UART_H
+
+#include <stdint.h>
+
+#include <zephyr/device.h>
+
+enum uart_config_parity
+{
+    UART_CFG_PARITY_NONE,
+    UART_CFG_PARITY_ODD,
+    UART_CFG_PARITY_EVEN
+};
+
+struct uart_config
+{
+    uint32_t baudrate;
+    uint8_t parity;
+    uint8_t stop_bits;
+    uint8_t data_bits;
+    uint8_t flow_ctrl;
+};
+
+inline const struct device host_zephyr_console_device = {"console"};
+
+int uart_config_get(const struct device *dev, struct uart_config *cfg);
+int uart_configure(const struct device *dev, const struct uart_config *cfg);
+
+#endif  //ZEPHYR_DRIVERS_UART_H
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host stand-in of the Zephyr NVS file system, used by the simulation build of the protocol.
+ *
+ * The entries are kept in the file host_nvs_path, as a list of | ID (u16) | LENGTH (u16) | DATA | records.
+ * A write rewrites the whole file and renames it over the previous one, so an interrupted write leaves
+ * the previous entries, as the real NVS does.
+ */
+
+
+#ifndef ZEPHYR_FS_NVS_H
+#define ZEPHYR_FS_NVS_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <zephyr/device.h>
+
+#define HOST_NVS_MAX_SIZE 4096
+
+/**
+ * @brief Path of the file backing the NVS, NULL to keep the entries in memory only.
+ */
+inline const char *host_nvs_path = "twist_sim.nvs";
+
+struct nvs_fs
+{
+    off_t offset;
+    uint16_t sector_size;
+    uint16_t sector_count;
+    const struct device *flash_device;
+    bool ready;
+};
+
+/**
+ * @brief Content of the NVS, loaded from host_nvs_path at mount.
+ */
+inline uint8_t host_nvs_data[HOST_NVS_MAX_SIZE];
+inline size_t host_nvs_size = 0;
+
+/**
+ * @brief Finds the record of an entry in host_nvs_data.
+ *
+ * @return The position of the record, or host_nvs_size if the entry does not exist.
+ */
+static inline size_t host_nvs_find(uint16_t id)
+{
+    size_t position = 0;
+    while (position + 4 <= host_nvs_size)
+    {
+        uint16_t record_id, length;
+        memcpy(&record_id, host_nvs_data + position, sizeof(uint16_t));
+        memcpy(&length, host_nvs_data + position + 2, sizeof(uint16_t));
+        if (record_id == id) return position;
+        position += 4 + length;
+    }
+    return host_nvs_size;
+}
+
+/**
+ * @brief Removes the record at the given position of host_nvs_data.
+ */
+static inline void host_nvs_remove(size_t position)
+{
+    uint16_t length;
+    memcpy(&length, host_nvs_data + position + 2, sizeof(uint16_t));
+    size_t end = position + 4 + length;
+    memmove(host_nvs_data + position, host_nvs_data + end, host_nvs_size - end);
+    host_nvs_size -= end - position;
+}
+
+static inline int host_nvs_save()
+{
+    if (host_nvs_path == NULL) return 0;
+    char temporary[512];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", host_nvs_path);
+    FILE *file = fopen(temporary, "wb");
+    if (file == NULL) return -EIO;
+    bool written = fwrite(host_nvs_data, 1, host_nvs_size, file) == host_nvs_size;
+    if (fclose(file) != 0 || !written || rename(temporary, host_nvs_path) != 0) return -EIO;
+    return 0;
+}
+
+static inline int nvs_mount(struct nvs_fs *fs)
+{
+    host_nvs_size = 0;
+    FILE *file = (host_nvs_path != NULL) ? fopen(host_nvs_path, "rb") : NULL;
+    if (file != NULL)
+    {
+        host_nvs_size = fread(host_nvs_data, 1, sizeof(host_nvs_data), file);
+        fclose(file);
+    }
+    fs->ready = true;
+    return 0;
+}
+
+static inline ssize_t nvs_read(struct nvs_fs *fs, uint16_t id, void *data, size_t len)
+{
+    if (!fs->ready) return -EACCES;
+    size_t position = host_nvs_find(id);
+    if (position == host_nvs_size) return -ENOENT;
+    uint16_t length;
+    memcpy(&length, host_nvs_data + position + 2, sizeof(uint16_t));
+    memcpy(data, host_nvs_data + position + 4, (len < length) ? len : length);
+    return length;
+}
+
+static inline ssize_t nvs_write(struct nvs_fs *fs, uint16_t id, const void *data, size_t len)
+{
+    if (!fs->ready) return -EACCES;
+    size_t position = host_nvs_find(id);
+    if (position != host_nvs_size) host_nvs_remove(position);
+    if (host_nvs_size + 4 + len > sizeof(host_nvs_data)) return -ENOSPC;
+
+    uint16_t length = len;
+    memcpy(host_nvs_data + host_nvs_size, &id, sizeof(uint16_t));
+    memcpy(host_nvs_data + host_nvs_size + 2, &length, sizeof(uint16_t));
+    memcpy(host_nvs_data + host_nvs_size + 4, data, len);
+    host_nvs_size += 4 + len;
+
+    int rc = host_nvs_save();
+    return (rc < 0) ? rc : (ssize_t)len;
+}
+
+static inline int nvs_delete(struct nvs_fs *fs, uint16_t id)
+{
+    if (!fs->ready) return -EACCES;
+    size_t position = host_nvs_find(id);
+    if (position == host_nvs_size) return 0;
+    host_nvs_remove(position);
+    return host_nvs_save();
+}
+
+#endif  //ZEPHYR_FS_NVS_H
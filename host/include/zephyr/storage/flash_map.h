@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host stand-in of the Zephyr flash map, used by the simulation build of the protocol.
+ *
+ * Every fixed partition is the single simulated flash device, at offset 0.
+ */
+
+
+#ifndef ZEPHYR_STORAGE_FLASH_MAP_H
+#define ZEPHYR_STORAGE_FLASH_MAP_H
+
+#include <zephyr/device.h>
+
+inline const struct device host_flash_device = {"flash"};
+
+#define FIXED_PARTITION_DEVICE(label) (&host_flash_device)
+#define FIXED_PARTITION_OFFSET(label) 0
+
+#endif  //ZEPHYR_STORAGE_FLASH_MAP_H
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host stand-in of the Zephyr kernel API, used by the simulation build of the protocol.
+ *
+ * printk() writes to the simulated console. The cycle counter runs at HOST_CYCLES_PER_SECOND, the frequency of
+ * the STM32G474 of the Spin board, so its 32-bit value wraps around every 25 seconds as on the board.
+ */
+
+
+#ifndef ZEPHYR_ZEPHYR_H
+#define ZEPHYR_ZEPHYR_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define HOST_CYCLES_PER_SECOND 170000000ULL
+#define CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER 1
+
+int printk(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+static inline uint64_t host_monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t k_cycle_get_64()
+{
+    uint64_t ns = host_monotonic_ns();
+    return (ns / 1000000000ULL) * HOST_CYCLES_PER_SECOND + (ns % 1000000000ULL) * HOST_CYCLES_PER_SECOND / 1000000000ULL;
+}
+
+static inline uint32_t k_cycle_get_32()
+{
+    return (uint32_t)k_cycle_get_64();
+}
+
+static inline uint32_t k_uptime_get_32()
+{
+    return (uint32_t)(host_monotonic_ns() / 1000000);
+}
+
+static inline uint32_t k_cyc_to_us_floor32(uint32_t cycles)
+{
+    return (uint32_t)(cycles * 1000000ULL / HOST_CYCLES_PER_SECOND);
+}
+
+static inline uint64_t k_cyc_to_us_floor64(uint64_t cycles)
+{
+    return cycles / HOST_CYCLES_PER_SECOND * 1000000ULL +
+           cycles % HOST_CYCLES_PER_SECOND * 1000000ULL / HOST_CYCLES_PER_SECOND;
+}
+
+#endif  //ZEPHYR_ZEPHYR_H
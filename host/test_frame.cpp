@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host test of the binary frames: CRC, encoding, and frames rejected by frameHandler() and the receiver.
+ *
+ * The frames too short for their command, longer than COMM_FRAME_MAX_PAYLOAD or with a bad CRC must be
+ * rejected without applying anything, and the receiver must handle the next valid frame. The test prints
+ * each failed check and exits with an error if any.
+ *
+ *     g++ -O2 -std=gnu++17 -Ihost/include -Isrc src/comm_*.cpp host/test_frame.cpp -o test_frame
+ *     ./test_frame
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include "comm_protocol.h"
+#include "comm_frame.h"
+#include "comm_receiver.h"
+#include "comm_registry.h"
+#include "comm_stats.h"
+
+#include <zephyr/drivers/uart.h>
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+
+SpinAPI spin;
+TaskAPI task;
+DataAPI data;
+
+float32_t V1_low_value;
+float32_t V2_low_value;
+float32_t I1_low_value;
+float32_t I2_low_value;
+float32_t I_high_value;
+float32_t V_high_value;
+
+int console_getchar() { return '\n'; }
+int console_putchar(char c) { return c; }
+int printk(const char *, ...) { return 0; }
+int uart_config_get(const struct device *, struct uart_config *) { return -ENOSYS; }
+int uart_configure(const struct device *, const struct uart_config *) { return -ENOSYS; }
+
+static uint32_t failures = 0;
+
+#define CHECK(condition) check(condition, #condition, __LINE__)
+
+static void check(bool condition, const char *text, int line)
+{
+    if (condition) return;
+    fprintf(stderr, "test_frame.cpp:%d: %s\n", line, text);
+    failures++;
+}
+
+/**
+ * @brief Encodes a frame of the given fields, its payload being filled with the given number of zeros.
+ */
+static size_t build_frame(uint8_t *out, uint8_t opcode, uint8_t leg, uint8_t length)
+{
+    commFrame_t frame = {opcode, leg, COMM_NO_INDEX, length, {}};
+    return frame_encode(&frame, out, COMM_FRAME_MAX_SIZE);
+}
+
+/**
+ * @brief Feeds bytes to the receiver, handling them as comm_background_task() does.
+ */
+static void receive(const uint8_t *bytes, size_t length)
+{
+    for (size_t i = 0; i < length; i++) receiver_push(bytes[i]);
+    while (ring_count(&rx_ring) > 0) receiver_poll();
+}
+
+static void test_crc()
+{
+    // Check value of CRC-16/CCITT-FALSE
+    const uint8_t check_string[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    CHECK(frame_crc16(check_string, sizeof(check_string)) == 0x29B1);
+    CHECK(frame_crc16(check_string, 0) == 0xFFFF);
+}
+
+static void test_round_trip()
+{
+    uint8_t raw[COMM_FRAME_MAX_SIZE];
+    commFrame_t frame = {'d', 1, COMM_NO_INDEX, 0, {}};
+    frame_put_float(&frame, 0, 0.25f);
+    size_t size = frame_encode(&frame, raw, sizeof(raw));
+    CHECK(size == COMM_FRAME_HEADER_SIZE + sizeof(float32_t) + COMM_FRAME_CRC_SIZE);
+
+    commFrame_t decoded;
+    CHECK(frame_decode(raw, size, &decoded));
+    CHECK(decoded.opcode == 'd' && decoded.leg == 1 && decoded.length == sizeof(float32_t));
+    CHECK(frame_get_float(&decoded, 0) == 0.25f);
+
+    // A full payload fits, one more byte does not
+    CHECK(build_frame(raw, 'B', COMM_NO_INDEX, COMM_FRAME_MAX_PAYLOAD) == COMM_FRAME_MAX_SIZE);
+    CHECK(frame_encode(&frame, raw, size - 1) == 0);
+}
+
+static void test_rejected_decode()
+{
+    uint8_t raw[COMM_FRAME_MAX_SIZE + 1];
+    commFrame_t decoded;
+    size_t size = build_frame(raw, 'o', COMM_NO_INDEX, 0);
+
+    CHECK(!frame_decode(raw, size - 1, &decoded));
+    CHECK(!frame_decode(raw, COMM_FRAME_HEADER_SIZE, &decoded));
+
+    raw[size - 1] ^= 0x01;
+    CHECK(!frame_decode(raw, size, &decoded));
+
+    size = build_frame(raw, 'B', COMM_NO_INDEX, COMM_FRAME_MAX_PAYLOAD);
+    raw[4] = COMM_FRAME_MAX_PAYLOAD + 1;
+    CHECK(!frame_decode(raw, sizeof(raw), &decoded));
+}
+
+static void test_short_frames()
+{
+    // Each command needs its values: the frames are rejected before anything is applied
+    commFrame_t frame = {'d', 0, COMM_NO_INDEX, 2, {}};
+    float32_t duty_cycle = power_leg_settings[0].duty_cycle;
+    CHECK(frameHandler(&frame) == COMM_ERROR_FORMAT);
+    CHECK(power_leg_settings[0].duty_cycle == duty_cycle);
+
+    frame = {'k', COMM_NO_INDEX, 0, sizeof(float32_t), {}};
+    CHECK(frameHandler(&frame) == COMM_ERROR_FORMAT);
+
+    // A calibration is rejected unless both of its parameters are finite
+    frame_put_float(&frame, 0, 1.0f);
+    frame_put_float(&frame, sizeof(float32_t), INFINITY);
+    CHECK(frameHandler(&frame) == COMM_ERROR_RANGE);
+
+    frame = {(uint8_t)('d' | COMM_FRAME_SEQUENCED), 0, COMM_NO_INDEX, 1, {}};
+    CHECK(frameHandler(&frame) == COMM_ERROR_FORMAT);
+
+    frame = {'d', REGISTRY_MAX_LEGS, COMM_NO_INDEX, sizeof(float32_t), {}};
+    CHECK(frameHandler(&frame) == COMM_ERROR_LEG);
+
+    // Letters differing only by their case are distinct opcodes
+    frame = {'a', COMM_NO_INDEX, COMM_NO_INDEX, 0, {}};
+    CHECK(frameHandler(&frame) == COMM_ERROR_UNKNOWN_COMMAND);
+    frame = {'O', COMM_NO_INDEX, COMM_NO_INDEX, 0, {}};
+    CHECK(frameHandler(&frame) == COMM_ERROR_UNKNOWN_COMMAND);
+}
+
+static void test_rejected_receive()
+{
+    uint8_t raw[COMM_FRAME_MAX_SIZE];
+    uint32_t parse_errors = comm_counters.parse_errors;
+    mode = IDLE;
+
+    // Oversize length: the header is dropped as soon as its length is read
+    size_t size = build_frame(raw, 'o', COMM_NO_INDEX, 0);
+    raw[4] = COMM_FRAME_MAX_PAYLOAD + 1;
+    receive(raw, COMM_FRAME_HEADER_SIZE);
+    CHECK(comm_counters.parse_errors == parse_errors + 1);
+    CHECK(mode == IDLE);
+
+    // Bad CRC
+    size = build_frame(raw, 'o', COMM_NO_INDEX, 0);
+    raw[size - 2] ^= 0x80;
+    receive(raw, size);
+    CHECK(comm_counters.parse_errors == parse_errors + 2);
+    CHECK(mode == IDLE);
+
+    // The receiver is back in sync for the next frame
+    uint32_t frames = comm_counters.frames;
+    size = build_frame(raw, 'o', COMM_NO_INDEX, 0);
+    receive(raw, size);
+    CHECK(comm_counters.frames == frames + 1);
+    CHECK(mode == POWER_ON);
+    mode = IDLE;
+}
+
+int main()
+{
+    test_crc();
+    test_round_trip();
+    test_rejected_decode();
+    test_short_frames();
+    test_rejected_receive();
+    printf("%s: %u failed checks\n", failures ? "FAILED" : "OK", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+"""
+Copyright (c) 2021-2024 LAAS-CNRS
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 2.1 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGLPV2.1
+"""
+
+"""
+@brief  Tests of the frame encoder and decoder of the host (src/twist_frame.py), which need no board:
+
+            python3 host/test_twist_frame.py
+
+@author Luiz Villa <luiz.villa@laas.fr>
+"""
+
+import os, struct, sys, unittest
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src"))
+
+import twist_frame
+
+
+class Crc16Test(unittest.TestCase):
+
+    def test_check_value(self):
+        # Check value of CRC-16/CCITT-FALSE, as frame_crc16() on the board
+        self.assertEqual(twist_frame.crc16(b"123456789"), 0x29B1)
+        self.assertEqual(twist_frame.crc16(b""), 0xFFFF)
+
+    def test_frame_crc(self):
+        frame = twist_frame.encode_command("POWER_ON")
+        (crc,) = struct.unpack_from("<H", frame, len(frame) - twist_frame.FRAME_CRC_SIZE)
+        self.assertEqual(crc, twist_frame.crc16(frame[1:-twist_frame.FRAME_CRC_SIZE]))
+
+
+class FrameRoundTripTest(unittest.TestCase):
+
+    def test_command(self):
+        frame = twist_frame.encode_command("DUTY", "LEG2", 0.25)
+        opcode, leg, variable, payload = twist_frame.decode_frame(frame)
+        self.assertEqual((chr(opcode), leg, variable), ("d", 1, twist_frame.NO_INDEX))
+        self.assertEqual(twist_frame.payload_floats(payload), (0.25,))
+
+    def test_calibration(self):
+        frame = twist_frame.encode_command("CALIBRATE", "I1", 2.0, -0.5)
+        opcode, leg, variable, payload = twist_frame.decode_frame(frame)
+        self.assertEqual((chr(opcode), variable), ("k", twist_frame.VARIABLES["I1"]))
+        self.assertEqual(twist_frame.payload_floats(payload), (2.0, -0.5))
+
+    def test_sequenced(self):
+        frame = twist_frame.encode_command("POWER_OFF", sequence=0x12345)
+        opcode, leg, variable, payload = twist_frame.decode_frame(frame)
+        self.assertEqual(opcode, ord("f") | twist_frame.FRAME_SEQUENCED)
+        self.assertEqual(struct.unpack("<H", payload), (0x2345,))
+
+    def test_full_payload(self):
+        values = [float(i) for i in range(twist_frame.FRAME_MAX_PAYLOAD // 4)]
+        opcode, leg, variable, payload = twist_frame.decode_frame(twist_frame.encode_frame("B", values=values))
+        self.assertEqual(list(twist_frame.payload_floats(payload)), values)
+        with self.assertRaises(ValueError):
+            twist_frame.encode_frame("B", values=values + [0.0])
+
+
+class FrameRejectedTest(unittest.TestCase):
+
+    def test_bad_crc(self):
+        frame = bytearray(twist_frame.encode_command("DUTY", "LEG1", 0.5))
+        frame[-1] ^= 0x01
+        with self.assertRaises(ValueError):
+            twist_frame.decode_frame(bytes(frame))
+
+    def test_truncated(self):
+        frame = twist_frame.encode_command("DUTY", "LEG1", 0.5)
+        for length in range(len(frame)):
+            with self.assertRaises(ValueError):
+                twist_frame.decode_frame(frame[:length])
+
+    def test_oversize(self):
+        header = bytes((twist_frame.FRAME_SYNC, ord("B"), 0, 0, twist_frame.FRAME_MAX_PAYLOAD + 1))
+        with self.assertRaises(ValueError):
+            twist_frame.decode_frame(header + bytes(twist_frame.FRAME_MAX_PAYLOAD + 3))
+
+    def test_stream_resync(self):
+        # Text, an oversize header and a corrupted frame are skipped, the frames around them are kept
+        good = twist_frame.encode_command("DUTY", "LEG1", 0.5)
+        bad = bytearray(good)
+        bad[-2] ^= 0x80
+        oversize = bytes((twist_frame.FRAME_SYNC, ord("B"), 0, 0, 0xFF))
+        stream = good + b"IDLE MODE\n" + oversize + bytes(bad) + good
+
+        decoder = twist_frame.FrameDecoder()
+        frames = []
+        for i in range(len(stream)):
+            frames += decoder.feed(stream[i:i + 1])
+        self.assertEqual(frames, [twist_frame.decode_frame(good)] * 2)
+
+
+if __name__ == "__main__":
+    unittest.main()
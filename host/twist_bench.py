@@ -0,0 +1,152 @@
+"""
+Copyright (c) 2021-2024 LAAS-CNRS
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 2.1 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGLPV2.1
+"""
+
+"""
+@brief  Throughput and latency benchmark of the Twist board protocol.
+
+        Runs against the host simulation (host/twist_sim.cpp) or a real board and writes a JSON report:
+
+            python3 host/twist_bench.py --port /dev/pts/3 --output report.json [--parse-bench ./bench_protocol]
+
+        - latency: time from the write of a duty command to the first telemetry record showing the new duty
+          cycle, for text lines and binary frames, as percentiles.
+        - rate: sustained number of commands per second, sending commands back to back and waiting for the
+          last one to be applied.
+        - handlers: parse time per handler reported by host/bench_protocol.cpp, if given.
+
+@author Luiz Villa <luiz.villa@laas.fr>
+"""
+
+import argparse, json, os, subprocess, sys, threading, time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src"))
+
+import numpy as np
+import twist_frame
+from Twist_Class import Twist_Device
+
+
+def text_duty(value):
+    return f"s_LEG1_d_{value:.5f}\r\n".encode()
+
+
+def binary_duty(value):
+    return twist_frame.encode_command("DUTY", "LEG1", value)
+
+
+def wait_duty(twist, value, timeout):
+    """
+    Reads the telemetry until a record shows the given duty cycle on LEG1.
+
+    Returns:
+        float: The time at which the record was received, or None on timeout.
+    """
+    target = np.float32(value)
+    deadline = time.perf_counter() + timeout
+    while time.perf_counter() < deadline:
+        records = twist.getTelemetry()
+        if len(records) and np.any(records["D1"] == target):
+            return time.perf_counter()
+    return None
+
+
+def percentiles(samples):
+    if not samples:
+        return {}
+    values = np.array(samples) * 1e3
+    return {"count": len(samples),
+            "p50_ms": float(np.percentile(values, 50)),
+            "p90_ms": float(np.percentile(values, 90)),
+            "p99_ms": float(np.percentile(values, 99)),
+            "max_ms": float(values.max())}
+
+
+def bench_latency(twist, encode, count, timeout):
+    latencies = []
+    lost = 0
+    for i in range(count):
+        value = 0.1 + 0.8 * (i % 2) + 1e-5 * (i % 997)
+        start = time.perf_counter()
+        twist.twist_serialObj.write(encode(value))
+        received = wait_duty(twist, value, timeout)
+        if received is None:
+            lost += 1
+        else:
+            latencies.append(received - start)
+    result = percentiles(latencies)
+    result["lost"] = lost
+    return result
+
+
+def bench_rate(twist, encode, count, timeout):
+    values = [0.1 + 0.5 * i / count for i in range(count)]
+    data = b"".join(encode(value) for value in values)
+    # Written from another thread while this one drains the telemetry, so neither side of the link stalls
+    # on a full buffer
+    writer = threading.Thread(target=twist.twist_serialObj.write, args=(data,))
+    twist.twist_serialObj.write(encode(0.05))
+    wait_duty(twist, 0.05, timeout)
+    start = time.perf_counter()
+    writer.start()
+    received = wait_duty(twist, values[-1], timeout + len(data) / 1000)
+    while writer.is_alive():
+        twist.getTelemetry()
+    if received is None:
+        return {"count": count, "completed": False}
+    elapsed = received - start
+    return {"count": count, "completed": True, "elapsed_s": elapsed, "commands_per_s": count / elapsed,
+            "bytes_per_command": len(data) / count}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Throughput and latency benchmark of the Twist board protocol")
+    parser.add_argument("--port", required=True, help="serial port of the board or pseudo-terminal of twist_sim")
+    parser.add_argument("--output", default="bench_report.json", help="path of the JSON report")
+    parser.add_argument("--count", type=int, default=200, help="number of latency samples per encoding")
+    parser.add_argument("--rate-count", type=int, default=1000, help="number of commands of the rate benchmark")
+    parser.add_argument("--decimation", type=int, default=1, help="control periods between two telemetry records")
+    parser.add_argument("--timeout", type=float, default=2.0, help="time to wait for a command to be applied, in s")
+    parser.add_argument("--parse-bench", help="path of the bench_protocol executable")
+    args = parser.parse_args()
+
+    report = {"port": args.port, "decimation": args.decimation, "time": time.strftime("%Y-%m-%dT%H:%M:%S")}
+
+    twist = Twist_Device(twist_port=args.port)
+    twist.startTelemetry(args.decimation)
+    time.sleep(0.2)
+    twist.getTelemetry()
+
+    report["latency"] = {"text": bench_latency(twist, text_duty, args.count, args.timeout),
+                         "binary": bench_latency(twist, binary_duty, args.count, args.timeout)}
+    report["rate"] = {"text": bench_rate(twist, text_duty, args.rate_count, args.timeout),
+                      "binary": bench_rate(twist, binary_duty, args.rate_count, args.timeout)}
+    report["telemetry_lost_records"] = twist.telemetry_decoder.lost
+    twist.stopTelemetry()
+
+    if args.parse_bench:
+        output = subprocess.run([args.parse_bench], check=True, capture_output=True, text=True).stdout
+        report["handlers"] = json.loads(output)["handlers"]
+
+    with open(args.output, "w") as report_file:
+        json.dump(report, report_file, indent=2)
+    print(json.dumps(report, indent=2))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Host simulation of a Twist board running the communication protocol.
+ *
+ * The protocol sources are built against the stand-ins of host/include and exposed on a pseudo-terminal,
+ * so the Python Twist_Device can talk to the simulated board as to a real one:
+ *
+ *     g++ -O2 -std=gnu++17 -pthread -Ihost/include -Isrc src/comm_*.cpp host/twist_sim.cpp -o twist_sim
+ *     ./twist_sim [-p control_period_us] [-s status_period_ms] [-n nvs_file] [-b baud] [-v]
+ *
+ * The path of the pseudo-terminal is printed at startup. Three threads mimic the tasks of the firmware:
+ * the RX path pushes the received bytes into the reception ring, the control task picks up the published
+ * setpoints, plays the sequence back, updates a simple model of the converter and feeds the telemetry and the capture, and the
+ * application task runs comm_background_task() and prints the status line. Only the application task
+ * writes to the console. Besides the channels of the Twist board, the input power is registered as the
+ * derived quantity "PH". The flash holding the saved calibrations is the file given with -n, twist_sim.nvs
+ * in the current directory by default.
+ *
+ * Like the board, whose console is on USB, the simulated console has no baud rate by default. With -b, it is
+ * a UART instead: its output is paced at a tenth of the baud rate (8N1), the bytes exchanged while the host
+ * sets another baud rate on the pseudo-terminal are lost, and the host can negotiate a higher baud rate (see
+ * comm_link.h).
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include "comm_protocol.h"
+#include "comm_receiver.h"
+#include "comm_transmitter.h"
+#include "comm_telemetry.h"
+#include "comm_capture.h"
+#include "comm_stats.h"
+#include "comm_setpoints.h"
+#include "comm_sequence.h"
+#include "comm_registry.h"
+#include "comm_calibration.h"
+#include "comm_link.h"
+
+#include <zephyr/fs/nvs.h>
+#include <zephyr/drivers/uart.h>
+
+#include <atomic>
+#include <thread>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <termios.h>
+#include <unistd.h>
+
+SpinAPI spin;
+TaskAPI task;
+DataAPI data;
+
+// Measurements, defined by the application on the board
+float32_t V1_low_value;
+float32_t V2_low_value;
+float32_t I1_low_value;
+float32_t I2_low_value;
+float32_t I_high_value;
+float32_t V_high_value;
+float32_t P_high_value;     // Derived quantity, the input power
+
+#define SIM_INPUT_VOLTAGE 48.0
+#define SIM_LOAD_RESISTANCE 10.0
+#define SIM_UART_BURST_NS 1000000   // Output the UART can get ahead of its pace before the writer sleeps
+
+static int console_fd = -1;
+static bool verbose = false;
+static std::atomic<bool> running(true);
+static std::atomic<uint32_t> uart_baud(0);  // 0 for a USB console, which has no baud rate
+
+
+int console_getchar()
+{
+    uint8_t byte;
+    while (read(console_fd, &byte, 1) != 1)
+    {
+        usleep(1000);
+    }
+    return byte;
+}
+
+
+/**
+ * @brief Reads the baud rate the host set on the pseudo-terminal.
+ *
+ * @return The baud rate, 0 if it is not a standard one.
+ */
+static uint32_t host_baud()
+{
+    static const struct { speed_t speed; uint32_t baud; } speeds[] = {
+        {B9600, 9600}, {B19200, 19200}, {B38400, 38400}, {B57600, 57600}, {B115200, 115200}, {B230400, 230400},
+        {B460800, 460800}, {B500000, 500000}, {B576000, 576000}, {B921600, 921600}, {B1000000, 1000000}};
+    struct termios settings;
+    if (tcgetattr(console_fd, &settings) != 0) return 0;
+
+    speed_t speed = cfgetospeed(&settings);
+    for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+    {
+        if (speeds[i].speed == speed) return speeds[i].baud;
+    }
+    return 0;
+}
+
+
+/**
+ * @brief Tells whether the host and the simulated console use the same baud rate, always true without a UART.
+ */
+static bool uart_in_sync()
+{
+    uint32_t baud = uart_baud;
+    return baud == 0 || host_baud() == baud;
+}
+
+
+/**
+ * @brief Waits for the UART to be able to send a byte, at 10 bits per byte.
+ */
+static void uart_pace(uint32_t baud)
+{
+    static struct timespec next = {0, 0};
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t ahead_ns = (next.tv_sec - now.tv_sec) * 1000000000LL + (next.tv_nsec - now.tv_nsec);
+    if (ahead_ns < 0)
+    {
+        next = now;
+        ahead_ns = 0;
+    }
+
+    next.tv_nsec += 10000000000LL / baud;
+    while (next.tv_nsec >= 1000000000)
+    {
+        next.tv_nsec -= 1000000000;
+        next.tv_sec++;
+    }
+    if (ahead_ns > SIM_UART_BURST_NS) clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+}
+
+
+int uart_config_get(const struct device *, struct uart_config *cfg)
+{
+    if (uart_baud == 0) return -ENOSYS;
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->baudrate = uart_baud;
+    return 0;
+}
+
+
+int uart_configure(const struct device *, const struct uart_config *cfg)
+{
+    if (uart_baud == 0) return -ENOSYS;
+    uart_baud = cfg->baudrate;
+    if (verbose) fprintf(stderr, "UART at %u baud\n", cfg->baudrate);
+    return 0;
+}
+
+
+int console_putchar(char c)
+{
+    uint32_t baud = uart_baud;
+    if (baud != 0)
+    {
+        uart_pace(baud);
+        // The host reading at another baud rate does not get the byte
+        if (host_baud() != baud) return c;
+    }
+    while (write(console_fd, &c, 1) != 1)
+    {
+        usleep(100);
+    }
+    return c;
+}
+
+
+int printk(const char *format, ...)
+{
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length > (int)sizeof(line) - 1) length = sizeof(line) - 1;
+
+    for (int i = 0; i < length; i++)
+    {
+        console_putchar(line[i]);
+    }
+    if (verbose) fputs(line, stderr);
+    return length;
+}
+
+
+/**
+ * @brief Opens the pseudo-terminal of the simulated console in raw mode.
+ *
+ * @return The path of the device to open from the host.
+ */
+static const char *open_console()
+{
+    console_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (console_fd < 0 || grantpt(console_fd) != 0 || unlockpt(console_fd) != 0) return NULL;
+
+    struct termios settings;
+    tcgetattr(console_fd, &settings);
+    cfmakeraw(&settings);
+    tcsetattr(console_fd, TCSANOW, &settings);
+    fcntl(console_fd, F_SETFL, fcntl(console_fd, F_GETFL) | O_NONBLOCK);
+    return ptsname(console_fd);
+}
+
+
+/**
+ * @brief Measurement of a simulated channel, with the calibration of the DataAPI applied.
+ */
+static float32_t measure(channel_t channel, float32_t value)
+{
+    return value * data.gain[channel] + data.offset[channel];
+}
+
+
+/**
+ * @brief Updates the measurements from a resistive load on both legs in buck mode.
+ */
+static void converter_model()
+{
+    bool powered = (control_setpoints.mode == POWER_ON);
+    float32_t v_low[2];
+    for (uint8_t leg = 0; leg < 2; leg++)
+    {
+        bool leg_on = powered && control_setpoints.legs[leg].settings[BOOL_LEG];
+        v_low[leg] = leg_on ? control_setpoints.legs[leg].duty_cycle * SIM_INPUT_VOLTAGE : 0;
+    }
+    V_high_value = measure(V_HIGH, SIM_INPUT_VOLTAGE);
+    V1_low_value = measure(V1_LOW, v_low[0]);
+    V2_low_value = measure(V2_LOW, v_low[1]);
+    I1_low_value = measure(I1_LOW, v_low[0] / SIM_LOAD_RESISTANCE);
+    I2_low_value = measure(I2_LOW, v_low[1] / SIM_LOAD_RESISTANCE);
+    I_high_value = measure(I_HIGH, (v_low[0] * v_low[0] + v_low[1] * v_low[1]) / SIM_LOAD_RESISTANCE / SIM_INPUT_VOLTAGE);
+    P_high_value = V_high_value * I_high_value;
+}
+
+
+static void rx_thread()
+{
+    uint8_t chunk[64];
+    while (running)
+    {
+        ssize_t length = read(console_fd, chunk, sizeof(chunk));
+        if (length <= 0)
+        {
+            usleep(100);
+            continue;
+        }
+        // Nor does the board get the bytes sent at another baud rate
+        if (!uart_in_sync()) continue;
+        for (ssize_t i = 0; i < length; i++)
+        {
+            // The pseudo-terminal keeps what is not read yet, so wait for space rather than dropping bytes
+            while (running && ring_space(&rx_ring) == 0) usleep(20);
+            receiver_push(chunk[i]);
+        }
+    }
+}
+
+
+static void control_thread(uint32_t period_us)
+{
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (running)
+    {
+        setpoints_acquire();
+        sequence_tick();
+        converter_model();
+        telemetry_tick();
+        capture_sample();
+
+        next.tv_nsec += period_us * 1000;
+        while (next.tv_nsec >= 1000000000)
+        {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+}
+
+
+/**
+ * @brief Prints the status line parsed by Twist_Device.getMeasurement().
+ */
+static void print_status()
+{
+    printk("%.5f:%.5f:%.5f:%d:%.5f:%.5f:%.5f:%d:%.5f:%.5f:%d:%d:%d:%d\n",
+           power_leg_settings[0].duty_cycle, V1_low_value, I1_low_value, power_leg_settings[0].settings[BOOL_LEG],
+           power_leg_settings[1].duty_cycle, I2_low_value, V2_low_value, power_leg_settings[1].settings[BOOL_LEG],
+           V_high_value, I_high_value, analog_value, can_test_ctrl_enable, CAN_Bus_receive, rx_consigne.test_RS485);
+}
+
+
+static void application_thread(uint32_t status_period_ms)
+{
+    static const char *mode_names[] = {"IDLE", "POWER_ON", "POWER_OFF"};
+    uint32_t last_status = k_uptime_get_32();
+    while (running)
+    {
+        comm_background_task();
+
+        if (!print_done)
+        {
+            printk("%s MODE\n", mode_names[mode]);
+            print_done = true;
+        }
+        if (mode == POWER_ON && status_period_ms > 0 && k_uptime_get_32() - last_status >= status_period_ms)
+        {
+            last_status = k_uptime_get_32();
+            print_status();
+        }
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    uint32_t period_us = 100;
+    uint32_t status_period_ms = 100;
+    int option;
+    while ((option = getopt(argc, argv, "p:s:n:b:v")) != -1)
+    {
+        switch (option)
+        {
+        case 'p':
+            period_us = atoi(optarg);
+            break;
+        case 's':
+            status_period_ms = atoi(optarg);
+            break;
+        case 'n':
+            host_nvs_path = optarg;
+            break;
+        case 'b':
+            uart_baud = atoi(optarg);
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-p control_period_us] [-s status_period_ms] [-n nvs_file] [-b baud] [-v]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    const char *port = open_console();
+    if (port == NULL)
+    {
+        perror("twist_sim: cannot open the pseudo-terminal");
+        return 1;
+    }
+    printf("%s\n", port);
+    fflush(stdout);
+
+    comm_init(period_us);
+    registry_add_derived("PH", &P_high_value);
+    calibration_restore();
+    setpoints_init();
+    std::thread rx(rx_thread);
+    std::thread control(control_thread, period_us);
+    application_thread(status_period_ms);
+
+    running = false;
+    rx.join();
+    control.join();
+    return 0;
+}
@@ -5,9 +5,12 @@
 
 #Python modules import
 import time, serial
+import twist_frame, twist_stats, twist_sequence, twist_calibration, twist_events, twist_link
+# twist_telemetry, twist_capture and twist_recorder need numpy, so they are imported by the methods using them: the
+# text commands work without numpy
 
 class Twist_Device:
-    def __init__(self, twist_port, baudrate = 115200, bytesize = 8, parity = "N", stopbits = 1, timeout_sec = 2, product_id = 0x0100, vendor_id = 0x2fe3):
+    def __init__(self, twist_port, baudrate = 115200, bytesize = 8, parity = "N", stopbits = 1, timeout_sec = 2, product_id = 0x0100, vendor_id = 0x2fe3, negotiate = False, max_baudrate = None):
 
         self.twist_serialObj = serial.Serial(port = twist_port)
         self.CommPortDescWithoutPort = "TWIST"
@@ -41,6 +44,23 @@ class Twist_Device:
                                     "CR": {"index": 12},
                                     "RS": {"index": 13}}
 
+        self.telemetry_channels = 0
+        self.telemetry_compressed = False
+        self.telemetry_decoder = None
+        self.telemetry_backlog = []
+        self.recorder = None
+        self.event_decoder = None
+        self.event_callbacks = []
+
+        self.ack_decoder = twist_frame.AckDecoder()
+        self.next_sequence = 0
+        self.pending_commands = set()
+        self.acknowledgements = {}
+
+        self.link = None
+        if negotiate:
+            self.negotiateLink(max_baudrate)
+
 
     def setSerialPort(self, port):
         self.CommPort = port
@@ -117,7 +137,7 @@ class Twist_Device:
 
         size_check = False
         while size_check == False:
-            reading = self.get_TWIST_line()
+            reading = self.getLine()
             reading = [elem.replace('{', '').replace('}', '') for elem in reading] #eliminates curly brackets from the message
             if len(reading) == 14 : size_check = True               #14 is the length of the communication buffer
 
@@ -158,6 +178,7 @@ class Twist_Device:
                 - "BOOST": Controls the state of a boost converter on the Twist board.
                 - "REFERENCE": Sets the reference value for a specific variable on the Twist board.
                 - "DUTY": Sets the duty cycle value for a specific leg on the Twist board.
+                - "DUTY_SCALED": Same as "DUTY", sent as an integer number of parts per 100000.
                 - "CALIBRATE": Calibrates a specific variable on the Twist board.
             *args: Optional arguments corresponding to the action.
             delay (float, optional): The delay (in seconds) after sending the command. Default is 0.2 seconds.
@@ -172,8 +193,31 @@ class Twist_Device:
             To set leg A to ON:
             >>> sendCommand("LEG", "A", "ON")
         """
+        # Generate message based on action and arguments
+        message = self.formatCommand(action, *args)
+
+        # Send the generated message via serial communication
+        self.sendMessage(message)
+        time.sleep(delay)
+
+        return message
+
 
-        action_types = ("LEG", "CAPA", "DRIVER", "BUCK", "BOOST", "REFERENCE", "DUTY", "CALIBRATE")
+    def formatCommand(self, action, *args):
+        """
+        Generate the text message of a command, without its end of line.
+
+        Args:
+            action (str): The action to perform, see sendCommand().
+            *args: Optional arguments corresponding to the action.
+
+        Returns:
+            str: The message.
+
+        Raises:
+            ValueError: If an invalid action is provided.
+        """
+        action_types = ("LEG", "CAPA", "DRIVER", "BUCK", "BOOST", "REFERENCE", "DUTY", "DUTY_SCALED", "CALIBRATE")
 
         # Dictionary mapping actions to their message formats
         message_formats = {
@@ -187,6 +231,7 @@ class Twist_Device:
             "BOOST": lambda leg, state: f"s_{leg.upper()}_t_{state.lower()}",
             "REFERENCE": lambda leg, variable, value: f"s_{leg.upper()}_r_{variable.upper()}_{value:.5f}",
             "DUTY": lambda leg, value: f"s_{leg.upper()}_d_{value:.5f}",
+            "DUTY_SCALED": lambda leg, value: f"s_{leg.upper()}_p_{round(value * twist_frame.DUTY_SCALE)}",
             "CALIBRATE": lambda variable, gain, offset: f"k_{variable.upper()}_g_{gain:.8f}_o_{offset:.8f}",
             }
 
@@ -194,11 +239,678 @@ class Twist_Device:
         if action not in message_formats:
             raise ValueError(f"Invalid action: {action}")
 
-        # Generate message based on action and arguments
-        message = message_formats[action](*args) if action in action_types else message_formats[action]
+        return message_formats[action](*args) if action in action_types else message_formats[action]
 
-        # Send the generated message via serial communication
-        self.sendMessage(message)
-        time.sleep(delay)
 
-        return message
+    def submitCommand(self, action, *args, binary=True, window=8):
+        """
+        Send a command carrying a sequence number, without waiting for it to be applied.
+
+        The board acknowledges each such command with its result. At most `window` commands are left
+        unacknowledged: beyond, this method first waits for the oldest acknowledgements.
+
+        Args:
+            action (str): The action to perform, see sendCommand(). "BATCH" sends a batch, args being its
+                list of commands (see sendBatch()).
+            *args: Optional arguments corresponding to the action.
+            binary (bool): Sends a binary frame if True, a text line ending with "#<sequence>" otherwise.
+            window (int): The maximum number of unacknowledged commands.
+
+        Returns:
+            int: The sequence number of the command, see waitAcknowledgements().
+
+        Example:
+            >>> sequence = submitCommand("DUTY", "LEG1", 0.3)
+            >>> waitAcknowledgements([sequence])
+            {0: 'OK'}
+        """
+        if action == "BATCH":
+            return self._submitFrame(lambda sequence: twist_frame.encode_batch(args[0], sequence=sequence), window)
+        if binary:
+            return self._submitFrame(lambda sequence: twist_frame.encode_command(action, *args, sequence=sequence), window)
+        return self._submitFrame(lambda sequence: f"{self.formatCommand(action, *args)}#{sequence}\r\n".encode(), window)
+
+
+    def _submitFrame(self, encode, window=8):
+        """
+        Send the data built by encode(sequence) with the next sequence number, see submitCommand().
+        """
+        while len(self.pending_commands) >= window:
+            self._receive(keep_telemetry=True)
+
+        sequence = self.next_sequence
+        self.next_sequence = (sequence + 1) % twist_frame.SEQUENCE_MODULO
+        data = encode(sequence)
+
+        self.pending_commands.add(sequence)
+        self.acknowledgements.pop(sequence, None)
+        self.twist_serialObj.write(data)
+
+        return sequence
+
+
+    def waitAcknowledgements(self, sequences=None, timeout=None):
+        """
+        Wait for the acknowledgements of commands sent with submitCommand().
+
+        Args:
+            sequences (list of int): The sequence numbers to wait for, all the pending commands by default.
+            timeout (float): The maximum time to wait, in seconds, the serial timeout by default.
+
+        Returns:
+            dict: The result of each command, a name of twist_frame.STATUSES ('OK', 'RANGE', ...).
+
+        Raises:
+            TimeoutError: If an acknowledgement is not received in time.
+        """
+        sequences = list(self.pending_commands) if sequences is None else list(sequences)
+        deadline = time.monotonic() + (self.Timeout_s if timeout is None else timeout)
+        while any(sequence in self.pending_commands for sequence in sequences):
+            if time.monotonic() > deadline:
+                raise TimeoutError(f"No acknowledgement for {len(self.pending_commands)} commands")
+            self._receive(keep_telemetry=True)
+
+        return {sequence: self.acknowledgements.pop(sequence) for sequence in sequences}
+
+
+    def sendCommands(self, commands, binary=True, window=8):
+        """
+        Send a list of commands, keeping up to `window` of them in flight instead of sleeping after each one.
+
+        Args:
+            commands (list of tuple): The commands, each one being a tuple (action, *args) with the same
+                actions and arguments as sendCommand().
+            binary (bool): Sends binary frames if True, text lines otherwise.
+            window (int): The maximum number of unacknowledged commands.
+
+        Returns:
+            list: The result of each command, in order, as a name of twist_frame.STATUSES.
+
+        Example:
+            >>> sendCommands([("DUTY", "LEG1", duty) for duty in (0.1, 0.2, 0.3)])
+            ['OK', 'OK', 'OK']
+        """
+        sequences = [self.submitCommand(action, *args, binary=binary, window=window) for action, *args in commands]
+        results = self.waitAcknowledgements(sequences)
+
+        return [results[sequence] for sequence in sequences]
+
+
+    def _receive(self, keep_telemetry=False):
+        """
+        Read the bytes received since the last call, waiting for at least one up to the serial timeout.
+
+        The acknowledgements are recorded, the events are passed to the callbacks of onEvent() and the telemetry
+        records are returned, or kept for the next call to getTelemetry() if keep_telemetry is True.
+        """
+        return self._dispatch(self.twist_serialObj.read(max(1, self.twist_serialObj.in_waiting)), keep_telemetry)
+
+
+    def _dispatch(self, data, keep_telemetry=False):
+        """
+        Separate the acknowledgements, the events and the telemetry records of the received bytes, see _receive().
+        """
+        for sequence, opcode, status in self.ack_decoder.feed(data):
+            if sequence in self.pending_commands:
+                self.pending_commands.discard(sequence)
+                self.acknowledgements[sequence] = status
+
+        if self.event_decoder is not None:
+            for event in self.event_decoder.feed(data):
+                for callback in self.event_callbacks:
+                    callback(event)
+
+        # No telemetry is decoded before the stream is started, nor read
+        if self.telemetry_decoder is None:
+            return None
+        records = self.telemetry_decoder.feed(data)
+        if keep_telemetry and len(records):
+            self.telemetry_backlog.append(records)
+        return records
+
+
+    def sendBinaryCommand(self, action, *args):
+        """
+        Send a command to the Twist board as a binary frame.
+
+        This method takes the same actions and arguments as sendCommand() but sends a single binary frame
+        carrying the raw float values, without chunking nor text formatting.
+
+        Args:
+            action (str): The action to perform, see sendCommand().
+            *args: Optional arguments corresponding to the action.
+
+        Returns:
+            bytes: The frame sent to the Twist board.
+
+        Raises:
+            ValueError: If an invalid action is provided.
+
+        Example:
+            To set the duty cycle of leg 1:
+            >>> sendBinaryCommand("DUTY", "LEG1", 0.02233)
+        """
+        frame = twist_frame.encode_command(action, *args)
+        self.twist_serialObj.write(frame)
+
+        return frame
+
+
+    def sendBatch(self, commands):
+        """
+        Send several commands to the Twist board in a single binary frame.
+
+        The board applies all the commands at the beginning of the same control period, or none of them if
+        one is invalid, so the legs never go through intermediate states.
+
+        Args:
+            commands (list of tuple): The commands, each one being a tuple (action, *args) with the same
+                actions and arguments as sendCommand(). Calibrations cannot be batched.
+
+        Returns:
+            bytes: The frame sent to the Twist board.
+
+        Example:
+            To configure both legs at once:
+            >>> sendBatch([("LEG", "LEG1", "ON"), ("LEG", "LEG2", "ON"), ("DUTY", "LEG1", 0.3), ("DUTY", "LEG2", 0.3)])
+        """
+        frame = twist_frame.encode_batch(commands)
+        self.twist_serialObj.write(frame)
+
+        return frame
+
+
+    def negotiateLink(self, max_baudrate=None):
+        """
+        Ask the board what the link can carry and switch to the highest baud rate both sides support.
+
+        This handshake runs when the device is created with negotiate=True, it is off by default since a firmware
+        without link negotiation never answers and only costs the connection its timeouts. A USB link has no baud
+        rate to negotiate, and a board that does not answer keeps the link as it is.
+
+        Args:
+            max_baudrate (int): The highest baud rate to switch to, the highest one of twist_link.HOST_BAUDS by default.
+
+        Returns:
+            dict: The capabilities of the link (see twist_link.decode_info()), None if the board does not support
+            the negotiation.
+        """
+        sequence = self.next_sequence
+        self.next_sequence = (sequence + 1) % twist_frame.SEQUENCE_MODULO
+        self.link = twist_link.negotiate(self.twist_serialObj, max_baudrate, sequence)
+        self.baudRate = self.twist_serialObj.baudrate
+
+        return self.link
+
+
+    def getLinkInfo(self):
+        """
+        Read the capabilities of the link: control period, baud rates, throughput and supported encodings.
+
+        Telemetry records received meanwhile are kept for the next call to getTelemetry().
+
+        Returns:
+            dict: The capabilities, see twist_link.decode_info().
+
+        Raises:
+            TimeoutError: If the board does not answer within the serial timeout.
+        """
+        self.twist_serialObj.write(twist_link.encode_info())
+        self.link = twist_link.decode_info(self._waitFrame(twist_link.OPCODE_LINK, "link request"))
+
+        return self.link
+
+
+    def setTelemetryPeriod(self, period_us=None):
+        """
+        Start the binary telemetry stream with one record every `period_us` microseconds, whatever the control
+        period of the board.
+
+        Args:
+            period_us (int): The period of the records, rounded up to a multiple of the control period. By default,
+                the shortest one the link sustains for the subscribed channels and the selected stream (see
+                twist_link.fastest_period()).
+
+        Returns:
+            str: The result of the command, a name of twist_frame.STATUSES.
+
+        Example:
+            >>> setTelemetryPeriod(1000)
+            'OK'
+        """
+        if period_us is None:
+            link = self.link or self.getLinkInfo()
+            period_us = twist_link.fastest_period(link, self.telemetry_channels, self.telemetry_compressed)
+        self._resetTelemetryDecoder()
+        sequence = self._submitFrame(lambda sequence: twist_link.encode_rate(period_us, sequence))
+
+        return self.waitAcknowledgements([sequence])[sequence]
+
+
+    def startTelemetry(self, decimation=1):
+        """
+        Start the binary telemetry stream of the Twist board.
+
+        Args:
+            decimation (int): The number of control periods between two records.
+
+        Returns:
+            None
+        """
+        self._resetTelemetryDecoder()
+        import twist_telemetry
+        self.twist_serialObj.write(twist_telemetry.encode_start(decimation))
+
+
+    def stopTelemetry(self):
+        """
+        Stop the binary telemetry stream of the Twist board.
+
+        Returns:
+            None
+        """
+        import twist_telemetry
+        self.twist_serialObj.write(twist_telemetry.encode_start(0))
+
+
+    def subscribeTelemetry(self, channels):
+        """
+        Select the channels sent in the telemetry records.
+
+        Args:
+            channels (list of str or int): The names of the channels, among 'V1', 'V2', 'VH', 'I1', 'I2', 'IH',
+                'D1', 'D2', 'R1', 'R2', 'S1', 'S2', 'MO', 'RS', 'SY', 'CT', 'CB', 'AM', 'ST', 'AN', 'CR', or
+                the corresponding bitmask. An empty list returns to the full record.
+
+        Returns:
+            None
+        """
+        import twist_telemetry
+        self.twist_serialObj.write(twist_telemetry.encode_subscribe(channels))
+        self.telemetry_channels = channels
+        self._resetTelemetryDecoder()
+
+
+    def compressTelemetry(self, records_per_frame=16, quantum_exponent=3):
+        """
+        Select the compressed telemetry stream, which packs several delta encoded records in each frame.
+
+        Args:
+            records_per_frame (int): The maximum number of records per frame, 0 to return to the uncompressed records.
+            quantum_exponent (int): The float channels are rounded to a multiple of 10^-quantum_exponent.
+
+        Returns:
+            None
+        """
+        import twist_telemetry
+        self.twist_serialObj.write(twist_telemetry.encode_compress(records_per_frame, quantum_exponent))
+        self.telemetry_compressed = records_per_frame > 0
+        self._resetTelemetryDecoder()
+
+
+    def _resetTelemetryDecoder(self):
+        """
+        Create the decoder of the selected telemetry stream and discard the records of the previous one.
+        """
+        import twist_telemetry
+        if self.telemetry_compressed:
+            self.telemetry_decoder = twist_telemetry.CompressedDecoder(self.telemetry_channels)
+        else:
+            self.telemetry_decoder = twist_telemetry.TelemetryDecoder(self.telemetry_channels)
+        self.telemetry_backlog = []
+
+
+    def getTelemetry(self):
+        """
+        Read the telemetry records received since the last call.
+
+        This method waits for at least one byte (up to the serial timeout) and then decodes all the bytes
+        already received, so it returns many records at once at high rates.
+
+        Returns:
+            numpy.ndarray: The records, as a structured array with the fields sequence, timestamp_us,
+            V1, V2, VH, I1, I2, IH, D1, D2, mode, settings1 and settings2, or sequence, timestamp_us and
+            the subscribed channels after subscribeTelemetry(). The compressed stream has no frame fields: its
+            records hold sequence, timestamp_us and the channels of compressed_dtype().
+        """
+        import numpy as np
+        if self.telemetry_decoder is None:
+            self._resetTelemetryDecoder()
+        records = self._receive()
+        if self.telemetry_backlog:
+            records = np.concatenate(self.telemetry_backlog + [records])
+            self.telemetry_backlog = []
+
+        return records
+
+
+    def startRecording(self, path, stream="telemetry", chunk_records=4096):
+        """
+        Start recording the telemetry records or the status lines into a columnar recording (see twist_recorder.py).
+
+        The recording runs in background threads which read the serial port, so no other method reading the
+        board may be called until stopRecording().
+
+        Args:
+            path (str): The directory of the recording, which must not hold a recording yet.
+            stream (str): "telemetry" for the records of the selected telemetry stream, "status" for the status
+                lines read by getMeasurement().
+            chunk_records (int): The number of records appended to the recording at once.
+
+        Returns:
+            None
+        """
+        import twist_recorder
+        self.recorder = twist_recorder.TwistRecorder(self.twist_serialObj, path, stream=stream,
+                                                     channels=self.telemetry_channels,
+                                                     compressed=self.telemetry_compressed,
+                                                     chunk_records=chunk_records)
+        self.recorder.start()
+
+
+    def stopRecording(self):
+        """
+        Stop the recording once the received data is written.
+
+        Returns:
+            int: The number of records of the recording.
+        """
+        records = self.recorder.stop()
+        self.recorder = None
+        return records
+
+
+    def onEvent(self, callback):
+        """
+        Register a function called with each event of the board, once subscribed with subscribeEvents().
+
+        The callbacks are called from the methods reading the board (getTelemetry(), sendCommands(), pollEvents(),
+        ...), in the order of the events.
+
+        Args:
+            callback (callable): Called with a twist_events.Event.
+
+        Returns:
+            None
+        """
+        self.event_callbacks.append(callback)
+
+
+    def subscribeEvents(self, kinds=None):
+        """
+        Select the state changes reported by the board as events, instead of polling the status line.
+
+        The board first sends the current value of each selected kind, then only its changes.
+
+        Args:
+            kinds (list of str or int): The kinds of events, among 'MODE', 'SETTING', 'DUTY', 'REFERENCE', 'GAIN' and
+                'OFFSET', or the corresponding bitmask. All of them by default, an empty list stops the events.
+
+        Returns:
+            str: The result of the subscription, a name of twist_frame.STATUSES.
+        """
+        self.event_decoder = twist_events.EventDecoder() if twist_events.kinds_mask(kinds) else None
+        sequence = self._submitFrame(lambda sequence: twist_events.encode_subscribe(kinds, sequence=sequence))
+        return self.waitAcknowledgements([sequence])[sequence]
+
+
+    def pollEvents(self, duration=0.0):
+        """
+        Read the board for `duration` seconds, passing the events received to the callbacks of onEvent().
+
+        At least one read is made, which waits for a byte up to the serial timeout. The telemetry records
+        received meanwhile are kept for the next call to getTelemetry().
+
+        Returns:
+            None
+        """
+        deadline = time.monotonic() + duration
+        self._receive(keep_telemetry=True)
+        while time.monotonic() < deadline:
+            self._receive(keep_telemetry=True)
+
+
+    def armCapture(self, channels, pre_trigger, post_trigger, trigger="MANUAL", channel="V1", threshold=0.0):
+        """
+        Arm an on-device capture of the tracking variables at the control rate.
+
+        The board ignores the command while a capture is armed or triggered, see triggerCapture().
+
+        Args:
+            channels (list of str): The captured channels, among 'V1', 'V2', 'VH', 'I1', 'I2', 'IH'.
+            pre_trigger (int): The number of samples kept before the trigger.
+            post_trigger (int): The number of samples recorded after the trigger.
+            trigger (str): "MANUAL" (see triggerCapture()), "RISING" or "FALLING" threshold crossing, or
+                "MODE" for a mode change.
+            channel (str): The channel compared to the threshold.
+            threshold (float): The threshold of the "RISING" and "FALLING" triggers.
+
+        Returns:
+            None
+        """
+        import twist_capture
+        self.twist_serialObj.write(twist_capture.encode_arm(channels, pre_trigger, post_trigger, trigger, channel, threshold))
+
+
+    def triggerCapture(self):
+        """
+        Fire the trigger of the armed capture.
+
+        Returns:
+            None
+        """
+        import twist_capture
+        self.twist_serialObj.write(twist_capture.encode_command(twist_capture.CMD_TRIGGER))
+
+
+    def getStatistics(self, reset=False):
+        """
+        Read the protocol statistics of the board: traffic counters and cycles spent in each handler.
+
+        Telemetry records received meanwhile are kept for the next call to getTelemetry().
+
+        Args:
+            reset (bool): Whether the board clears its statistics once sent.
+
+        Returns:
+            dict: The counters bytes_received, lines, frames, parse_errors, unknown_commands, rejected_commands,
+            rx_overruns and tx_dropped, and "cycles", a dict giving the (min, max, mean) cycles of each handler.
+
+        Raises:
+            TimeoutError: If the board does not answer within the serial timeout.
+        """
+        self.twist_serialObj.write(twist_stats.encode_request(reset))
+        return twist_stats.decode_stats(self._waitFrame(twist_stats.OPCODE_STATS, "statistics request"))
+
+
+    def getCalibrations(self):
+        """
+        Read the calibrations of all the channels of the board.
+
+        Telemetry records received meanwhile are kept for the next call to getTelemetry().
+
+        Returns:
+            list: (gain, offset) of each channel, by index, twist_calibration.UNCHANGED (NaN) for the channels never
+            calibrated and the derived quantities.
+
+        Raises:
+            TimeoutError: If the board does not answer within the serial timeout.
+        """
+        calibrations = []
+        while True:
+            self.twist_serialObj.write(twist_calibration.encode_get(len(calibrations)))
+            payload = self._waitFrame(twist_calibration.OPCODE_CALIBRATIONS, "calibration request")
+            _, channels, values = twist_calibration.decode_get(payload)
+            calibrations += values
+            if len(calibrations) >= channels or not values:
+                return calibrations
+
+
+    def setCalibrations(self, calibrations, commit=False):
+        """
+        Calibrate all the channels of the board at once, in a single frame for up to 15 channels.
+
+        Args:
+            calibrations (list): (gain, offset) of each channel, by index, twist_calibration.UNCHANGED for the
+                channels to leave as they are.
+            commit (bool): Whether to save the calibrations in the flash of the board, to be restored at startup.
+
+        Returns:
+            str: 'OK', or the name of the status of the first rejected frame ('VARIABLE', 'RANGE', 'STORAGE', ...).
+
+        Example:
+            >>> setCalibrations([(1.02, -0.1), twist_calibration.UNCHANGED, (0.98, 0.05)], commit=True)
+        """
+        per_frame = twist_calibration.CHANNELS_PER_FRAME
+        sequences = [self._submitFrame(lambda sequence, first=first: twist_calibration.encode_set(
+                         calibrations[first:first + per_frame], first, sequence))
+                     for first in range(0, len(calibrations), per_frame)]
+        if commit:
+            sequences.append(self._submitFrame(
+                lambda sequence: twist_calibration.encode_command(twist_calibration.CMD_COMMIT, sequence)))
+        statuses = self.waitAcknowledgements(sequences)
+        return next((statuses[sequence] for sequence in sequences if statuses[sequence] != "OK"), "OK")
+
+
+    def commitCalibrations(self):
+        """
+        Save the current calibrations of the board in its flash, to be restored at startup.
+
+        Returns:
+            str: 'OK', or 'STORAGE' if the flash cannot be written.
+        """
+        sequence = self._submitFrame(
+            lambda sequence: twist_calibration.encode_command(twist_calibration.CMD_COMMIT, sequence))
+        return self.waitAcknowledgements([sequence])[sequence]
+
+
+    def eraseCalibrations(self):
+        """
+        Delete the calibrations saved in the flash of the board, the current ones being kept until the next reset.
+
+        Returns:
+            str: 'OK', or 'STORAGE' if the flash cannot be written.
+        """
+        sequence = self._submitFrame(
+            lambda sequence: twist_calibration.encode_command(twist_calibration.CMD_ERASE, sequence))
+        return self.waitAcknowledgements([sequence])[sequence]
+
+
+    def _readFrames(self, request):
+        """
+        Read the frames answering a request. The acknowledgements, events and telemetry received meanwhile go
+        through _dispatch() as with any other read, the telemetry being kept for getTelemetry().
+
+        Yields:
+            tuple: The frames received, as returned by twist_frame.FrameDecoder.
+
+        Raises:
+            TimeoutError: If nothing is received within the serial timeout.
+        """
+        decoder = twist_frame.FrameDecoder()
+        while True:
+            data = self.twist_serialObj.read(max(1, self.twist_serialObj.in_waiting))
+            if not data:
+                raise TimeoutError(f"No answer to the {request}")
+            self._dispatch(data, keep_telemetry=True)
+            yield from decoder.feed(data)
+
+
+    def _waitFrame(self, opcode, request):
+        """
+        Wait for the answer of the board to a request, see _readFrames().
+
+        Returns:
+            bytes: The payload of the first frame of the given opcode.
+        """
+        for frame_opcode, _, _, payload in self._readFrames(request):
+            if frame_opcode == ord(opcode):
+                return payload
+
+
+    def loadSequence(self, entries):
+        """
+        Upload a setpoint sequence, played back by the board at the control rate with startSequence().
+
+        Args:
+            entries (list): The entries of the sequence, built with twist_sequence.step() and twist_sequence.ramp()
+                and sorted by period.
+
+        Returns:
+            str: 'OK', or the name of the status of the first rejected frame ('RANGE', 'BUSY', ...).
+
+        Example:
+            >>> from twist_sequence import step, ramp
+            >>> loadSequence([step(0, "DUTY", "LEG1", 0.1), ramp(0, 10000, "DUTY", "LEG1", 0.5)])
+        """
+        sequences = [self._submitFrame(lambda sequence, payload=payload: twist_sequence.encode_payload(payload, sequence))
+                     for payload in twist_sequence.load_payloads(entries)]
+        statuses = self.waitAcknowledgements(sequences)
+        return next((statuses[sequence] for sequence in sequences if statuses[sequence] != "OK"), "OK")
+
+
+    def startSequence(self, loops=1):
+        """
+        Start the playback of the uploaded sequence.
+
+        Args:
+            loops (int): The number of times the sequence is played, 0 to play it until stopSequence().
+
+        Returns:
+            str: 'OK', 'BUSY' if a sequence is already playing, 'RANGE' if no sequence is loaded.
+        """
+        sequence = self._submitFrame(lambda sequence: twist_sequence.encode_start(loops, sequence))
+        return self.waitAcknowledgements([sequence])[sequence]
+
+
+    def stopSequence(self):
+        """
+        Stop the playback of the sequence, the settings it drives keeping their current values.
+
+        Returns:
+            None
+        """
+        self.twist_serialObj.write(twist_sequence.encode_command(twist_sequence.CMD_STOP))
+
+
+    def getSequenceStatus(self):
+        """
+        Read the playback status of the sequence.
+
+        Telemetry records received meanwhile are kept for the next call to getTelemetry().
+
+        Returns:
+            dict: state ('IDLE', 'ARMED', 'PLAYING' or 'DONE'), entries, position (index of the next entry),
+            period and loop.
+
+        Raises:
+            TimeoutError: If the board does not answer within the serial timeout.
+        """
+        self.twist_serialObj.write(twist_sequence.encode_command(twist_sequence.CMD_STATUS))
+        return twist_sequence.decode_status(self._waitFrame(twist_sequence.OPCODE_SEQUENCE, "sequence status"))
+
+
+    def dumpCapture(self):
+        """
+        Upload the samples of a completed capture.
+
+        The acknowledgements, events and telemetry received meanwhile are handled as by any other read.
+
+        Returns:
+            tuple: (status, samples) where status is a dict with the state of the capture and the number of
+            samples recorded before the trigger, and samples a structured array with one field per channel.
+            samples is empty if the capture is not complete.
+
+        Raises:
+            TimeoutError: If the board does not answer within the serial timeout.
+        """
+        import twist_capture
+        self.twist_serialObj.write(twist_capture.encode_command(twist_capture.CMD_DUMP))
+
+        dump = twist_capture.CaptureDump()
+        for frame in self._readFrames("capture dump"):
+            dump.feed(frame)
+            if dump.complete:
+                break
+
+        return dump.status, dump.samples()
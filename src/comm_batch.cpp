@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Batched power leg settings applied atomically.
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include "comm_batch.h"
+
+static PowerLegSettings power_leg_settings_shadow[REGISTRY_MAX_LEGS];
+
+
+comm_status_t batchHandler(const commFrame_t *frame)
+{
+    if (frame->length == 0 || frame->length % COMM_BATCH_ENTRY_SIZE != 0)
+    {
+        printk("Invalid batch length: %d\n", frame->length);
+        return COMM_ERROR_FORMAT;
+    }
+
+    memcpy(power_leg_settings_shadow, power_leg_settings, sizeof(power_leg_settings_shadow));
+    uint8_t mode_command = COMM_NO_INDEX;
+
+    for (uint8_t position = 0; position < frame->length; position += COMM_BATCH_ENTRY_SIZE)
+    {
+        const uint8_t *entry = frame->payload + position;
+        uint8_t opcode = entry[0];
+        uint8_t leg = entry[1];
+        uint8_t variable = entry[2];
+        float32_t value;
+        memcpy(&value, entry + 3, sizeof(float32_t));
+
+        uint8_t i = find_default_command(opcode);
+        if (i != COMM_NO_INDEX)
+        {
+            mode_command = i;
+            continue;
+        }
+
+        // Same precedence as frameHandler(): the opcode, then the leg, then the setting
+        i = find_power_setting(opcode);
+        if (i == COMM_NO_INDEX || leg >= num_power_legs || power_settings[i].apply == NULL)
+        {
+            printk("Invalid batch entry %c for leg %d\n", opcode, leg);
+            if (i == COMM_NO_INDEX) return COMM_ERROR_UNKNOWN_COMMAND;
+            return (leg >= num_power_legs) ? COMM_ERROR_LEG : COMM_ERROR_UNKNOWN_COMMAND;
+        }
+        comm_status_t status = power_settings[i].apply(&power_leg_settings_shadow[leg], i, variable, value);
+        if (status != COMM_OK)
+        {
+            return status;
+        }
+    }
+
+    memcpy(power_leg_settings, power_leg_settings_shadow, sizeof(power_leg_settings_shadow));
+    if (mode_command != COMM_NO_INDEX) defaultApply(mode_command);
+    return COMM_OK;
+}
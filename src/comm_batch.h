@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Batched power leg settings applied atomically.
+ *
+ * A batch frame (opcode COMM_OP_BATCH) carries several updates, each encoded on COMM_BATCH_ENTRY_SIZE bytes:
+ *
+ *   | OPCODE | LEG | VARIABLE | VALUE (little endian float32_t) |
+ *
+ * OPCODE is a letter of default_commands[] or power_settings[]. The updates are staged in a shadow copy of
+ * power_leg_settings[] and the tester mode. If one of them is invalid, the whole batch is dropped. Otherwise
+ * the shadow copy replaces the working copies, which are then published to the control task at once (see
+ * comm_setpoints.h), so the legs never go through the intermediate states of the batch.
+ */
+
+
+#ifndef COMM_BATCH_H
+#define COMM_BATCH_H
+
+#include "comm_frame.h"
+#include "comm_registry.h"
+
+#define COMM_BATCH_ENTRY_SIZE 7
+#define COMM_BATCH_MAX_ENTRIES (COMM_FRAME_MAX_PAYLOAD / COMM_BATCH_ENTRY_SIZE)
+
+/**
+ * @brief Handles a batch frame.
+ *
+ * This function validates all the updates of the batch, then applies them to power_leg_settings[] and the
+ * mode. They reach the control task with the next setpoints_publish().
+ *
+ * @param frame The batch frame.
+ * @return COMM_OK if the batch has been applied, the reason of the rejection otherwise.
+ */
+comm_status_t batchHandler(const commFrame_t *frame);
+
+#endif  //COMM_BATCH_H
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Persistent calibration of the measurement channels (see comm_calibration.h).
+ */
+
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/fs/nvs.h>
+
+#include <math.h>
+
+#include "comm_calibration.h"
+#include "comm_setpoints.h"
+#include "comm_transmitter.h"
+
+static_assert(3 + CALIBRATION_CHANNELS_PER_FRAME * 2 * sizeof(float32_t) <= COMM_FRAME_MAX_PAYLOAD,
+              "a calibration frame must fit in COMM_FRAME_MAX_PAYLOAD");
+
+static struct nvs_fs calibration_fs;
+static bool calibration_fs_mounted = false;
+
+static calibrationImage_t calibration_image;
+static commFrame_t calibration_frame;
+
+
+/**
+ * @brief Mounts the NVS of the storage partition, once.
+ *
+ * @return false if the storage is not available.
+ */
+static bool storage_mount()
+{
+    if (calibration_fs_mounted) return true;
+
+    struct flash_pages_info info;
+    calibration_fs.flash_device = FIXED_PARTITION_DEVICE(storage_partition);
+    if (!device_is_ready(calibration_fs.flash_device)) return false;
+    calibration_fs.offset = FIXED_PARTITION_OFFSET(storage_partition);
+    if (flash_get_page_info_by_offs(calibration_fs.flash_device, calibration_fs.offset, &info) != 0) return false;
+    calibration_fs.sector_size = info.size;
+    calibration_fs.sector_count = CALIBRATION_NVS_SECTORS;
+    if (nvs_mount(&calibration_fs) != 0)
+    {
+        printk("Calibration storage unavailable\n");
+        return false;
+    }
+    calibration_fs_mounted = true;
+    return true;
+}
+
+
+static uint16_t image_crc(const calibrationImage_t *image)
+{
+    return frame_crc16((const uint8_t *)image, offsetof(calibrationImage_t, crc));
+}
+
+
+uint8_t calibration_restore()
+{
+    if (!storage_mount()) return 0;
+    memset(&calibration_image, 0, sizeof(calibration_image));
+    ssize_t length = nvs_read(&calibration_fs, CALIBRATION_NVS_ID, &calibration_image, sizeof(calibration_image));
+    if (length < 0) return 0;
+    if (length != sizeof(calibration_image) || calibration_image.magic != CALIBRATION_IMAGE_MAGIC
+        || calibration_image.version != CALIBRATION_IMAGE_VERSION || calibration_image.count > REGISTRY_MAX_CHANNELS
+        || calibration_image.crc != image_crc(&calibration_image))
+    {
+        printk("Invalid calibration image ignored\n");
+        return 0;
+    }
+
+    uint8_t restored = 0;
+    for (uint8_t r = 0; r < calibration_image.count; r++)
+    {
+        const calibrationRecord_t *record = &calibration_image.records[r];
+        commToken_t name = {record->name, (uint8_t)strnlen(record->name, REGISTRY_NAME_LENGTH)};
+        uint8_t i = find_tracking_var(&name);
+        if (i == COMM_NO_INDEX || !tracking_vars[i].calibrated) continue;
+
+        // The control task is not running yet, the DataAPI is set directly
+        setpoints_calibrate(i, record->gain, record->offset);
+        data.setParameters(tracking_vars[i].channel_reference, record->gain, record->offset);
+        restored++;
+    }
+    printk("Restored %d calibrations\n", restored);
+    return restored;
+}
+
+
+comm_status_t calibration_commit()
+{
+    if (!storage_mount()) return COMM_ERROR_STORAGE;
+
+    memset(&calibration_image, 0, sizeof(calibration_image));
+    calibration_image.magic = CALIBRATION_IMAGE_MAGIC;
+    calibration_image.version = CALIBRATION_IMAGE_VERSION;
+    for (uint8_t i = 0; i < num_tracking_vars; i++)
+    {
+        const commCalibration_t *calibration = setpoints_calibration(i);
+        if (!tracking_vars[i].calibrated || calibration->updates == 0) continue;
+
+        calibrationRecord_t *record = &calibration_image.records[calibration_image.count++];
+        strncpy(record->name, tracking_vars[i].name, REGISTRY_NAME_LENGTH);
+        record->gain = calibration->gain;
+        record->offset = calibration->offset;
+    }
+    calibration_image.crc = image_crc(&calibration_image);
+
+    if (nvs_write(&calibration_fs, CALIBRATION_NVS_ID, &calibration_image, sizeof(calibration_image)) < 0)
+    {
+        printk("Calibration commit failed\n");
+        return COMM_ERROR_STORAGE;
+    }
+    return COMM_OK;
+}
+
+
+/**
+ * @brief Answers a GET command with the calibrations of the channels from the index first.
+ */
+static comm_status_t calibration_get(uint8_t first)
+{
+    if (first > num_tracking_vars) return COMM_ERROR_VARIABLE;
+
+    calibration_frame.opcode = COMM_OP_CALIBRATIONS;
+    calibration_frame.leg = COMM_NO_INDEX;
+    calibration_frame.variable = COMM_NO_INDEX;
+    calibration_frame.payload[0] = CALIBRATION_CMD_GET;
+    calibration_frame.payload[1] = first;
+    calibration_frame.payload[2] = num_tracking_vars;
+    calibration_frame.length = 3;
+    for (uint8_t i = first; i < num_tracking_vars && i < first + CALIBRATION_CHANNELS_PER_FRAME; i++)
+    {
+        const commCalibration_t *calibration = setpoints_calibration(i);
+        bool calibrated = tracking_vars[i].calibrated && calibration->updates != 0;
+        float32_t values[2] = {calibrated ? calibration->gain : NAN, calibrated ? calibration->offset : NAN};
+        memcpy(calibration_frame.payload + calibration_frame.length, values, sizeof(values));
+        calibration_frame.length += sizeof(values);
+    }
+    return transmitter_send_response(&calibration_frame) ? COMM_OK : COMM_ERROR_BUSY;
+}
+
+
+/**
+ * @brief Handles a SET command, validating all the channels of the frame before calibrating any.
+ */
+static comm_status_t calibration_set(const commFrame_t *frame)
+{
+    if (frame->length < 2 || (frame->length - 2) % (2 * sizeof(float32_t)) != 0) return COMM_ERROR_FORMAT;
+    uint8_t first = frame->payload[1];
+    uint8_t count = (frame->length - 2) / (2 * sizeof(float32_t));
+    if (first + count > num_tracking_vars) return COMM_ERROR_VARIABLE;
+
+    for (uint8_t n = 0; n < count; n++)
+    {
+        float32_t gain = frame_get_float(frame, 2 + n * 2 * sizeof(float32_t));
+        float32_t offset = frame_get_float(frame, 2 + n * 2 * sizeof(float32_t) + sizeof(float32_t));
+        if (isnan(gain)) continue;
+        if (!tracking_vars[first + n].calibrated) return COMM_ERROR_VARIABLE;
+        if (!isfinite(gain) || !isfinite(offset)) return COMM_ERROR_RANGE;
+    }
+    for (uint8_t n = 0; n < count; n++)
+    {
+        float32_t gain = frame_get_float(frame, 2 + n * 2 * sizeof(float32_t));
+        float32_t offset = frame_get_float(frame, 2 + n * 2 * sizeof(float32_t) + sizeof(float32_t));
+        if (!isnan(gain)) setpoints_calibrate(first + n, gain, offset);
+    }
+    return COMM_OK;
+}
+
+
+comm_status_t calibrationFrameHandler(const commFrame_t *frame)
+{
+    if (frame->length < 1) return COMM_ERROR_FORMAT;
+
+    switch (frame->payload[0])
+    {
+    case CALIBRATION_CMD_GET:
+        return calibration_get((frame->length >= 2) ? frame->payload[1] : 0);
+    case CALIBRATION_CMD_SET:
+        return calibration_set(frame);
+    case CALIBRATION_CMD_COMMIT:
+        return calibration_commit();
+    case CALIBRATION_CMD_ERASE:
+        if (!storage_mount()) return COMM_ERROR_STORAGE;
+        return (nvs_delete(&calibration_fs, CALIBRATION_NVS_ID) == 0) ? COMM_OK : COMM_ERROR_STORAGE;
+    default:
+        return COMM_ERROR_UNKNOWN_COMMAND;
+    }
+}
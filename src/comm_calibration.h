@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Persistent calibration of the measurement channels.
+ *
+ * The calibrations can be saved into a compact image in the NVS partition of the flash, which
+ * calibration_restore() applies at startup before the control task runs. The image holds a magic number,
+ * a version, the name, gain and offset of each calibrated channel, and a CRC16 of the whole image. Channels
+ * are matched by name, so an image stays valid when the application registers other channels (see
+ * comm_registry.h). An image whose magic number, version or CRC does not match is ignored.
+ *
+ * The calibrations are handled with frames of opcode COMM_OP_CALIBRATIONS whose first payload byte is a command:
+ *
+ * - CALIBRATION_CMD_GET:    | CMD | FIRST (u8) |
+ * - CALIBRATION_CMD_SET:    | CMD | FIRST (u8) | GAIN (f32) | OFFSET (f32) | ... |
+ * - CALIBRATION_CMD_COMMIT: | CMD |
+ * - CALIBRATION_CMD_ERASE:  | CMD |
+ *
+ * SET calibrates the consecutive channels from the index FIRST in tracking_vars[], up to
+ * CALIBRATION_CHANNELS_PER_FRAME of them, the whole frame being rejected if one of them is invalid. A NaN
+ * gain leaves its channel unchanged. COMMIT saves the current calibrations into the image, ERASE deletes the
+ * image without changing the current calibrations. GET is answered with a frame of the same opcode:
+ *
+ * - CALIBRATION_CMD_GET:    | CMD | FIRST (u8) | CHANNELS (u8) | GAIN (f32) | OFFSET (f32) | ... |
+ *
+ * where CHANNELS is the number of registered channels. The channels never calibrated, which keep the
+ * defaults of the DataAPI, and the derived quantities report NaN, so a GET answer can be sent back as is.
+ */
+
+
+#ifndef COMM_CALIBRATION_H
+#define COMM_CALIBRATION_H
+
+#include "comm_frame.h"
+#include "comm_registry.h"
+
+#define COMM_OP_CALIBRATIONS 'K'
+
+#define CALIBRATION_IMAGE_MAGIC 0x4C435754  // "TWCL"
+#define CALIBRATION_IMAGE_VERSION 1
+#define CALIBRATION_NVS_ID 1
+#define CALIBRATION_NVS_SECTORS 2
+#define CALIBRATION_CHANNELS_PER_FRAME ((COMM_FRAME_MAX_PAYLOAD - 3) / (2 * sizeof(float32_t)))
+
+typedef enum
+{
+    CALIBRATION_CMD_GET = 1,
+    CALIBRATION_CMD_SET = 2,
+    CALIBRATION_CMD_COMMIT = 3,
+    CALIBRATION_CMD_ERASE = 4
+} calibration_commands_t;
+
+/**
+ * @brief Structure representing the saved calibration of a channel.
+ */
+typedef struct __attribute__((packed)) {
+    char name[REGISTRY_NAME_LENGTH];    /**< Name of the channel, padded with '\0' */
+    float32_t gain;                     /**< Gain of the channel */
+    float32_t offset;                   /**< Offset of the channel */
+} calibrationRecord_t;
+
+/**
+ * @brief Structure representing the calibration image saved in the NVS.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t magic;                                     /**< CALIBRATION_IMAGE_MAGIC */
+    uint8_t version;                                    /**< CALIBRATION_IMAGE_VERSION */
+    uint8_t count;                                      /**< Number of records in use */
+    calibrationRecord_t records[REGISTRY_MAX_CHANNELS]; /**< Calibrated channels, unused records being null */
+    uint16_t crc;                                       /**< CRC16 of the image up to this field */
+} calibrationImage_t;
+
+/**
+ * @brief Restores the saved calibrations, if any.
+ *
+ * The calibrations are applied to the DataAPI directly and staged as the current ones. This function must be
+ * called once at startup, after the registration of the channels and before setpoints_init(), which
+ * comm_task_start() does.
+ *
+ * @return The number of restored channels.
+ */
+uint8_t calibration_restore();
+
+/**
+ * @brief Saves the current calibrations into the NVS.
+ *
+ * This function must be called from the task handling the commands. It blocks while the flash is written.
+ *
+ * @return COMM_ERROR_STORAGE if the image cannot be written.
+ */
+comm_status_t calibration_commit();
+
+/**
+ * @brief Handles a calibration frame.
+ *
+ * @param frame The decoded frame, of opcode COMM_OP_CALIBRATIONS.
+ * @return The result of the command.
+ */
+comm_status_t calibrationFrameHandler(const commFrame_t *frame);
+
+
+#endif  //COMM_CALIBRATION_H
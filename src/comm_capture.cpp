@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  On-device capture of the tracking variables around an event.
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include "comm_capture.h"
+#include "comm_transmitter.h"
+#include "comm_setpoints.h"
+
+capture_states_t capture_state = CAPTURE_IDLE;
+
+static uint8_t capture_buffer[CAPTURE_BUFFER_SIZE];
+static captureConfig_t capture_config;
+static uint8_t sample_size;         // Bytes per sample
+static uint16_t capture_depth;      // Samples that fit in the buffer
+static uint16_t write_index;        // Next sample written
+static uint16_t recorded;           // Samples recorded, saturated to capture_depth
+static uint16_t pre_recorded;       // Samples recorded before the trigger
+static uint16_t post_recorded;      // Samples recorded after the trigger
+static float32_t previous_value;
+static tester_states_t previous_mode;
+static bool trigger_request = false;
+
+static bool dump_active = false;
+static uint16_t dump_offset;        // Next byte of the dump, from the oldest sample
+static commFrame_t capture_frame;
+
+
+/**
+ * @brief Tells whether the control task is sampling, in which case it owns the configuration and the buffer.
+ */
+static bool capture_sampling()
+{
+    capture_states_t state = __atomic_load_n(&capture_state, __ATOMIC_ACQUIRE);
+    return state == CAPTURE_ARMED || state == CAPTURE_TRIGGERED;
+}
+
+
+bool capture_arm(const captureConfig_t *config)
+{
+    if (dump_active || capture_sampling()) return false;
+
+    uint8_t values = 0;
+    for (uint8_t i = 0; i < num_tracking_vars; i++)
+    {
+        if (config->mask & (1 << i)) values++;
+    }
+    if (values == 0) return false;
+    if (config->trigger != CAPTURE_TRIGGER_MANUAL && config->trigger != CAPTURE_TRIGGER_MODE
+        && config->channel >= num_tracking_vars) return false;
+
+    uint16_t depth = CAPTURE_BUFFER_SIZE / (values * sizeof(float32_t));
+    if ((uint32_t)config->pre_trigger + config->post_trigger > depth || config->post_trigger == 0) return false;
+
+    // The control task does not sample while the capture is idle or done, the configuration is only published
+    // to it by the store of CAPTURE_ARMED below
+    capture_config = *config;
+    sample_size = values * sizeof(float32_t);
+    capture_depth = depth;
+    write_index = 0;
+    recorded = 0;
+    pre_recorded = 0;
+    post_recorded = 0;
+    trigger_request = false;
+    previous_mode = control_setpoints.mode;
+    if (config->trigger == CAPTURE_TRIGGER_RISING || config->trigger == CAPTURE_TRIGGER_FALLING)
+    {
+        previous_value = *tracking_vars[config->channel].address;
+    }
+    __atomic_store_n(&capture_state, CAPTURE_ARMED, __ATOMIC_RELEASE);
+    return true;
+}
+
+
+void capture_trigger()
+{
+    trigger_request = true;
+}
+
+
+/**
+ * @brief Checks whether the configured trigger fired since the previous sample.
+ */
+static bool capture_triggered()
+{
+    if (trigger_request) return true;
+
+    switch (capture_config.trigger)
+    {
+    case CAPTURE_TRIGGER_RISING:
+    case CAPTURE_TRIGGER_FALLING:
+    {
+        float32_t value = *tracking_vars[capture_config.channel].address;
+        bool crossed = (capture_config.trigger == CAPTURE_TRIGGER_RISING)
+                       ? (previous_value < capture_config.threshold && value >= capture_config.threshold)
+                       : (previous_value > capture_config.threshold && value <= capture_config.threshold);
+        previous_value = value;
+        return crossed;
+    }
+    case CAPTURE_TRIGGER_MODE:
+    {
+        bool changed = (control_setpoints.mode != previous_mode);
+        previous_mode = control_setpoints.mode;
+        return changed;
+    }
+    default:
+        return false;
+    }
+}
+
+
+void capture_sample()
+{
+    capture_states_t sampled = __atomic_load_n(&capture_state, __ATOMIC_ACQUIRE);
+    if (sampled != CAPTURE_ARMED && sampled != CAPTURE_TRIGGERED) return;
+    capture_states_t state = sampled;
+
+    uint8_t *sample = capture_buffer + (uint32_t)write_index * sample_size;
+    for (uint8_t i = 0; i < num_tracking_vars; i++)
+    {
+        if (capture_config.mask & (1 << i))
+        {
+            memcpy(sample, tracking_vars[i].address, sizeof(float32_t));
+            sample += sizeof(float32_t);
+        }
+    }
+    write_index = (write_index + 1) % capture_depth;
+    if (recorded < capture_depth) recorded++;
+
+    if (state == CAPTURE_ARMED)
+    {
+        if (!capture_triggered()) return;
+        // The triggering sample is the first post-trigger sample
+        pre_recorded = (recorded - 1 < capture_config.pre_trigger) ? recorded - 1 : capture_config.pre_trigger;
+        post_recorded = 1;
+        state = CAPTURE_TRIGGERED;
+    }
+    else
+    {
+        post_recorded++;
+    }
+
+    if (post_recorded >= capture_config.post_trigger) state = CAPTURE_DONE;
+    // Only the state this sample was taken in is replaced
+    if (state != sampled)
+    {
+        __atomic_compare_exchange_n(&capture_state, &sampled, state, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    }
+}
+
+
+/**
+ * @brief Fills capture_frame with a status response.
+ */
+static void build_status()
+{
+    uint16_t samples = (capture_state == CAPTURE_DONE) ? pre_recorded + post_recorded : 0;
+    capture_frame.opcode = COMM_OP_CAPTURE;
+    capture_frame.leg = COMM_NO_INDEX;
+    capture_frame.variable = COMM_NO_INDEX;
+    capture_frame.payload[0] = CAPTURE_CMD_STATUS;
+    capture_frame.payload[1] = capture_state;
+    capture_frame.payload[2] = capture_config.mask;
+    memcpy(capture_frame.payload + 3, &pre_recorded, sizeof(uint16_t));
+    memcpy(capture_frame.payload + 5, &samples, sizeof(uint16_t));
+    capture_frame.length = 7;
+}
+
+
+void capture_dump_step()
+{
+    if (!dump_active) return;
+
+    uint32_t dump_size = (uint32_t)(pre_recorded + post_recorded) * sample_size;
+    // Oldest sample of the capture, the samples being contiguous modulo the buffer
+    uint32_t first_sample = (write_index + capture_depth - pre_recorded - post_recorded) % capture_depth;
+    uint32_t buffer_size = (uint32_t)capture_depth * sample_size;
+
+    while (dump_offset < dump_size)
+    {
+        uint16_t length = (dump_size - dump_offset < CAPTURE_DATA_PER_FRAME) ? dump_size - dump_offset : CAPTURE_DATA_PER_FRAME;
+        capture_frame.payload[0] = CAPTURE_CMD_DATA;
+        memcpy(capture_frame.payload + 1, &dump_offset, sizeof(uint16_t));
+        for (uint16_t i = 0; i < length; i++)
+        {
+            capture_frame.payload[3 + i] = capture_buffer[(first_sample * sample_size + dump_offset + i) % buffer_size];
+        }
+        capture_frame.length = 3 + length;
+        // Retried at the next call when the transmission ring is full
+        if (ring_space(&response_ring) < COMM_FRAME_HEADER_SIZE + capture_frame.length + COMM_FRAME_CRC_SIZE) return;
+        transmitter_send_response(&capture_frame);
+        dump_offset += length;
+    }
+
+    capture_frame.payload[0] = CAPTURE_CMD_END;
+    capture_frame.length = 1;
+    if (ring_space(&response_ring) < COMM_FRAME_HEADER_SIZE + capture_frame.length + COMM_FRAME_CRC_SIZE) return;
+    transmitter_send_response(&capture_frame);
+    dump_active = false;
+}
+
+
+comm_status_t captureHandler(const commFrame_t *frame)
+{
+    if (frame->length < 1)
+    {
+        printk("Invalid capture frame\n");
+        return COMM_ERROR_FORMAT;
+    }
+
+    switch (frame->payload[0])
+    {
+    case CAPTURE_CMD_ARM:
+    {
+        if (frame->length < 12)
+        {
+            printk("Invalid capture frame\n");
+            return COMM_ERROR_FORMAT;
+        }
+        if (frame->payload[2] > CAPTURE_TRIGGER_MODE)
+        {
+            printk("Invalid capture trigger: %d\n", frame->payload[2]);
+            return COMM_ERROR_RANGE;
+        }
+        captureConfig_t config;
+        config.mask = frame->payload[1];
+        config.trigger = (capture_triggers_t)frame->payload[2];
+        config.channel = frame->payload[3];
+        memcpy(&config.threshold, frame->payload + 4, sizeof(float32_t));
+        memcpy(&config.pre_trigger, frame->payload + 8, sizeof(uint16_t));
+        memcpy(&config.post_trigger, frame->payload + 10, sizeof(uint16_t));
+        if (dump_active || capture_sampling())
+        {
+            printk("Capture in progress\n");
+            return COMM_ERROR_BUSY;
+        }
+        if (!capture_arm(&config))
+        {
+            printk("Invalid capture configuration\n");
+            return COMM_ERROR_RANGE;
+        }
+        break;
+    }
+    case CAPTURE_CMD_TRIGGER:
+        capture_trigger();
+        break;
+    case CAPTURE_CMD_STATUS:
+        build_status();
+        transmitter_send_response(&capture_frame);
+        break;
+    case CAPTURE_CMD_DUMP:
+        if (dump_active) return COMM_ERROR_BUSY;
+        build_status();
+        transmitter_send_response(&capture_frame);
+        if (capture_state != CAPTURE_DONE) break;
+        dump_active = true;
+        dump_offset = 0;
+        capture_dump_step();
+        break;
+    default:
+        printk("unknown capture command %d\n", frame->payload[0]);
+        return COMM_ERROR_UNKNOWN_COMMAND;
+    }
+    return COMM_OK;
+}
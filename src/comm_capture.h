@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  On-device capture of the tracking variables around an event.
+ *
+ * capture_sample(), called by the control task at each control period, writes the selected values of
+ * tracking_vars[] into a circular RAM buffer. Once armed, the capture keeps the last `pre_trigger` samples
+ * and, when the trigger fires, records `post_trigger` more samples before stopping. The buffer is then
+ * uploaded in bulk by a dump command, independently of the acquisition rate.
+ *
+ * The capture is controlled with frames of opcode COMM_OP_CAPTURE whose first payload byte is a command:
+ *
+ * - CAPTURE_CMD_ARM:     | CMD | MASK (u8) | TRIGGER (u8) | CHANNEL (u8) | THRESHOLD (f32) | PRE (u16) | POST (u16) |
+ * - CAPTURE_CMD_TRIGGER: | CMD |
+ * - CAPTURE_CMD_STATUS:  | CMD |
+ * - CAPTURE_CMD_DUMP:    | CMD |
+ *
+ * The bit i of MASK selects tracking_vars[i], so only the first 8 registered channels can be captured. CHANNEL
+ * is the index in tracking_vars[] compared to the THRESHOLD for the threshold triggers. Samples are packed as
+ * the selected float32_t values, in table order. An ARM received while a capture is armed or triggered is
+ * rejected with COMM_ERROR_BUSY.
+ *
+ * The board answers the status and dump commands with frames of the same opcode:
+ *
+ * - CAPTURE_CMD_STATUS:  | CMD | STATE (u8) | MASK (u8) | PRE (u16) | SAMPLES (u16) |
+ * - CAPTURE_CMD_DATA:    | CMD | OFFSET (u16) | packed samples |
+ * - CAPTURE_CMD_END:     | CMD |
+ *
+ * A dump starts with a status frame, where PRE is the number of samples recorded before the trigger and
+ * SAMPLES the total number of samples, followed by the data frames and an end frame.
+ */
+
+
+#ifndef COMM_CAPTURE_H
+#define COMM_CAPTURE_H
+
+#include "comm_frame.h"
+
+#define COMM_OP_CAPTURE 'C'
+
+#define CAPTURE_BUFFER_SIZE 8192
+#define CAPTURE_DATA_PER_FRAME 96
+
+typedef enum
+{
+    CAPTURE_CMD_ARM = 1, CAPTURE_CMD_TRIGGER, CAPTURE_CMD_STATUS, CAPTURE_CMD_DUMP, CAPTURE_CMD_DATA, CAPTURE_CMD_END
+} capture_commands_t;
+
+typedef enum
+{
+    CAPTURE_TRIGGER_MANUAL, CAPTURE_TRIGGER_RISING, CAPTURE_TRIGGER_FALLING, CAPTURE_TRIGGER_MODE
+} capture_triggers_t;
+
+typedef enum
+{
+    CAPTURE_IDLE, CAPTURE_ARMED, CAPTURE_TRIGGERED, CAPTURE_DONE
+} capture_states_t;
+
+/**
+ * @brief Structure representing the configuration of a capture.
+ */
+typedef struct {
+    uint8_t mask;                   /**< Selected tracking_vars[], one bit each */
+    capture_triggers_t trigger;     /**< Event starting the post-trigger recording */
+    uint8_t channel;                /**< Index in tracking_vars[] of the value compared to the threshold */
+    float32_t threshold;            /**< Threshold of the threshold triggers */
+    uint16_t pre_trigger;           /**< Number of samples kept before the trigger */
+    uint16_t post_trigger;          /**< Number of samples recorded after the trigger */
+} captureConfig_t;
+
+extern capture_states_t capture_state;
+
+/**
+ * @brief Arms a capture.
+ *
+ * The control task owns the configuration and the buffer while it samples, so a capture cannot be armed again
+ * before it is done: a capture waiting for its trigger is completed with capture_trigger().
+ *
+ * @param config The configuration of the capture.
+ * @return false if the configuration does not fit in the buffer, a capture is armed or triggered, or a dump is
+ * in progress.
+ */
+bool capture_arm(const captureConfig_t *config);
+
+/**
+ * @brief Fires the trigger of an armed capture.
+ */
+void capture_trigger();
+
+/**
+ * @brief Records a sample and checks the trigger.
+ *
+ * This function is meant to be called by the control task at each control period.
+ */
+void capture_sample();
+
+/**
+ * @brief Queues the next frames of a dump in progress, if any.
+ *
+ * This function is meant to be called from the task handling the commands, until the dump is complete.
+ */
+void capture_dump_step();
+
+/**
+ * @brief Handles a capture frame.
+ *
+ * @param frame The frame, whose first payload byte is the command.
+ * @return The result of the command, COMM_ERROR_BUSY for a dump requested while another one is in progress.
+ */
+comm_status_t captureHandler(const commFrame_t *frame);
+
+#endif  //COMM_CAPTURE_H
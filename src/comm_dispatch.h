@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Compile-time perfect hash tables for the command dispatch.
+ *
+ * The command tables of the protocol (default_commands[], power_settings[], the frame handlers) are
+ * constant and their keys are one character long. A multiplicative hash of the key selects a slot
+ * holding the index of the only entry that can match, which is then confirmed with a single
+ * comparison. The compiler searches the multiplier, stored in the table as its seed, until no two
+ * entries of the table share a slot, so the hash is perfect by construction and adding an entry to a
+ * table is still a one-line declaration. The channel names, registered at runtime, are hashed with
+ * name_hash() into a table probed linearly from the seed of the Twist board channels (see comm_registry.h).
+ */
+
+
+#ifndef COMM_DISPATCH_H
+#define COMM_DISPATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define COMM_HASH_BITS 5
+#define COMM_HASH_SLOTS (1 << COMM_HASH_BITS)
+#define COMM_HASH_EMPTY 0xFF
+
+/**
+ * @brief Structure representing a perfect hash table: the index of the entry of each slot.
+ */
+typedef struct {
+    uint8_t slot[COMM_HASH_SLOTS];  /**< Index of the entry hashed in each slot, COMM_HASH_EMPTY if none */
+    uint16_t seed;                  /**< Odd multiplier of the hash */
+    bool perfect;                   /**< false if two entries collide whatever the seed */
+} commHashTable_t;
+
+/**
+ * @brief Multiplicative hash of a 16-bit key: the top bits of its product with an odd seed.
+ */
+constexpr uint8_t comm_hash(uint16_t key, uint16_t seed)
+{
+    return (uint16_t)((uint32_t)key * seed) >> (16 - COMM_HASH_BITS);
+}
+
+/**
+ * @brief Hash of a command letter, the character following the underscore ("_d" -> 'd').
+ */
+constexpr uint8_t opcode_hash(uint8_t opcode, uint16_t seed)
+{
+    return comm_hash(opcode, seed);
+}
+
+/**
+ * @brief Hash of a two-character variable name ("V1", "IH", ...).
+ */
+constexpr uint8_t name_hash(const char *name, uint16_t seed)
+{
+    return comm_hash((uint16_t)((uint8_t)name[0] << 8 | (uint8_t)name[1]), seed);
+}
+
+/**
+ * @brief Builds the hash table of an array of entries with a given seed.
+ *
+ * @param entries The constant array to index.
+ * @param key_hash The function returning the hash of an entry for a seed.
+ * @param seed The multiplier of the hash.
+ * @return The table of slots of the entries, not perfect if two of them collide.
+ */
+template <typename T, size_t N>
+constexpr commHashTable_t hash_table_fill(const T (&entries)[N], uint8_t (*key_hash)(const T &, uint16_t), uint16_t seed)
+{
+    commHashTable_t table = {{}, seed, N < COMM_HASH_EMPTY};
+    for (size_t i = 0; i < COMM_HASH_SLOTS; i++) table.slot[i] = COMM_HASH_EMPTY;
+    for (size_t i = 0; i < N; i++)
+    {
+        uint8_t hash = key_hash(entries[i], seed);
+        if (table.slot[hash] != COMM_HASH_EMPTY) table.perfect = false;
+        table.slot[hash] = (uint8_t)i;
+    }
+    return table;
+}
+
+/**
+ * @brief Builds the perfect hash table of an array of entries.
+ *
+ * The odd seeds are tried in turn until one of them sends every entry to its own slot.
+ *
+ * @param entries The constant array to index.
+ * @param key_hash The function returning the hash of an entry for a seed.
+ * @return The table of slots of the entries, not perfect if no seed separates them.
+ */
+template <typename T, size_t N>
+constexpr commHashTable_t hash_table_build(const T (&entries)[N], uint8_t (*key_hash)(const T &, uint16_t))
+{
+    commHashTable_t table = hash_table_fill(entries, key_hash, 1);
+    for (uint32_t seed = 3; !table.perfect && seed <= UINT16_MAX; seed += 2)
+    {
+        table = hash_table_fill(entries, key_hash, (uint16_t)seed);
+    }
+    return table;
+}
+
+#endif  //COMM_DISPATCH_H
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  State-change events of the twist board communication protocol.
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include "comm_events.h"
+#include "comm_transmitter.h"
+#include "comm_telemetry.h"
+
+static uint8_t events_mask = 0;
+static uint16_t events_sequence = 0;
+static commSetpoints_t events_published;
+static commFrame_t events_frame;
+
+
+/**
+ * @brief Sends the pending events frame, if any.
+ */
+static void events_flush()
+{
+    if (events_frame.length == 0) return;
+    // A dropped frame shows as a gap in the sequence numbers
+    transmitter_send_response(&events_frame);
+    events_frame.length = 0;
+}
+
+
+/**
+ * @brief Appends an event to the pending frame if its kind is selected, sending the frame once full.
+ */
+static void event_add(events_kind_t kind, uint8_t leg, uint8_t index, float32_t value)
+{
+    if (!(events_mask & (1 << kind))) return;
+    if (events_frame.length == 0)
+    {
+        uint32_t timestamp_us = telemetry_timestamp_us();
+        events_frame.opcode = COMM_OP_EVENTS;
+        events_frame.leg = COMM_NO_INDEX;
+        events_frame.variable = COMM_NO_INDEX;
+        memcpy(events_frame.payload, &events_sequence, sizeof(uint16_t));
+        memcpy(events_frame.payload + 2, &timestamp_us, sizeof(uint32_t));
+        events_frame.length = EVENTS_HEADER_SIZE;
+    }
+    uint8_t *event = events_frame.payload + events_frame.length;
+    event[0] = kind;
+    event[1] = leg;
+    event[2] = index;
+    memcpy(event + 3, &value, sizeof(float32_t));
+    events_frame.length += EVENT_SIZE;
+    events_sequence++;
+    if (events_frame.length + EVENT_SIZE > COMM_FRAME_MAX_PAYLOAD) events_flush();
+}
+
+
+/**
+ * @brief Finds the index of a tracking variable from its address.
+ */
+static uint8_t tracking_var_index(const float32_t *address)
+{
+    for (uint8_t i = 0; i < num_tracking_vars; i++)
+    {
+        if (tracking_vars[i].address == address) return i;
+    }
+    return COMM_NO_INDEX;
+}
+
+
+/**
+ * @brief Queues the events of the setpoints that differ from the last published ones, or all of them.
+ */
+static void events_compare(const commSetpoints_t *setpoints, bool all)
+{
+    if (all || setpoints->mode != events_published.mode) event_add(EVENT_MODE, COMM_NO_INDEX, COMM_NO_INDEX, setpoints->mode);
+
+    for (uint8_t leg = 0; leg < num_power_legs; leg++)
+    {
+        const PowerLegSettings *current = &setpoints->legs[leg];
+        const PowerLegSettings *previous = &events_published.legs[leg];
+        for (uint8_t setting = 0; setting < BOOL_SETTINGS_NUMBER; setting++)
+        {
+            if (all || current->settings[setting] != previous->settings[setting])
+            {
+                event_add(EVENT_SETTING, leg, setting, current->settings[setting]);
+            }
+        }
+        if (all || current->duty_cycle != previous->duty_cycle)
+        {
+            event_add(EVENT_DUTY, leg, COMM_NO_INDEX, current->duty_cycle);
+        }
+        if (all || current->reference_value != previous->reference_value
+            || current->tracking_variable != previous->tracking_variable)
+        {
+            event_add(EVENT_REFERENCE, leg, tracking_var_index(current->tracking_variable), current->reference_value);
+        }
+    }
+
+    for (uint8_t i = 0; i < num_tracking_vars; i++)
+    {
+        const commCalibration_t *calibration = &setpoints->calibrations[i];
+        // A channel never calibrated has no value to report
+        if ((all && calibration->updates != 0) || calibration->updates != events_published.calibrations[i].updates)
+        {
+            event_add(EVENT_GAIN, COMM_NO_INDEX, i, calibration->gain);
+            event_add(EVENT_OFFSET, COMM_NO_INDEX, i, calibration->offset);
+        }
+    }
+    events_flush();
+}
+
+
+void events_check(const commSetpoints_t *setpoints)
+{
+    if (events_mask != 0) events_compare(setpoints, false);
+    memcpy(&events_published, setpoints, sizeof(events_published));
+}
+
+
+comm_status_t eventsHandler(const commFrame_t *frame)
+{
+    if (frame->length < 1)
+    {
+        printk("Invalid events frame\n");
+        return COMM_ERROR_FORMAT;
+    }
+    events_mask = frame->payload[0] & EVENTS_ALL;
+    // The current values are those last published, the command being handled has not changed them
+    if (events_mask != 0) events_compare(&events_published, true);
+    return COMM_OK;
+}
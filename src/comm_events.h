@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  State-change events of the twist board communication protocol.
+ *
+ * Instead of polling the status line, the host can subscribe to events sent when the setpoints change. Each
+ * time setpoints_publish() hands the working copies to the control task, events_check() compares them with
+ * the ones it published last and queues one event per difference: the mode, a boolean setting, the duty
+ * cycle or the reference of a leg, or the calibration of a channel. Changes made by a sequence while it plays
+ * are not reported, only the settings it leaves once done.
+ *
+ * The host subscribes with a frame of opcode COMM_OP_EVENTS whose payload | MASK (u8) | selects the kinds of
+ * events of events_kind_t, one bit per kind, 0 stopping the events. The current value of each selected kind is
+ * sent right away by eventsHandler(), taken from the last published setpoints, then only its changes. The
+ * events are sent on the response ring, before the telemetry stream, in frames of the same opcode holding the
+ * little endian payload:
+ *
+ *   | SEQUENCE (u16) | TIMESTAMP (u32) | KIND (u8) | LEG (u8) | INDEX (u8) | VALUE (f32) | ...
+ *
+ * with up to EVENTS_PER_FRAME events of 7 bytes. SEQUENCE numbers the first event of the frame, the next ones
+ * following, so the host detects lost events from the gaps. TIMESTAMP is in microseconds, on the clock of the
+ * telemetry records. LEG and INDEX are COMM_NO_INDEX when they do not apply.
+ */
+
+
+#ifndef COMM_EVENTS_H
+#define COMM_EVENTS_H
+
+#include "comm_setpoints.h"
+#include "comm_frame.h"
+
+#define COMM_OP_EVENTS 'E'
+#define EVENTS_HEADER_SIZE 6
+#define EVENT_SIZE 7
+#define EVENTS_PER_FRAME ((COMM_FRAME_MAX_PAYLOAD - EVENTS_HEADER_SIZE) / EVENT_SIZE)
+
+typedef enum
+{
+    EVENT_MODE,             /**< The mode changed, VALUE is a tester_states_t */
+    EVENT_SETTING,          /**< A boolean setting of LEG changed, INDEX is its position in power_settings[] */
+    EVENT_DUTY,             /**< The duty cycle of LEG changed */
+    EVENT_REFERENCE,        /**< The reference of LEG changed, INDEX is its tracking variable in tracking_vars[] */
+    EVENT_GAIN,             /**< The gain of channel INDEX of tracking_vars[] changed */
+    EVENT_OFFSET,           /**< The offset of channel INDEX of tracking_vars[] changed */
+    EVENTS_KINDS_NUMBER
+} events_kind_t;
+
+#define EVENTS_ALL ((1 << EVENTS_KINDS_NUMBER) - 1)
+
+/**
+ * @brief Queues the events of the setpoints about to be published.
+ *
+ * This function is called by setpoints_publish(), from the task handling the commands.
+ *
+ * @param setpoints The setpoints about to be published.
+ */
+void events_check(const commSetpoints_t *setpoints);
+
+/**
+ * @brief Handles an events frame, selecting the kinds of events sent.
+ *
+ * @param frame The frame, whose payload holds the mask of the kinds of events.
+ * @return COMM_ERROR_FORMAT if the payload is missing, COMM_OK otherwise.
+ */
+comm_status_t eventsHandler(const commFrame_t *frame);
+
+#endif  //COMM_EVENTS_H
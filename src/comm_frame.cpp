@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Binary framed version of the twist board communication protocol.
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include "comm_frame.h"
+#include "comm_batch.h"
+#include "comm_telemetry.h"
+#include "comm_capture.h"
+#include "comm_transmitter.h"
+#include "comm_stats.h"
+#include "comm_sequence.h"
+#include "comm_registry.h"
+#include "comm_calibration.h"
+#include "comm_events.h"
+#include "comm_link.h"
+#include "comm_dispatch.h"
+
+commFrame_t rx_frame;
+
+static uint8_t framebuffer[COMM_FRAME_MAX_SIZE];
+static commFrame_t sequenced_frame;
+
+/**
+ * @brief Structure representing a binary opcode mapping to its handler.
+ */
+typedef struct {
+    uint8_t opcode;                                     /**< Opcode of the frame */
+    comm_status_t (*handler)(const commFrame_t *frame); /**< Function handling the frame */
+} frameToHandler_t;
+
+static comm_status_t calibrationOpHandler(const commFrame_t *frame);
+
+static constexpr frameToHandler_t frame_handlers[] = {
+    {COMM_OP_CALIBRATION, calibrationOpHandler},
+    {COMM_OP_BATCH, batchHandler},
+    {COMM_OP_TELEMETRY, telemetryHandler},
+    {COMM_OP_SUBSCRIBE, subscribeHandler},
+    {COMM_OP_COMPRESSED, compressHandler},
+    {COMM_OP_CAPTURE, captureHandler},
+    {COMM_OP_STATS, statsHandler},
+    {COMM_OP_SEQUENCE, sequenceHandler},
+    {COMM_OP_CALIBRATIONS, calibrationFrameHandler},
+    {COMM_OP_EVENTS, eventsHandler},
+    {COMM_OP_LINK, linkHandler},
+};
+
+// Perfect hash table of the frame handlers, computed at compile time
+static constexpr uint8_t frame_handler_key(const frameToHandler_t &entry, uint16_t seed) { return opcode_hash(entry.opcode, seed); }
+
+static constexpr commHashTable_t frame_handlers_hash = hash_table_build(frame_handlers, frame_handler_key);
+
+static_assert(frame_handlers_hash.perfect, "frame_handlers[] opcodes collide for every seed of opcode_hash()");
+
+
+uint16_t frame_crc16(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+
+size_t frame_encode(const commFrame_t *frame, uint8_t *out, size_t out_size)
+{
+    size_t size = COMM_FRAME_HEADER_SIZE + frame->length + COMM_FRAME_CRC_SIZE;
+    if (frame->length > COMM_FRAME_MAX_PAYLOAD || size > out_size) return 0;
+
+    out[0] = COMM_FRAME_SYNC;
+    out[1] = frame->opcode;
+    out[2] = frame->leg;
+    out[3] = frame->variable;
+    out[4] = frame->length;
+    memcpy(out + COMM_FRAME_HEADER_SIZE, frame->payload, frame->length);
+
+    uint16_t crc = frame_crc16(out + 1, COMM_FRAME_HEADER_SIZE - 1 + frame->length);
+    out[size - 2] = crc & 0xFF;
+    out[size - 1] = crc >> 8;
+    return size;
+}
+
+
+bool frame_decode(const uint8_t *raw, size_t length, commFrame_t *frame)
+{
+    if (length < COMM_FRAME_HEADER_SIZE + COMM_FRAME_CRC_SIZE || raw[0] != COMM_FRAME_SYNC) return false;
+
+    uint8_t payload_length = raw[4];
+    if (payload_length > COMM_FRAME_MAX_PAYLOAD) return false;
+    if (length < (size_t)(COMM_FRAME_HEADER_SIZE + payload_length + COMM_FRAME_CRC_SIZE)) return false;
+
+    const uint8_t *crc_position = raw + COMM_FRAME_HEADER_SIZE + payload_length;
+    uint16_t crc = crc_position[0] | (crc_position[1] << 8);
+    if (crc != frame_crc16(raw + 1, COMM_FRAME_HEADER_SIZE - 1 + payload_length)) return false;
+
+    frame->opcode = raw[1];
+    frame->leg = raw[2];
+    frame->variable = raw[3];
+    frame->length = payload_length;
+    memcpy(frame->payload, raw + COMM_FRAME_HEADER_SIZE, payload_length);
+    return true;
+}
+
+
+float32_t frame_get_float(const commFrame_t *frame, uint8_t offset)
+{
+    float32_t value = 0;
+    if (offset + sizeof(float32_t) <= frame->length) memcpy(&value, frame->payload + offset, sizeof(float32_t));
+    return value;
+}
+
+
+void frame_put_float(commFrame_t *frame, uint8_t offset, float32_t value)
+{
+    if (offset + sizeof(float32_t) > COMM_FRAME_MAX_PAYLOAD) return;
+    memcpy(frame->payload + offset, &value, sizeof(float32_t));
+    if (frame->length < offset + sizeof(float32_t)) frame->length = offset + sizeof(float32_t);
+}
+
+
+bool console_read_frame(commFrame_t *frame)
+{
+    framebuffer[0] = COMM_FRAME_SYNC;
+    for (uint8_t i = 1; i < COMM_FRAME_HEADER_SIZE; i++)
+    {
+        framebuffer[i] = console_getchar();
+    }
+
+    comm_counters.bytes_received += COMM_FRAME_HEADER_SIZE - 1;
+
+    uint8_t payload_length = framebuffer[4];
+    if (payload_length > COMM_FRAME_MAX_PAYLOAD)
+    {
+        printk("Invalid frame length: %d\n", payload_length);
+        comm_counters.parse_errors++;
+        return false;
+    }
+
+    size_t size = COMM_FRAME_HEADER_SIZE + payload_length + COMM_FRAME_CRC_SIZE;
+    for (size_t i = COMM_FRAME_HEADER_SIZE; i < size; i++)
+    {
+        framebuffer[i] = console_getchar();
+    }
+    comm_counters.bytes_received += size - COMM_FRAME_HEADER_SIZE;
+
+    if (!frame_decode(framebuffer, size, frame))
+    {
+        printk("Invalid frame CRC\n");
+        comm_counters.parse_errors++;
+        return false;
+    }
+    comm_counters.frames++;
+    return true;
+}
+
+
+static uint8_t find_frame_handler(uint8_t opcode)
+{
+    uint8_t i = frame_handlers_hash.slot[opcode_hash(opcode, frame_handlers_hash.seed)];
+    return (i != COMM_HASH_EMPTY && frame_handlers[i].opcode == opcode) ? i : COMM_NO_INDEX;
+}
+
+
+static comm_status_t calibrationOpHandler(const commFrame_t *frame)
+{
+    if (frame->length < 2 * sizeof(float32_t))
+    {
+        printk("Invalid calibration frame\n");
+        return COMM_ERROR_FORMAT;
+    }
+    return calibrationApply(frame->variable, frame_get_float(frame, 0), frame_get_float(frame, sizeof(float32_t)));
+}
+
+
+comm_status_t frameHandler(const commFrame_t *frame)
+{
+    if (frame->opcode & COMM_FRAME_SEQUENCED)
+    {
+        if (frame->length < COMM_FRAME_SEQUENCE_SIZE)
+        {
+            printk("Invalid sequenced frame\n");
+            return COMM_ERROR_FORMAT;
+        }
+        // The command is handled without its sequence number, as if it had been sent alone
+        uint16_t sequence = frame->payload[0] | (frame->payload[1] << 8);
+        sequenced_frame.opcode = frame->opcode & ~COMM_FRAME_SEQUENCED;
+        sequenced_frame.leg = frame->leg;
+        sequenced_frame.variable = frame->variable;
+        sequenced_frame.length = frame->length - COMM_FRAME_SEQUENCE_SIZE;
+        memcpy(sequenced_frame.payload, frame->payload + COMM_FRAME_SEQUENCE_SIZE, sequenced_frame.length);
+
+        comm_status_t status = frameHandler(&sequenced_frame);
+        transmitter_send_ack(sequence, sequenced_frame.opcode, status);
+        return status;
+    }
+
+    // Default commands share the letter following the underscore of their text version
+    uint8_t i = find_default_command(frame->opcode);
+    if (i != COMM_NO_INDEX)
+    {
+        defaultApply(i);
+        return COMM_OK;
+    }
+
+    i = find_frame_handler(frame->opcode);
+    if (i != COMM_NO_INDEX)
+    {
+        return frame_handlers[i].handler(frame);
+    }
+
+    i = find_power_setting(frame->opcode);
+    if (i != COMM_NO_INDEX)
+    {
+        if (frame->leg >= num_power_legs)
+        {
+            printk("Invalid power frame\n");
+            return COMM_ERROR_LEG;
+        }
+        if (frame->length < sizeof(float32_t))
+        {
+            printk("Invalid power frame\n");
+            return COMM_ERROR_FORMAT;
+        }
+        if (power_settings[i].apply == NULL) return COMM_ERROR_UNKNOWN_COMMAND;
+
+        // The switches are driven by the control task once the settings are published
+        return power_settings[i].apply(&power_leg_settings[frame->leg], i, frame->variable, frame_get_float(frame, 0));
+    }
+    printk("unknown frame opcode %c\n", frame->opcode);
+    return COMM_ERROR_UNKNOWN_COMMAND;
+}
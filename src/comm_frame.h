@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Binary framed version of the twist board communication protocol.
+ *
+ * A frame carries the same commands as the text protocol without any float to text conversion:
+ *
+ *   | SYNC | OPCODE | LEG | VARIABLE | LENGTH | PAYLOAD (LENGTH bytes) | CRC16 |
+ *
+ * - SYNC is COMM_FRAME_SYNC, which can never be the first character of a text command.
+ * - OPCODE is the command letter of the text protocol ('i', 'f', 'o' for default_commands[],
+ *   'l', 'c', 'v', 'b', 't', 'r', 'd' for power_settings[] and 'k' for the calibration).
+ * - LEG is the index of the power leg, VARIABLE the index of the variable in tracking_vars[].
+ * - PAYLOAD is a sequence of little endian float32_t values, except for batches (see comm_batch.h).
+ * - CRC16 is a little endian CRC-16/CCITT-FALSE computed from OPCODE to the end of the PAYLOAD.
+ *
+ * A command whose OPCODE has the COMM_FRAME_SEQUENCED bit set starts its PAYLOAD with a little endian u16
+ * sequence number, followed by the usual payload of the command. Such a command is acknowledged with this
+ * sequence number once handled (see transmitter_send_ack()).
+ */
+
+
+#ifndef COMM_FRAME_H
+#define COMM_FRAME_H
+
+#include "comm_protocol.h"
+
+#define COMM_FRAME_SYNC 0xA5
+
+#define COMM_FRAME_HEADER_SIZE 5
+#define COMM_FRAME_CRC_SIZE 2
+#define COMM_FRAME_MAX_PAYLOAD 128
+#define COMM_FRAME_MAX_SIZE (COMM_FRAME_HEADER_SIZE + COMM_FRAME_MAX_PAYLOAD + COMM_FRAME_CRC_SIZE)
+
+#define COMM_FRAME_SEQUENCED 0x80
+#define COMM_FRAME_SEQUENCE_SIZE 2
+
+#define COMM_OP_CALIBRATION 'k'
+#define COMM_OP_BATCH 'B'
+#define COMM_OP_ACK 'A'
+
+/**
+ * @brief Structure representing a decoded binary frame.
+ *
+ * The sync byte and the CRC are not stored, they are only used on the wire.
+ */
+typedef struct {
+    uint8_t opcode;                             /**< Command letter */
+    uint8_t leg;                                /**< Index of the power leg */
+    uint8_t variable;                           /**< Index of the variable in tracking_vars[] */
+    uint8_t length;                             /**< Number of bytes in the payload */
+    uint8_t payload[COMM_FRAME_MAX_PAYLOAD];    /**< Raw payload */
+} commFrame_t;
+
+extern commFrame_t rx_frame;
+
+/**
+ * @brief Computes the CRC-16/CCITT-FALSE of a buffer.
+ *
+ * @param data The buffer.
+ * @param length The number of bytes of the buffer.
+ * @return The CRC of the buffer.
+ */
+uint16_t frame_crc16(const uint8_t *data, size_t length);
+
+/**
+ * @brief Serializes a frame, adding the sync byte and the CRC.
+ *
+ * @param frame The frame to serialize.
+ * @param out The output buffer.
+ * @param out_size The size of the output buffer.
+ * @return The number of bytes written, or 0 if the frame does not fit in the output buffer.
+ */
+size_t frame_encode(const commFrame_t *frame, uint8_t *out, size_t out_size);
+
+/**
+ * @brief Deserializes a frame from a buffer starting with the sync byte.
+ *
+ * @param raw The buffer.
+ * @param length The number of bytes of the buffer.
+ * @param frame The decoded frame.
+ * @return true if the buffer holds a complete frame with a valid CRC, false otherwise.
+ */
+bool frame_decode(const uint8_t *raw, size_t length, commFrame_t *frame);
+
+/**
+ * @brief Reads the float32_t at the given byte offset of the payload of a frame.
+ */
+float32_t frame_get_float(const commFrame_t *frame, uint8_t offset);
+
+/**
+ * @brief Writes a float32_t at the given byte offset of the payload of a frame and updates its length.
+ */
+void frame_put_float(commFrame_t *frame, uint8_t offset, float32_t value);
+
+/**
+ * @brief Reads the rest of a binary frame from the console input.
+ *
+ * This function is called once the sync byte has been received. It reads the header, the payload and
+ * the CRC of the frame and decodes them.
+ *
+ * @param frame The decoded frame.
+ * @return true if a valid frame was received, false otherwise.
+ */
+bool console_read_frame(commFrame_t *frame);
+
+/**
+ * @brief Handles a binary frame.
+ *
+ * This function dispatches the frame depending on its opcode. Default commands, power leg settings and
+ * calibrations use the same apply functions as the text handlers, the other opcodes (batch, telemetry, subscription, compression, capture)
+ * have their own handler. Sequenced frames are acknowledged once handled.
+ *
+ * @param frame The frame to handle.
+ * @return The result of the command.
+ */
+comm_status_t frameHandler(const commFrame_t *frame);
+
+#endif  //COMM_FRAME_H
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Link negotiation of the twist board communication protocol.
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/uart.h>
+
+#include "comm_link.h"
+#include "comm_telemetry.h"
+#include "comm_transmitter.h"
+#include "comm_stats.h"
+
+static const uint32_t link_bauds[] = {115200, 230400, 460800, 921600};
+#define LINK_BAUDS_NUMBER (sizeof(link_bauds) / sizeof(link_bauds[0]))
+
+static_assert(LINK_INFO_SIZE + sizeof(link_bauds) <= COMM_FRAME_MAX_PAYLOAD, "the link info must fit in a frame");
+
+static const struct device *const link_console = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
+static uint32_t link_control_period_us = LINK_DEFAULT_CONTROL_PERIOD_US;
+static bool link_configurable = false;
+static struct uart_config link_config;
+static commFrame_t link_frame;
+
+// State of a baud rate change
+static uint32_t link_pending_baud = 0;      // Baud rate to switch to once the acknowledgement is written
+static uint32_t link_previous_baud = 0;     // Baud rate to return to if the host does not follow
+static bool link_ack_written = false;
+static uint32_t link_since_ms;              // Time the acknowledgement was written, then time of the switch
+static uint32_t link_frames;                // Frames received before the switch
+
+
+void link_init(uint32_t control_period_us)
+{
+    if (control_period_us > 0) link_control_period_us = control_period_us;
+#if !DT_NODE_HAS_COMPAT(DT_CHOSEN(zephyr_console), zephyr_cdc_acm_uart)
+    // Setting the current configuration back tells whether the driver can change it at runtime. The driver of
+    // a USB console accepts any configuration and ignores it, so it is never tried.
+    link_configurable = device_is_ready(link_console) && uart_config_get(link_console, &link_config) == 0 &&
+                        uart_configure(link_console, &link_config) == 0;
+#endif
+}
+
+
+static bool link_set_baud(uint32_t baud)
+{
+    struct uart_config config = link_config;
+    config.baudrate = baud;
+    if (uart_configure(link_console, &config) != 0) return false;
+    link_config = config;
+    return true;
+}
+
+
+void link_step()
+{
+    uint32_t now_ms = k_uptime_get_32();
+    if (link_pending_baud != 0)
+    {
+        // The host switches when it gets the acknowledgement, sent on the response ring
+        if (ring_count(&response_ring) > 0) return;
+        if (!link_ack_written)
+        {
+            link_ack_written = true;
+            link_since_ms = now_ms;
+            return;
+        }
+        if (now_ms - link_since_ms < LINK_SWITCH_DELAY_MS) return;
+
+        uint32_t previous_baud = link_config.baudrate;
+        if (link_set_baud(link_pending_baud)) link_previous_baud = previous_baud;
+        link_pending_baud = 0;
+        link_frames = comm_counters.frames;
+        link_since_ms = now_ms;
+    }
+    else if (link_previous_baud != 0)
+    {
+        // Any frame with a valid CRC shows that the host follows
+        if (comm_counters.frames != link_frames)
+        {
+            link_previous_baud = 0;
+        }
+        else if (now_ms - link_since_ms >= LINK_CONFIRM_MS)
+        {
+            link_set_baud(link_previous_baud);
+            link_previous_baud = 0;
+            printk("Link baud rate reverted to %u\n", link_config.baudrate);
+        }
+    }
+}
+
+
+/**
+ * @brief Answers an INFO command with the capabilities of the link.
+ */
+static comm_status_t link_info()
+{
+    uint32_t baud = link_configurable ? link_config.baudrate : 0;
+    uint32_t bytes_per_second = link_configurable ? baud / 10 : LINK_USB_BYTES_PER_SECOND;
+    uint8_t bauds = link_configurable ? LINK_BAUDS_NUMBER : 0;
+
+    link_frame.opcode = COMM_OP_LINK;
+    link_frame.leg = COMM_NO_INDEX;
+    link_frame.variable = COMM_NO_INDEX;
+    link_frame.payload[0] = LINK_CMD_INFO;
+    link_frame.payload[1] = LINK_VERSION;
+    link_frame.payload[2] = (1 << LINK_ENCODINGS_NUMBER) - 1;
+    memcpy(link_frame.payload + 3, &link_control_period_us, sizeof(uint32_t));
+    memcpy(link_frame.payload + 7, &baud, sizeof(uint32_t));
+    memcpy(link_frame.payload + 11, &bytes_per_second, sizeof(uint32_t));
+    memcpy(link_frame.payload + 15, &telemetry_config.decimation, sizeof(uint16_t));
+    link_frame.payload[17] = bauds;
+    memcpy(link_frame.payload + LINK_INFO_SIZE, link_bauds, bauds * sizeof(uint32_t));
+    link_frame.length = LINK_INFO_SIZE + bauds * sizeof(uint32_t);
+    return transmitter_send_response(&link_frame) ? COMM_OK : COMM_ERROR_BUSY;
+}
+
+
+/**
+ * @brief Handles a RATE command, the period being rounded up to a multiple of the control period.
+ */
+static comm_status_t link_rate(uint32_t period_us)
+{
+    uint32_t decimation = period_us / link_control_period_us + (period_us % link_control_period_us != 0);
+    if (decimation > UINT16_MAX) return COMM_ERROR_RANGE;
+    telemetry_start(decimation);
+    return COMM_OK;
+}
+
+
+/**
+ * @brief Handles a BAUD command, the switch being made by link_step() once acknowledged.
+ */
+static comm_status_t link_baud(uint32_t baud)
+{
+    if (link_pending_baud != 0 || link_previous_baud != 0) return COMM_ERROR_BUSY;
+    if (!link_configurable) return COMM_ERROR_RANGE;
+
+    for (uint8_t i = 0; i < LINK_BAUDS_NUMBER; i++)
+    {
+        if (link_bauds[i] != baud) continue;
+        if (baud != link_config.baudrate)
+        {
+            link_pending_baud = baud;
+            link_ack_written = false;
+        }
+        return COMM_OK;
+    }
+    return COMM_ERROR_RANGE;
+}
+
+
+static uint32_t link_value(const commFrame_t *frame)
+{
+    uint32_t value;
+    memcpy(&value, frame->payload + 1, sizeof(uint32_t));
+    return value;
+}
+
+
+comm_status_t linkHandler(const commFrame_t *frame)
+{
+    if (frame->length < 1) return COMM_ERROR_FORMAT;
+
+    switch (frame->payload[0])
+    {
+    case LINK_CMD_INFO:
+        return link_info();
+    case LINK_CMD_RATE:
+        if (frame->length < 1 + sizeof(uint32_t)) return COMM_ERROR_FORMAT;
+        return link_rate(link_value(frame));
+    case LINK_CMD_BAUD:
+        if (frame->length < 1 + sizeof(uint32_t)) return COMM_ERROR_FORMAT;
+        return link_baud(link_value(frame));
+    default:
+        return COMM_ERROR_UNKNOWN_COMMAND;
+    }
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Link negotiation of the twist board communication protocol.
+ *
+ * At connection, the host asks the board what the link can carry and adapts the telemetry to it, instead of
+ * assuming a rate that floods the console. The link is handled with frames of opcode COMM_OP_LINK whose first
+ * payload byte is a command:
+ *
+ * - LINK_CMD_INFO: | CMD |
+ * - LINK_CMD_RATE: | CMD | PERIOD us (u32) |
+ * - LINK_CMD_BAUD: | CMD | BAUD (u32) |
+ *
+ * INFO is answered with a frame of the same opcode holding the little endian payload:
+ *
+ *   | CMD | VERSION (u8) | ENCODINGS (u8) | CONTROL PERIOD us (u32) | BAUD (u32) | BYTES PER SECOND (u32) |
+ *   | DECIMATION (u16) | BAUD COUNT (u8) | BAUD (u32) | ... |
+ *
+ * ENCODINGS has one bit per link_encodings_t supported by the firmware. BYTES PER SECOND is the throughput of
+ * the console: a tenth of the baud rate for a UART (8N1), LINK_USB_BYTES_PER_SECOND for a USB console, whose
+ * baud rate is only emulated and reported as 0. DECIMATION is the current one of the telemetry stream and the
+ * baud rates listed are those BAUD accepts, none for a USB console.
+ *
+ * RATE starts the telemetry stream with one record every PERIOD microseconds, rounded up to a multiple of the
+ * control period, 0 stopping the stream. BAUD switches the console to another baud rate once its acknowledgement
+ * is written: the host switches too when it gets the acknowledgement, then sends any valid frame within
+ * LINK_CONFIRM_MS at the new baud rate, otherwise the board returns to the previous one.
+ */
+
+
+#ifndef COMM_LINK_H
+#define COMM_LINK_H
+
+#include "comm_frame.h"
+
+#define COMM_OP_LINK 'N'
+#define LINK_VERSION 1
+#define LINK_INFO_SIZE 18
+
+#define LINK_DEFAULT_CONTROL_PERIOD_US 100
+#define LINK_USB_BYTES_PER_SECOND 500000
+#define LINK_SWITCH_DELAY_MS 10     // Leaves the UART time to shift out the acknowledgement
+#define LINK_CONFIRM_MS 1000
+
+typedef enum
+{
+    LINK_CMD_INFO = 1,
+    LINK_CMD_RATE = 2,
+    LINK_CMD_BAUD = 3
+} link_commands_t;
+
+typedef enum
+{
+    LINK_ENCODING_TEXT,         /**< Text command lines */
+    LINK_ENCODING_FRAMES,       /**< Binary command frames, batches and acknowledgements */
+    LINK_ENCODING_TELEMETRY,    /**< Full telemetry records */
+    LINK_ENCODING_SUBSCRIBE,    /**< Telemetry records of the subscribed channels */
+    LINK_ENCODING_COMPRESSED,   /**< Compressed telemetry stream */
+    LINK_ENCODING_EVENTS,       /**< State-change events */
+    LINK_ENCODINGS_NUMBER
+} link_encodings_t;
+
+/**
+ * @brief Sets the control period and detects whether the baud rate of the console can be changed.
+ *
+ * This function is meant to be called once at startup. Without it, the link reports a control period of
+ * LINK_DEFAULT_CONTROL_PERIOD_US and a fixed baud rate.
+ *
+ * @param control_period_us The period of the control task, in microseconds.
+ */
+void link_init(uint32_t control_period_us);
+
+/**
+ * @brief Applies a pending baud rate change once acknowledged, and reverts it if the host does not follow.
+ *
+ * This function is called by comm_background_task(), from the task handling the commands.
+ */
+void link_step();
+
+/**
+ * @brief Handles a link frame.
+ *
+ * @param frame The decoded frame, of opcode COMM_OP_LINK.
+ * @return COMM_ERROR_RANGE for a period beyond 65535 control periods or a baud rate not supported,
+ *         COMM_ERROR_BUSY if a baud rate change is in progress or the answer does not fit in the ring,
+ *         the result of the command otherwise.
+ */
+comm_status_t linkHandler(const commFrame_t *frame);
+
+#endif  //COMM_LINK_H
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Bounded parsers of the text protocol.
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include "comm_parse.h"
+
+#define COMM_PARSE_MAX_UNSIGNED_DIGITS 9
+
+// Powers of ten up to 1e8 are exact in float32_t, so dividing by them rounds the fraction correctly
+static const float32_t fraction_scale[COMM_PARSE_MAX_FRACTION_DIGITS + 1] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f
+};
+
+
+/**
+ * @brief Accumulates at most max_digits decimal digits, without reading past end.
+ *
+ * @return The number of digits read, max_digits + 1 if there are more digits than allowed.
+ */
+static uint8_t parse_digits(const char **text, const char *end, uint8_t max_digits, uint32_t *value)
+{
+    uint8_t count = 0;
+    *value = 0;
+    while (count <= max_digits && *text < end && (*text)[0] >= '0' && (*text)[0] <= '9')
+    {
+        *value = *value * 10 + ((*text)[0] - '0');
+        (*text)++;
+        count++;
+    }
+    return count;
+}
+
+
+bool parse_tokens(const char *line, commTokens_t *tokens)
+{
+    tokens->count = 0;
+    if (line[0] != '_') return false;
+
+    const char *field = line + 1;
+    for (const char *c = field; ; c++)
+    {
+        if (c[0] != '_' && c[0] != '\0') continue;
+        if (tokens->count >= COMM_MAX_TOKENS)
+        {
+            tokens->count = 0;
+            return false;
+        }
+        tokens->token[tokens->count++] = {field, (uint8_t)(c - field)};
+        if (c[0] == '\0') return true;
+        field = c + 1;
+    }
+}
+
+
+bool token_equals(const commToken_t *token, const char *text)
+{
+    return strncmp(token->text, text, token->length) == 0 && text[token->length] == '\0';
+}
+
+
+bool parse_decimal(const commToken_t *token, float32_t *value)
+{
+    const char *text = token->text;
+    const char *end = text + token->length;
+    bool negative = (text < end && text[0] == '-');
+    if (text < end && (text[0] == '-' || text[0] == '+')) text++;
+
+    uint32_t integer;
+    uint8_t integer_digits = parse_digits(&text, end, COMM_PARSE_MAX_INTEGER_DIGITS, &integer);
+    if (integer_digits > COMM_PARSE_MAX_INTEGER_DIGITS) return false;
+
+    uint32_t fraction = 0;
+    uint8_t fraction_digits = 0;
+    if (text < end && text[0] == '.')
+    {
+        text++;
+        fraction_digits = parse_digits(&text, end, COMM_PARSE_MAX_FRACTION_DIGITS, &fraction);
+        if (fraction_digits > COMM_PARSE_MAX_FRACTION_DIGITS) return false;
+    }
+
+    if (integer_digits + fraction_digits == 0 || text != end) return false;
+
+    float32_t result = (float32_t)integer + (float32_t)fraction / fraction_scale[fraction_digits];
+    *value = negative ? -result : result;
+    return true;
+}
+
+
+bool parse_unsigned(const commToken_t *token, uint32_t *value)
+{
+    const char *text = token->text;
+    const char *end = text + token->length;
+    uint32_t result;
+    uint8_t digits = parse_digits(&text, end, COMM_PARSE_MAX_UNSIGNED_DIGITS, &result);
+    if (digits == 0 || digits > COMM_PARSE_MAX_UNSIGNED_DIGITS || text != end) return false;
+
+    *value = result;
+    return true;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Bounded parsers of the text protocol.
+ *
+ * A text command is split once by parse_tokens() into the views of its fields, without copying or
+ * modifying the line, and the handlers only read these views: each character of the line is visited
+ * once by the split and once more by the parser of its field.
+ *
+ * The fields carry fixed point decimals, as printed by the Python client with "%.5f" (duty cycles,
+ * references) or "%.8f" (calibration gains and offsets). These parsers replace atof(): they only accept
+ * an optional sign, at most COMM_PARSE_MAX_INTEGER_DIGITS digits, and an optional fraction of at most
+ * COMM_PARSE_MAX_FRACTION_DIGITS digits, so their execution time is bounded and they never allocate.
+ * Anything else, including an empty field or trailing characters, is rejected.
+ */
+
+
+#ifndef COMM_PARSE_H
+#define COMM_PARSE_H
+
+#include "comm_protocol.h"
+
+#define COMM_PARSE_MAX_INTEGER_DIGITS 7
+#define COMM_PARSE_MAX_FRACTION_DIGITS 8
+
+/**
+ * @brief Splits a text command into its fields.
+ *
+ * Every underscore starts a new field, so "_LEG1__d" has an empty second field. The split stops at the
+ * first underscore exceeding COMM_MAX_TOKENS fields.
+ *
+ * @param line The null-terminated command, starting with an underscore.
+ * @param tokens The views of the fields, pointing into the line. There is no field on failure.
+ * @return false if the line does not start with an underscore or has more than COMM_MAX_TOKENS fields.
+ */
+bool parse_tokens(const char *line, commTokens_t *tokens);
+
+/**
+ * @brief Compares a field with a null-terminated string.
+ *
+ * @return true if the field has exactly the characters of text.
+ */
+bool token_equals(const commToken_t *token, const char *text);
+
+/**
+ * @brief Parses a decimal number such as "-12.50000".
+ *
+ * @param token The field holding the number.
+ * @param value The parsed value, only written on success.
+ * @return false if the field is not exactly a decimal number.
+ */
+bool parse_decimal(const commToken_t *token, float32_t *value);
+
+/**
+ * @brief Parses an unsigned integer such as "30000", without any float operation.
+ *
+ * @param token The field holding the number.
+ * @param value The parsed value, only written on success.
+ * @return false if the field is not exactly an integer of at most 9 digits.
+ */
+bool parse_unsigned(const commToken_t *token, uint32_t *value);
+
+#endif  //COMM_PARSE_H
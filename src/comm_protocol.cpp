@@ -28,52 +28,52 @@
  */
 
 
-#include "comm_protocol.h"
+#include <math.h>
 
-extern float32_t V1_low_value;
-extern float32_t V2_low_value;
-extern float32_t I1_low_value;
-extern float32_t I2_low_value;
-extern float32_t I_high_value;
-extern float32_t V_high_value;
+#include "comm_protocol.h"
+#include "comm_frame.h"
+#include "comm_dispatch.h"
+#include "comm_transmitter.h"
+#include "comm_parse.h"
+#include "comm_stats.h"
+#include "comm_setpoints.h"
+#include "comm_sequence.h"
+#include "comm_registry.h"
 
 float32_t reference_value = 0.0;
 
-// Declare the tracking variable struct
-TrackingVariables tracking_vars[] = {
-    {"V1", &V1_low_value, V1_LOW},
-    {"V2", &V2_low_value, V2_LOW},
-    {"VH", &V_high_value, V_HIGH},
-    {"I1", &I1_low_value, I1_LOW},
-    {"I2", &I2_low_value, I2_LOW},
-    {"IH", &I_high_value, I_HIGH}
-};
-
-PowerLegSettings power_leg_settings[] = {
-    //   LEG_OFF      ,   CAPA_OFF      , DRIVER_OFF      ,  BUCK_MODE_ON,  BOOST_MODE_ON
-    {{BOOL_SETTING_OFF, BOOL_SETTING_OFF, BOOL_SETTING_OFF,  BOOL_SETTING_OFF,  BOOL_SETTING_OFF}, {LEG1_CAPA_DGND, LEG1_DRIVER_SWITCH},  &V1_low_value, "V1", reference_value, 0.1},
-    {{BOOL_SETTING_OFF, BOOL_SETTING_OFF, BOOL_SETTING_OFF,  BOOL_SETTING_OFF,  BOOL_SETTING_OFF}, {LEG2_CAPA_DGND, LEG2_DRIVER_SWITCH},  &V2_low_value, "V2",reference_value, 0.1}
-};
-
-cmdToSettings_t power_settings[] = {
-    {"_l", boolSettingsHandler},
-    {"_c", boolSettingsHandler},
-    {"_v", boolSettingsHandler},
-    {"_b", boolSettingsHandler},
-    {"_t", boolSettingsHandler},
-    {"_r", referenceHandler},
-    {"_d", dutyHandler},
+constexpr cmdToSettings_t power_settings[] = {
+    {"_l", boolSettingsHandler, boolSettingsApply},
+    {"_c", boolSettingsHandler, boolSettingsApply},
+    {"_v", boolSettingsHandler, boolSettingsApply},
+    {"_b", boolSettingsHandler, boolSettingsApply},
+    {"_t", boolSettingsHandler, boolSettingsApply},
+    {"_r", referenceHandler, referenceApply},
+    {"_d", dutyHandler, dutyApply},
+    {"_p", dutyScaledHandler, dutyScaledApply},
 };
 
-cmdToState_t default_commands[] = {
+constexpr cmdToState_t default_commands[] = {
     {"_i", IDLE},
     {"_f", POWER_OFF},
     {"_o", POWER_ON},
 };
 
+// Perfect hash tables of the command tables, computed at compile time
+static constexpr uint8_t power_setting_key(const cmdToSettings_t &entry, uint16_t seed) { return opcode_hash(entry.cmd[1], seed); }
+static constexpr uint8_t default_command_key(const cmdToState_t &entry, uint16_t seed) { return opcode_hash(entry.cmd[1], seed); }
+
+static constexpr commHashTable_t power_settings_hash = hash_table_build(power_settings, power_setting_key);
+static constexpr commHashTable_t default_commands_hash = hash_table_build(default_commands, default_command_key);
+
+static_assert(power_settings_hash.perfect, "power_settings[] commands collide for every seed of opcode_hash()");
+static_assert(default_commands_hash.perfect, "default_commands[] commands collide for every seed of opcode_hash()");
+
+static_assert(sizeof(power_settings)/sizeof(power_settings[0]) <= SEQUENCE_MAX_SETTINGS,
+              "power_settings[] indexes must fit in the low nibble of sequenceEntry_t.target");
+
 tester_states_t mode = IDLE;
 
-uint8_t num_tracking_vars = sizeof(tracking_vars)/sizeof(tracking_vars[0]);
 uint8_t num_power_settings =  sizeof(power_settings)/sizeof(power_settings[0]);
 uint8_t num_default_commands = sizeof(default_commands)/sizeof(default_commands[0]);
 
@@ -124,213 +124,323 @@ bool Can_success = false;
 
 void initial_handle(uint8_t received_char)
 {
+    uint32_t start_cycles = stats_cycles();
+    comm_counters.bytes_received++;
     switch (received_char)
     {
     case 'd':
+    case 's':
+    case 'k':
         console_read_line();
-        printk("buffer str = %s\n", bufferstr);
-        defaultHandler();
+        lineHandler(received_char);
+        break;
+    case COMM_FRAME_SYNC:
+        if (console_read_frame(&rx_frame))
+        {
+            uint32_t frame_cycles = stats_cycles();
+            stats_count_command(frameHandler(&rx_frame));
+            stats_record(STATS_FRAME_HANDLER, frame_cycles);
+        }
+        break;
+    default:
+        // Bytes outside of a command are not measured
+        return;
+    }
+    setpoints_publish();
+    stats_record(STATS_INITIAL_HANDLE, start_cycles);
+}
+
+comm_status_t lineHandler(uint8_t command)
+{
+    // An optional "#<sequence>" suffix requests an acknowledgement, it is not part of the command
+    uint32_t sequence_number = 0;
+    char *sequence = strrchr(bufferstr, '#');
+    if (sequence != NULL)
+    {
+        *sequence = '\0';
+        commToken_t sequence_token = {sequence + 1, (uint8_t)strlen(sequence + 1)};
+        // The command is not run without the acknowledgement it asked for, a sequence number that cannot be
+        // sent back as a u16 is malformed rather than truncated
+        if (!parse_unsigned(&sequence_token, &sequence_number) || sequence_number > UINT16_MAX)
+        {
+            printk("Invalid sequence number: %s\n", sequence + 1);
+            comm_counters.lines++;
+            stats_count_command(COMM_ERROR_FORMAT);
+            return COMM_ERROR_FORMAT;
+        }
+    }
+
+    comm_counters.lines++;
+    comm_status_t status = COMM_ERROR_UNKNOWN_COMMAND;
+    uint32_t start_cycles = stats_cycles();
+
+    // The line is split once, the handlers only read the views of its fields and reject a malformed line,
+    // which has none
+    commTokens_t tokens;
+    parse_tokens(bufferstr, &tokens);
+    switch (command)
+    {
+    case 'd':
+        status = defaultHandler(&tokens);
+        stats_record(STATS_DEFAULT_HANDLER, start_cycles);
         // spin.led.turnOn();
         break;
     case 's':
-        console_read_line();
-        printk("buffer str = %s\n", bufferstr);
-        powerLegSettingsHandler();
+        status = powerLegSettingsHandler(&tokens);
+        stats_record(STATS_POWER_LEG_SETTINGS_HANDLER, start_cycles);
         // counter = 0;
         break;
     case 'k':
-        console_read_line();
-        printk("buffer str = %s\n", bufferstr);
-        calibrationHandler();
+        status = calibrationHandler(&tokens);
+        stats_record(STATS_CALIBRATION_HANDLER, start_cycles);
         break;
     default:
         break;
     }
+    stats_count_command(status);
+
+    if (sequence != NULL) transmitter_send_ack(sequence_number, command, status);
+    return status;
 }
 
 void console_read_line()
 {
-    for (uint8_t i = 0; received_char != '\n'; i++)
+    uint32_t start_cycles = stats_cycles();
+    size_t i = 0;
+    uint8_t line_char = console_getchar();
+    comm_counters.bytes_received++;
+    while (line_char != '\n')
     {
-        received_char = console_getchar();
-        if (received_char == '\n')
-        {
-            if (bufferstr[i-1] == '\r')
-            {
-                bufferstr[i-1] = '\0';
-            }
-            else
-            {
-                bufferstr[i] = '\0';
-            }
-        }
-        else
-        {
-            bufferstr[i] = received_char;
-        }
+        // Characters that do not fit in bufferstr are dropped until the end of the line
+        if (i < sizeof(bufferstr) - 1) bufferstr[i++] = line_char;
+        line_char = console_getchar();
+        comm_counters.bytes_received++;
     }
+    if (i > 0 && bufferstr[i-1] == '\r') i--;
+    bufferstr[i] = '\0';
+    received_char = line_char;
+    stats_record(STATS_CONSOLE_READ_LINE, start_cycles);
 }
 
 
-void dutyHandler(uint8_t power_leg, uint8_t setting_position) {
-    // Check if the bufferstr starts with "_d_"
-    if (strncmp(bufferstr, "_LEG1_d_", 8) == 0 || strncmp(bufferstr, "_LEG2_d_", 8) == 0) {
-        // Extract the duty cycle value from the protocol message
-        float32_t duty_value = atof(bufferstr + 9);
+comm_status_t dutyHandler(uint8_t power_leg, uint8_t setting_position, const commTokens_t *tokens) {
+    // The command format is "_LEGX_d_<duty>"
+    float32_t duty_value;
+    if (tokens->count != 3 || !parse_decimal(&tokens->token[2], &duty_value)) {
+        printk("Invalid protocol format: %s\n", bufferstr);
+        return COMM_ERROR_FORMAT;
+    }
+    return dutyApply(&power_leg_settings[power_leg], setting_position, 0, duty_value);
+}
+
 
-        // Check if the duty cycle value is within the valid range (0-100)
-        if (duty_value >= 0.0 && duty_value <= 1.0) {
-            // Update the duty cycle variable
-            power_leg_settings[power_leg].duty_cycle = duty_value;
-        } else {
-            printk("Invalid duty cycle value: %.5f\n", duty_value);
-        }
-    } else {
+comm_status_t dutyScaledHandler(uint8_t power_leg, uint8_t setting_position, const commTokens_t *tokens) {
+    // The duty cycle is an integer number of parts per COMM_DUTY_SCALE, no float is parsed
+    uint32_t duty_parts;
+    if (tokens->count != 3 || !parse_unsigned(&tokens->token[2], &duty_parts)) {
         printk("Invalid protocol format: %s\n", bufferstr);
+        return COMM_ERROR_FORMAT;
     }
+    return dutyScaledApply(&power_leg_settings[power_leg], setting_position, 0, duty_parts);
 }
 
 
-void referenceHandler(uint8_t power_leg, uint8_t setting_position){
-    const char *underscore1 = strchr(bufferstr + 6, '_');
-    if (underscore1 != NULL) {
-        // Find the position of the next underscore after the first underscore
-        const char *underscore2 = strchr(underscore1 + 1, '_');
-        if (underscore2 != NULL) {
-            // Extract the variable name between the underscores
-            char variable[3];
-            strncpy(variable, underscore1 + 1, underscore2 - underscore1 - 1);
-            variable[underscore2 - underscore1 - 1] = '\0';
-
-            // Extract the value after the second underscore
-            reference_value = atof(underscore2 + 1);
-
-            printk("Variable: %s\n", variable);
-            printk("Value: %.5f\n", reference_value);
-
-            // Finds the tracking variable and updates the address of the tracking_variable
-            for (uint8_t i = 0; i < num_tracking_vars; i++) {
-                if (strcmp(variable, tracking_vars[i].name) == 0) {
-                    power_leg_settings[power_leg].tracking_variable = tracking_vars[i].address;
-                    power_leg_settings[power_leg].tracking_var_name = tracking_vars[i].name;
-                    power_leg_settings[power_leg].reference_value = reference_value;
-                    break;
-                }
-            }
-        }
+comm_status_t referenceHandler(uint8_t power_leg, uint8_t setting_position, const commTokens_t *tokens){
+    // The command format is "_LEGX_r_<variable>_<value>"
+    const commToken_t *variable = &tokens->token[2];
+    if (tokens->count != 4 || variable->length == 0 || variable->length > REGISTRY_NAME_LENGTH
+        || !parse_decimal(&tokens->token[3], &reference_value)) {
+        printk("Invalid protocol format: %s\n", bufferstr);
+        return COMM_ERROR_FORMAT;
     }
 
+    printk("Variable: %.*s\n", variable->length, variable->text);
+    printk("Value: %.5f\n", reference_value);
+
+    // Finds the tracking variable and updates the address of the tracking_variable
+    uint8_t i = find_tracking_var(variable);
+    if (i != COMM_NO_INDEX) return referenceApply(&power_leg_settings[power_leg], setting_position, i, reference_value);
+    return COMM_ERROR_VARIABLE;
 }
 
 
 
-void calibrationHandler() {
-    const char *underscore1 = strchr(bufferstr + 1, '_');
-    if (underscore1 != NULL) {
-        // Find the position of the next underscore after the first underscore
-        const char *underscore2 = strchr(underscore1 + 1, '_');
-        if (underscore2 != NULL) {
-            // Extract the variable name between the underscores
-            char variable[3];
-            strncpy(variable, bufferstr + 1, underscore1 - (bufferstr + 1));
-            variable[underscore1 - (bufferstr + 1)] = '\0';
-
-            // Find the position of the next underscore after the second underscore
-            const char *underscore3 = strchr(underscore2 + 1, '_');
-            if (underscore3 != NULL) {
-                // Extract the gain and offset values after the second underscore
-                float32_t gain = atof(underscore1 + 3); // Skip 'g_' and parse gain
-                float32_t offset = atof(underscore3 + 3); // Skip 'o_' and parse offset
-
-                // Print the parsed values
-                printk("Variable: %s\n", variable);
-                printk("Gain: %.8f\n", gain);
-                printk("Offset: %.8f\n", offset);
-
-                // Find the tracking variable and update its gain and offset
-                for (uint8_t i = 0; i < num_tracking_vars; i++) {
-                    if (strcmp(variable, tracking_vars[i].name) == 0) {
-                        data.setParameters(tracking_vars[i].channel_reference, gain, offset);
-                        printk("channel: %s\n", tracking_vars[i].name);
-                        printk("channel: %d\n", tracking_vars[i].channel_reference);
-                        break;
-                    }
-                    if (i>=num_tracking_vars) printk("Variable not found: %s\n", variable); //prints an error if it does not find the variable
-                }
-            }
-        }
+comm_status_t calibrationHandler(const commTokens_t *tokens) {
+    // The command format is "_<variable>_g_<gain>_o_<offset>"
+    const commToken_t *variable = &tokens->token[0];
+    float32_t gain;
+    float32_t offset;
+    if (tokens->count != 5 || variable->length == 0 || variable->length > REGISTRY_NAME_LENGTH
+        || !token_equals(&tokens->token[1], "g") || !token_equals(&tokens->token[3], "o")
+        || !parse_decimal(&tokens->token[2], &gain) || !parse_decimal(&tokens->token[4], &offset)) {
+        printk("Invalid protocol format: %s\n", bufferstr);
+        return COMM_ERROR_FORMAT;
     }
+
+    // Print the parsed values
+    printk("Variable: %.*s\n", variable->length, variable->text);
+    printk("Gain: %.8f\n", gain);
+    printk("Offset: %.8f\n", offset);
+
+    // Find the tracking variable and update its gain and offset
+    uint8_t i = find_tracking_var(variable);
+    if (i != COMM_NO_INDEX) return calibrationApply(i, gain, offset);
+    printk("Variable not found: %.*s\n", variable->length, variable->text); //prints an error if it does not find the variable
+    return COMM_ERROR_VARIABLE;
 }
 
-void boolSettingsHandler(uint8_t power_leg, uint8_t setting_position)
+comm_status_t boolSettingsHandler(uint8_t power_leg, uint8_t setting_position, const commTokens_t *tokens)
 {
-    if (strncmp(bufferstr + 7, "_on", 3) == 0) {
-        power_leg_settings[power_leg].settings[setting_position] = BOOL_SETTING_ON;
-        if (setting_position == BOOL_CAPA)  spin.gpio.resetPin(power_leg_settings[power_leg].switches[CAPA_SWITCH_INDEX]);  //turns the capacitor switch ON
-        if (setting_position == BOOL_DRIVER)  spin.gpio.resetPin(power_leg_settings[power_leg].switches[DRIVER_SWITCH_INDEX]);  //turns the capacitor switch ON
-    } else if (strncmp(bufferstr + 7, "_off", 4) == 0) {
-        power_leg_settings[power_leg].settings[setting_position] = BOOL_SETTING_OFF;
-        if (setting_position == BOOL_CAPA)  spin.gpio.setPin(power_leg_settings[power_leg].switches[CAPA_SWITCH_INDEX]);  //turns the capacitor switch ON
-        if (setting_position == BOOL_DRIVER)  spin.gpio.setPin(power_leg_settings[power_leg].switches[DRIVER_SWITCH_INDEX]);  //turns the capacitor switch ON
+    // The switches are driven by the control task once the settings are published
+    if (tokens->count == 3 && token_equals(&tokens->token[2], "on")) {
+        boolSettingsApply(&power_leg_settings[power_leg], setting_position, 0, BOOL_SETTING_ON);
+    } else if (tokens->count == 3 && token_equals(&tokens->token[2], "off")) {
+        boolSettingsApply(&power_leg_settings[power_leg], setting_position, 0, BOOL_SETTING_OFF);
     }
     else {
         // Unknown command
         printk("Unknown power command for LEG%d leg\n", power_leg + 1);
+        return COMM_ERROR_FORMAT;
     }
+    return COMM_OK;
 }
 
 
-void defaultHandler()
+comm_status_t defaultHandler(const commTokens_t *tokens)
 {
-    for(uint8_t i = 0; i < num_default_commands; i++) //iterates the default commands
+    // The command is exactly "_<letter>"
+    bool valid = (tokens->count == 1 && tokens->token[0].length == 1);
+    uint8_t i = valid ? find_default_command(tokens->token[0].text[0]) : COMM_NO_INDEX;
+    if (i != COMM_NO_INDEX)
     {
-        if (strncmp(bufferstr, default_commands[i].cmd, strlen(default_commands[i].cmd)) == 0)
-        {
-            mode = default_commands[i].mode;
-            print_done = false; //authorizes printing the current state once
-            return;
-        }
+        defaultApply(i);
+        return COMM_OK;
     }
     printk("unknown default command %s\n", bufferstr);
+    return COMM_ERROR_UNKNOWN_COMMAND;
 }
 
 
 // Function to parse the power leg settings commands
-void powerLegSettingsHandler() {
+comm_status_t powerLegSettingsHandler(const commTokens_t *tokens) {
 
     // Determine the power leg based on the received message
-    leg_t power_leg = LEG1; // Default to LEG1
-    if (strncmp(bufferstr, "_LEG2_", strlen("_LEG2_")) == 0) {
-        power_leg = LEG2;
-    } else if (strncmp(bufferstr, "_LEG1_", strlen("_LEG1_")) != 0) {
+    uint8_t power_leg = (tokens->count > 0) ? find_power_leg(&tokens->token[0]) : COMM_NO_INDEX;
+    if (power_leg == COMM_NO_INDEX) {
         printk("Unknown leg identifier\n");
-        return;
+        return COMM_ERROR_LEG;
     }
 
     // COMMAND EXTRACTION
-    // Find the position of the second underscore after the leg identifier
-    const char *underscore2 = strchr(bufferstr + 5, '_');
-    if (underscore2 == NULL) {
+    // The setting is the single letter of the second field
+    if (tokens->count < 2 || tokens->token[1].length != 1) {
         printk("Invalid command format\n");
-        return;
+        return COMM_ERROR_FORMAT;
     }
-    // Extract the command part after the leg identifier
-    char command[3];
-    strncpy(command, underscore2, 2);
-    command[2] = '\0';
 
     // FIND THE HANDLER OF THE SPECIFIC SETTING COMMAND
-    for(uint8_t i = 0; i < num_power_settings; i++) //iterates the default commands
+    uint8_t i = find_power_setting(tokens->token[1].text[0]);
+    if (i != COMM_NO_INDEX)
     {
-        if (strncmp(command, power_settings[i].cmd, strlen(power_settings[i].cmd)) == 0)
+        if (power_settings[i].func != NULL)
         {
-            if (power_settings[i].func != NULL)
-            {
-                power_settings[i].func(power_leg, i); //pointer to the handler function associated with the command
-            }
-            return;
+            return power_settings[i].func(power_leg, i, tokens); //pointer to the handler function associated with the command
         }
+        return COMM_ERROR_UNKNOWN_COMMAND;
     }
     printk("unknown power command %s\n", bufferstr);
+    return COMM_ERROR_UNKNOWN_COMMAND;
+}
+
+
+uint8_t find_default_command(uint8_t opcode)
+{
+    uint8_t i = default_commands_hash.slot[opcode_hash(opcode, default_commands_hash.seed)];
+    return (i != COMM_HASH_EMPTY && default_commands[i].cmd[1] == opcode) ? i : COMM_NO_INDEX;
+}
+
+
+uint8_t find_power_setting(uint8_t opcode)
+{
+    uint8_t i = power_settings_hash.slot[opcode_hash(opcode, power_settings_hash.seed)];
+    return (i != COMM_HASH_EMPTY && power_settings[i].cmd[1] == opcode) ? i : COMM_NO_INDEX;
+}
+
+
+void defaultApply(uint8_t command_index)
+{
+    mode = default_commands[command_index].mode;
+    print_done = false; //authorizes printing the current state once
+}
+
+
+comm_status_t boolSettingsApply(PowerLegSettings *leg, uint8_t setting_position, [[maybe_unused]] uint8_t variable, float32_t value)
+{
+    leg->settings[setting_position] = (value != 0) ? BOOL_SETTING_ON : BOOL_SETTING_OFF;
+    return COMM_OK;
+}
+
+
+void legSwitchesApply(const PowerLegSettings *leg, uint8_t setting_position)
+{
+    if (setting_position == BOOL_CAPA)
+    {
+        if (leg->settings[BOOL_CAPA] == BOOL_SETTING_ON) spin.gpio.resetPin(leg->switches[CAPA_SWITCH_INDEX]);  //turns the capacitor switch ON
+        else spin.gpio.setPin(leg->switches[CAPA_SWITCH_INDEX]);  //turns the capacitor switch OFF
+    }
+    if (setting_position == BOOL_DRIVER)
+    {
+        if (leg->settings[BOOL_DRIVER] == BOOL_SETTING_ON) spin.gpio.resetPin(leg->switches[DRIVER_SWITCH_INDEX]);  //turns the driver switch ON
+        else spin.gpio.setPin(leg->switches[DRIVER_SWITCH_INDEX]);  //turns the driver switch OFF
+    }
+}
+
+
+comm_status_t dutyApply(PowerLegSettings *leg, [[maybe_unused]] uint8_t setting_position, [[maybe_unused]] uint8_t variable, float32_t value)
+{
+    // Check if the duty cycle value is within the valid range (0-1)
+    if (value >= 0.0 && value <= 1.0) {
+        // Update the duty cycle variable
+        leg->duty_cycle = value;
+        return COMM_OK;
+    }
+    printk("Invalid duty cycle value: %.5f\n", value);
+    return COMM_ERROR_RANGE;
+}
+
+
+comm_status_t dutyScaledApply(PowerLegSettings *leg, uint8_t setting_position, uint8_t variable, float32_t value)
+{
+    return dutyApply(leg, setting_position, variable, value / COMM_DUTY_SCALE);
+}
+
+
+comm_status_t referenceApply(PowerLegSettings *leg, [[maybe_unused]] uint8_t setting_position, uint8_t variable, float32_t value)
+{
+    if (variable >= num_tracking_vars) {
+        printk("Variable not found: %d\n", variable);
+        return COMM_ERROR_VARIABLE;
+    }
+    leg->tracking_variable = tracking_vars[variable].address;
+    leg->tracking_var_name = tracking_vars[variable].name;
+    leg->reference_value = value;
+    return COMM_OK;
 }
 
+
+comm_status_t calibrationApply(uint8_t variable, float32_t gain, float32_t offset)
+{
+    if (variable >= num_tracking_vars || !tracking_vars[variable].calibrated) {
+        printk("Variable not found: %d\n", variable);
+        return COMM_ERROR_VARIABLE;
+    }
+    // As for the calibration frames, a parameter overflowing the float range is not staged
+    if (!isfinite(gain) || !isfinite(offset)) {
+        printk("Invalid calibration: %f %f\n", gain, offset);
+        return COMM_ERROR_RANGE;
+    }
+    setpoints_calibrate(variable, gain, offset);
+    printk("channel: %s\n", tracking_vars[variable].name);
+    printk("channel: %d\n", tracking_vars[variable].channel_reference);
+    return COMM_OK;
+}
@@ -55,9 +55,17 @@
 #define BOOL_BUCK 3
 #define BOOL_BOOST 4
 
+#define BOOL_SETTINGS_NUMBER 5
+
 #define CAPA_SWITCH_INDEX 0
 #define DRIVER_SWITCH_INDEX 1
 
+#define COMM_NO_INDEX 0xFF
+
+#define COMM_DUTY_SCALE 100000.0f  // Parts of a scaled duty cycle ("_p" setting)
+
+#define COMM_MAX_TOKENS 6  // Fields of the longest text command, "_V1_g_<gain>_o_<offset>"
+
 #define GET_ID(x) ((x >> 6) & 0x3)        // retrieve identifiant
 #define GET_STATUS(x) (x & 1) // check the status (IDLE MODE or POWER MODE)
 
@@ -72,6 +80,42 @@ typedef enum
 
 extern tester_states_t mode;
 
+/**
+ * @brief Result of a command, sent back in its acknowledgement (see comm_transmitter.h).
+ */
+typedef enum
+{
+    COMM_OK,                    /**< The command was applied */
+    COMM_ERROR_UNKNOWN_COMMAND, /**< The command or the opcode does not exist */
+    COMM_ERROR_FORMAT,          /**< The command is malformed or its payload is too short */
+    COMM_ERROR_LEG,             /**< The power leg does not exist */
+    COMM_ERROR_VARIABLE,        /**< The tracking variable does not exist */
+    COMM_ERROR_RANGE,           /**< A value is out of its valid range */
+    COMM_ERROR_BUSY,            /**< The command cannot be accepted yet, for instance a capture dump is in progress */
+    COMM_ERROR_STORAGE          /**< The flash storage cannot be written */
+} comm_status_t;
+
+/**
+ * @brief View of a field of a text command, the characters between two underscores.
+ *
+ * The text is not copied nor null-terminated, it points into the received line.
+ */
+typedef struct {
+    const char *text;           /**< First character of the field */
+    uint8_t length;             /**< Number of characters of the field */
+} commToken_t;
+
+/**
+ * @brief Fields of a text command, split once by parse_tokens().
+ *
+ * "_LEG1_d_0.5" gives the fields "LEG1", "d" and "0.5". The handlers only read these views, so any
+ * decoder able to fill them can reuse the handlers.
+ */
+typedef struct {
+    commToken_t token[COMM_MAX_TOKENS]; /**< Fields of the command, in order */
+    uint8_t count;              /**< Number of fields */
+} commTokens_t;
+
 
 /**
  * @brief Structure representing tracking variables and their information.
@@ -82,6 +126,7 @@ typedef struct {
     const char *name;           /**< Name of the tracking variable */
     float32_t *address;         /**< Memory address of the tracking variable */
     channel_t channel_reference; /**< Channel reference of the tracking variable */
+    bool calibrated;            /**< false for a derived quantity, which has no channel to calibrate */
 } TrackingVariables;
 /**
  * @brief Structure representing the settings of a power leg.
@@ -90,7 +135,7 @@ typedef struct {
  * tracking variable information, reference value, and duty cycle.
  */
 typedef struct {
-    bool settings[5];               /**< Array of boolean settings */
+    bool settings[BOOL_SETTINGS_NUMBER]; /**< Array of boolean settings */
     pin_t switches[2];              /**< Array of switches */
     float32_t *tracking_variable;   /**< Pointer to the tracking variable */
     const char *tracking_var_name;  /**< Name of the tracking variable */
@@ -105,7 +150,8 @@ typedef struct {
  */
 typedef struct {
     char cmd[16];                               /**< Command string */
-    void (*func)(uint8_t power_leg, uint8_t setting_position); /**< Function pointer to handle the settings */
+    comm_status_t (*func)(uint8_t power_leg, uint8_t setting_position, const commTokens_t *tokens); /**< Function pointer to handle the settings */
+    comm_status_t (*apply)(PowerLegSettings *leg, uint8_t setting_position, uint8_t variable, float32_t value); /**< Function pointer applying an already decoded value */
 } cmdToSettings_t;
 
 
@@ -134,13 +180,10 @@ typedef struct {
     uint8_t id_and_status;          /**< Status information */
 } ConsigneStruct_t;
 
-extern TrackingVariables tracking_vars[6];
-extern PowerLegSettings power_leg_settings[2];
-extern cmdToSettings_t power_settings[7];
-extern cmdToState_t default_commands[3];
+extern const cmdToSettings_t power_settings[];
+extern const cmdToState_t default_commands[];
 
 extern tester_states_t mode;
-extern uint8_t num_tracking_vars;
 extern uint8_t num_power_settings;
 extern uint8_t num_default_commands;
 
@@ -199,11 +242,26 @@ extern bool print_done;
  */
 void initial_handle(uint8_t received_char);
 
+/**
+ * @brief Handles a complete command line.
+ *
+ * This function splits the rest of the line, stored in the global bufferstr variable, into its fields
+ * with parse_tokens() and calls the handler associated with the first character of the command with
+ * these fields. A line ending with "#<sequence>", for
+ * instance "s_LEG1_d_0.5#42", is acknowledged with the given sequence number (see transmitter_send_ack()).
+ * A line whose sequence number is not an integer up to UINT16_MAX is rejected without running the command.
+ *
+ * @param command The first character of the command.
+ * @return The result of the command.
+ */
+comm_status_t lineHandler(uint8_t command);
+
 /**
  * @brief Reads a line from the console input.
  *
  * This function reads characters from the console input until a newline character ('\n') is encountered.
- * It stores the characters in the global bufferstr variable.
+ * It stores the characters in the global bufferstr variable, dropping the ones that do not fit.
+ * This function blocks until the end of the line, see receiver_poll() for a non-blocking alternative.
  */
 void console_read_line();
 
@@ -212,8 +270,10 @@ void console_read_line();
  *
  * This function handles default commands by matching the received command with predefined default commands and executing corresponding actions.
  *
+ * @param tokens The fields of the command, a single letter for "_i".
+ * @return The result of the command.
  */
-void defaultHandler();
+comm_status_t defaultHandler(const commTokens_t *tokens);
 
 /**
  * @brief Handles power leg settings commands.
@@ -221,8 +281,10 @@ void defaultHandler();
  * This function determines the power leg based on the received message and delegates the command handling to specific setting handlers.
  * The command format is expected to be "_LEGX_<setting>_XXXXX", where X represents the specific setting value.
  *
+ * @param tokens The fields of the command, the leg, the setting and its values.
+ * @return The result of the command.
  */
-void powerLegSettingsHandler();
+comm_status_t powerLegSettingsHandler(const commTokens_t *tokens);
 
 /**
  * @brief Handles boolean settings for a power leg.
@@ -232,8 +294,10 @@ void powerLegSettingsHandler();
  *
  * @param power_leg The index of the power leg.
  * @param setting_position The position of the boolean setting in the power leg settings array.
+ * @param tokens The fields of the command.
+ * @return The result of the command.
  */
-void boolSettingsHandler(uint8_t power_leg, uint8_t setting_position);
+comm_status_t boolSettingsHandler(uint8_t power_leg, uint8_t setting_position, const commTokens_t *tokens);
 
 /**
  * @brief Handles duty cycle settings for a power leg.
@@ -243,8 +307,24 @@ void boolSettingsHandler(uint8_t power_leg, uint8_t setting_position);
  *
  * @param power_leg The index of the power leg.
  * @param setting_position The position of the duty cycle setting in the power leg settings array.
+ * @param tokens The fields of the command.
+ * @return The result of the command.
+ */
+comm_status_t dutyHandler(uint8_t power_leg, uint8_t setting_position, const commTokens_t *tokens);
+
+/**
+ * @brief Handles scaled duty cycle settings for a power leg.
+ *
+ * This function is the integer version of dutyHandler(), which avoids parsing a float value.
+ * The command format is expected to be "_LEGX_p_NNNNN", where NNNNN is the duty cycle in parts per COMM_DUTY_SCALE
+ * (30000 for a duty cycle of 0.3).
+ *
+ * @param power_leg The index of the power leg.
+ * @param setting_position The position of the scaled duty cycle setting in the power leg settings array.
+ * @param tokens The fields of the command.
+ * @return The result of the command.
  */
-void dutyHandler(uint8_t power_leg, uint8_t setting_position);
+comm_status_t dutyScaledHandler(uint8_t power_leg, uint8_t setting_position, const commTokens_t *tokens);
 
 /**
  * @brief Handles reference value settings for a power leg.
@@ -254,8 +334,10 @@ void dutyHandler(uint8_t power_leg, uint8_t setting_position);
  *
  * @param power_leg The index of the power leg.
  * @param setting_position The position of the reference value setting in the power leg settings array.
+ * @param tokens The fields of the command.
+ * @return The result of the command.
  */
-void referenceHandler(uint8_t power_leg, uint8_t setting_position);
+comm_status_t referenceHandler(uint8_t power_leg, uint8_t setting_position, const commTokens_t *tokens);
 
 /**
  * @brief Handles calibration settings.
@@ -263,8 +345,115 @@ void referenceHandler(uint8_t power_leg, uint8_t setting_position);
  * This function extracts the variable name, gain, and offset from the received command and updates the calibration parameters.
  * The command format is expected to be "_VX_g_XX.XXXXX_o_XX.XXXXX", where VX represents the variable name, XX.XXXXX represents the gain,
  * and XX.XXXXX represents the offset.
+ *
+ * @param tokens The fields of the command.
+ * @return The result of the command.
+ */
+comm_status_t calibrationHandler(const commTokens_t *tokens);
+
+/**
+ * @brief Finds a default command from its letter.
+ *
+ * The lookup uses a perfect hash table computed at compile time from default_commands[].
+ *
+ * @param opcode The letter following the underscore of the command ('i' for "_i").
+ * @return The index of the command in default_commands[], or COMM_NO_INDEX if it does not exist.
+ */
+uint8_t find_default_command(uint8_t opcode);
+
+/**
+ * @brief Finds a power leg setting command from its letter.
+ *
+ * The lookup uses a perfect hash table computed at compile time from power_settings[].
+ *
+ * @param opcode The letter following the underscore of the command ('d' for "_d").
+ * @return The index of the command in power_settings[], or COMM_NO_INDEX if it does not exist.
+ */
+uint8_t find_power_setting(uint8_t opcode);
+
+/**
+ * @brief Applies a default command.
+ *
+ * This function switches the tester mode to the one of the given entry of default_commands[].
+ * It is shared by the text and the binary protocols.
+ *
+ * @param command_index The index of the command in default_commands[].
+ */
+void defaultApply(uint8_t command_index);
+
+/**
+ * @brief Applies a boolean setting to a power leg.
+ *
+ * Any non-zero value turns the setting on. Only the settings are updated, see legSwitchesApply() to drive
+ * the capacitor and driver switches accordingly.
+ *
+ * @param leg The settings of the power leg.
+ * @param setting_position The position of the boolean setting in the power leg settings array.
+ * @param variable Unused, present to match the apply signature of power_settings[].
+ * @param value The new state of the setting.
+ * @return COMM_OK, a boolean setting is always valid.
+ */
+comm_status_t boolSettingsApply(PowerLegSettings *leg, uint8_t setting_position, uint8_t variable, float32_t value);
+
+/**
+ * @brief Applies a duty cycle to a power leg.
+ *
+ * @param leg The settings of the power leg.
+ * @param setting_position The position of the duty cycle setting in the power leg settings array.
+ * @param variable Unused, present to match the apply signature of power_settings[].
+ * @param value The new duty cycle.
+ * @return COMM_ERROR_RANGE if the value is outside of the [0, 1] range, in which case it is ignored.
+ */
+comm_status_t dutyApply(PowerLegSettings *leg, uint8_t setting_position, uint8_t variable, float32_t value);
+
+/**
+ * @brief Applies a scaled duty cycle to a power leg.
+ *
+ * @param leg The settings of the power leg.
+ * @param setting_position The position of the scaled duty cycle setting in the power leg settings array.
+ * @param variable Unused, present to match the apply signature of power_settings[].
+ * @param value The new duty cycle, in parts per COMM_DUTY_SCALE.
+ * @return COMM_ERROR_RANGE if the value is outside of the [0, COMM_DUTY_SCALE] range, in which case it is ignored.
+ */
+comm_status_t dutyScaledApply(PowerLegSettings *leg, uint8_t setting_position, uint8_t variable, float32_t value);
+
+/**
+ * @brief Applies a reference value to a power leg.
+ *
+ * The tracking variable of the leg is set to the given entry of tracking_vars[]. Only the leg is modified, so
+ * the control task can apply references as well (see comm_sequence.h).
+ *
+ * @param leg The settings of the power leg.
+ * @param setting_position The position of the reference setting in the power leg settings array.
+ * @param variable The index of the tracked variable in tracking_vars[].
+ * @param value The new reference value.
+ * @return COMM_ERROR_VARIABLE if the variable does not exist, in which case the value is ignored.
+ */
+comm_status_t referenceApply(PowerLegSettings *leg, uint8_t setting_position, uint8_t variable, float32_t value);
+
+/**
+ * @brief Drives the switch associated with a boolean setting of a power leg.
+ *
+ * The capacitor and driver switches follow their settings, the other settings have no switch. This function
+ * is called by the control task when it picks up new settings (see setpoints_acquire()).
+ *
+ * @param leg The settings of the power leg.
+ * @param setting_position The position of the boolean setting in the power leg settings array.
+ */
+void legSwitchesApply(const PowerLegSettings *leg, uint8_t setting_position);
+
+/**
+ * @brief Applies calibration parameters to a measurement channel.
+ *
+ * The parameters are staged and applied by the control task once published (see setpoints_calibrate()).
+ *
+ * @param variable The index of the variable in tracking_vars[].
+ * @param gain The gain of the channel.
+ * @param offset The offset of the channel.
+ * @return COMM_ERROR_VARIABLE if the variable does not exist or is a derived quantity (see comm_registry.h),
+ * COMM_ERROR_RANGE if the gain or the offset is not finite.
  */
-void calibrationHandler();
+comm_status_t calibrationApply(uint8_t variable, float32_t gain, float32_t offset);
 
 
 #endif  //TEST_BENCH_COMM_PROTOCOL_H
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Non-blocking receiver of the twist board communication protocol.
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include "comm_receiver.h"
+#include "comm_frame.h"
+#include "comm_capture.h"
+#include "comm_stats.h"
+#include "comm_setpoints.h"
+#include "comm_sequence.h"
+
+typedef enum
+{
+    RX_WAIT_COMMAND, RX_LINE, RX_DISCARD_LINE, RX_FRAME
+} receiver_states_t;
+
+commRing_t rx_ring;
+uint32_t rx_discarded_lines = 0;
+
+static receiver_states_t rx_state = RX_WAIT_COMMAND;
+static uint8_t rx_command;
+static size_t rx_length;
+static uint8_t rx_framebuffer[COMM_FRAME_MAX_SIZE];
+
+
+void receiver_push(uint8_t byte)
+{
+    ring_push(&rx_ring, byte);
+}
+
+
+void receiver_rx_task()
+{
+    receiver_push(console_getchar());
+}
+
+
+/**
+ * @brief Feeds one byte to the state machine.
+ *
+ * @return true if the byte completed a command.
+ */
+static bool receiver_step(uint8_t byte)
+{
+    switch (rx_state)
+    {
+    case RX_WAIT_COMMAND:
+        if (byte == COMM_FRAME_SYNC)
+        {
+            rx_framebuffer[0] = byte;
+            rx_length = 1;
+            rx_state = RX_FRAME;
+        }
+        else if (byte == 'd' || byte == 's' || byte == 'k')
+        {
+            rx_command = byte;
+            rx_length = 0;
+            rx_state = RX_LINE;
+        }
+        return false;
+
+    case RX_LINE:
+        if (byte == '\n')
+        {
+            if (rx_length > 0 && bufferstr[rx_length - 1] == '\r') rx_length--;
+            bufferstr[rx_length] = '\0';
+            rx_state = RX_WAIT_COMMAND;
+            lineHandler(rx_command);
+            return true;
+        }
+        if (rx_length >= sizeof(bufferstr) - 1)
+        {
+            printk("Line too long, discarded\n");
+            rx_discarded_lines++;
+            comm_counters.parse_errors++;
+            rx_state = RX_DISCARD_LINE;
+            return false;
+        }
+        bufferstr[rx_length++] = byte;
+        return false;
+
+    case RX_DISCARD_LINE:
+        if (byte == '\n') rx_state = RX_WAIT_COMMAND;
+        return false;
+
+    case RX_FRAME:
+        rx_framebuffer[rx_length++] = byte;
+        if (rx_length == COMM_FRAME_HEADER_SIZE && rx_framebuffer[4] > COMM_FRAME_MAX_PAYLOAD)
+        {
+            printk("Invalid frame length: %d\n", rx_framebuffer[4]);
+            comm_counters.parse_errors++;
+            rx_state = RX_WAIT_COMMAND;
+            return false;
+        }
+        if (rx_length >= COMM_FRAME_HEADER_SIZE
+            && rx_length == (size_t)(COMM_FRAME_HEADER_SIZE + rx_framebuffer[4] + COMM_FRAME_CRC_SIZE))
+        {
+            rx_state = RX_WAIT_COMMAND;
+            if (!frame_decode(rx_framebuffer, rx_length, &rx_frame))
+            {
+                printk("Invalid frame CRC\n");
+                comm_counters.parse_errors++;
+                return false;
+            }
+            comm_counters.frames++;
+            uint32_t start_cycles = stats_cycles();
+            stats_count_command(frameHandler(&rx_frame));
+            stats_record(STATS_FRAME_HANDLER, start_cycles);
+            return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+
+bool receiver_poll()
+{
+    // Responses spanning several frames are produced by the task handling the commands
+    capture_dump_step();
+    sequence_release_step();
+
+    uint32_t start_cycles = stats_cycles();
+    uint8_t byte;
+    for (uint8_t i = 0; i < COMM_RX_BYTES_PER_POLL && ring_pop(&rx_ring, &byte); i++)
+    {
+        comm_counters.bytes_received++;
+        if (receiver_step(byte))
+        {
+            setpoints_publish();
+            stats_record(STATS_RECEIVER_POLL, start_cycles);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Non-blocking receiver of the twist board communication protocol.
+ *
+ * Received bytes are pushed into a ring by the RX path and assembled into text lines or binary frames
+ * by a state machine polled from the application loop. A poll never waits for input and handles a
+ * bounded number of bytes, so commands split in several chunks are simply completed by later polls.
+ *
+ * Typical use, with the reception running in the background task:
+ *
+ *     void loop_background_task() { receiver_rx_task(); }
+ *     void loop_application_task() { receiver_poll(); ... }
+ *
+ * comm_task_start() runs both in background tasks instead (see comm_setpoints.h). Each command handled by
+ * receiver_poll() is published to the control task with setpoints_publish().
+ */
+
+
+#ifndef COMM_RECEIVER_H
+#define COMM_RECEIVER_H
+
+#include "comm_protocol.h"
+#include "comm_ring.h"
+
+#define COMM_RX_BYTES_PER_POLL 32
+
+extern commRing_t rx_ring;
+extern uint32_t rx_discarded_lines;
+
+/**
+ * @brief Adds a received byte to the reception ring.
+ *
+ * This function can be called from an interrupt handler. Bytes received while the ring is full are
+ * dropped and counted in rx_ring.overruns.
+ *
+ * @param byte The received byte.
+ */
+void receiver_push(uint8_t byte);
+
+/**
+ * @brief Waits for a byte on the console and pushes it into the reception ring.
+ *
+ * This function blocks in console_getchar() and is meant to be called repeatedly by a low priority task.
+ */
+void receiver_rx_task();
+
+/**
+ * @brief Processes the received bytes without blocking.
+ *
+ * This function handles at most COMM_RX_BYTES_PER_POLL bytes and at most one complete command, which is
+ * dispatched to the same handlers as initial_handle(). Lines longer than bufferstr are discarded up to
+ * their end of line. It also continues the capture dump in progress, if any, and hands the settings of a
+ * finished sequence back to the commands (see sequence_release_step()).
+ *
+ * @return true if a command was dispatched, false otherwise.
+ */
+bool receiver_poll();
+
+#endif  //COMM_RECEIVER_H
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Registry of the measurement channels and power legs of the twist board (see comm_registry.h).
+ */
+
+
+#include "comm_registry.h"
+#include "comm_dispatch.h"
+#include "comm_parse.h"
+
+extern float32_t V1_low_value;
+extern float32_t V2_low_value;
+extern float32_t I1_low_value;
+extern float32_t I2_low_value;
+extern float32_t I_high_value;
+extern float32_t V_high_value;
+
+static_assert(2 * REGISTRY_MAX_CHANNELS <= COMM_HASH_SLOTS, "the name table must keep free slots to probe");
+static_assert(REGISTRY_MAX_LEGS <= 9, "legs are named with a single digit");
+
+// The channels and legs of the Twist board are registered statically, so the pools hold them before any code
+// runs and an application that never calls registry_init() keeps the commands of the Twist board
+#define TWIST_CHANNELS \
+    {"V1", &V1_low_value, V1_LOW, true}, \
+    {"V2", &V2_low_value, V2_LOW, true}, \
+    {"VH", &V_high_value, V_HIGH, true}, \
+    {"I1", &I1_low_value, I1_LOW, true}, \
+    {"I2", &I2_low_value, I2_LOW, true}, \
+    {"IH", &I_high_value, I_HIGH, true}
+
+#define TWIST_LEGS \
+    {{}, {LEG1_CAPA_DGND, LEG1_DRIVER_SWITCH}, &V1_low_value, "V1", 0, 0.1}, \
+    {{}, {LEG2_CAPA_DGND, LEG2_DRIVER_SWITCH}, &V2_low_value, "V2", 0, 0.1}
+
+static constexpr TrackingVariables twist_channels[] = {TWIST_CHANNELS};
+static const PowerLegSettings twist_legs[] = {TWIST_LEGS};
+
+#define TWIST_CHANNELS_NUMBER (sizeof(twist_channels) / sizeof(twist_channels[0]))
+#define TWIST_LEGS_NUMBER (sizeof(twist_legs) / sizeof(twist_legs[0]))
+
+static_assert(BOOL_SETTING_OFF == 0, "the legs of the Twist board are initialized with their settings off");
+
+TrackingVariables tracking_vars[REGISTRY_MAX_CHANNELS] = {TWIST_CHANNELS};
+PowerLegSettings power_leg_settings[REGISTRY_MAX_LEGS] = {TWIST_LEGS};
+
+uint8_t num_tracking_vars = TWIST_CHANNELS_NUMBER;
+uint8_t num_power_legs = TWIST_LEGS_NUMBER;
+
+// The seed of the name table is chosen so that the channels of the Twist board are found without probing
+static constexpr uint8_t channel_key(const TrackingVariables &channel, uint16_t seed) { return name_hash(channel.name, seed); }
+
+static constexpr commHashTable_t twist_names = hash_table_build(twist_channels, channel_key);
+
+static_assert(twist_names.perfect, "the Twist board channels collide for every seed of name_hash()");
+
+// Open addressing table of the channel names, probed linearly from name_hash()
+static commHashTable_t tracking_vars_names = twist_names;
+
+
+/**
+ * @brief Finds the slot of a channel name: the one holding it, or the free slot where it would be inserted.
+ */
+static uint8_t name_slot(const commToken_t *name)
+{
+    // A one-character name is hashed as its null-terminated registered string
+    const char key[REGISTRY_NAME_LENGTH] = {name->text[0], (name->length > 1) ? name->text[1] : '\0'};
+    uint8_t slot = name_hash(key, tracking_vars_names.seed);
+    while (tracking_vars_names.slot[slot] != COMM_HASH_EMPTY && !token_equals(name, tracking_vars[tracking_vars_names.slot[slot]].name))
+    {
+        slot = (slot + 1) & (COMM_HASH_SLOTS - 1);
+    }
+    return slot;
+}
+
+
+static uint8_t add_channel(const char *name, float32_t *address, channel_t channel_reference, bool calibrated)
+{
+    size_t length = strlen(name);
+    if (length == 0 || length > REGISTRY_NAME_LENGTH || address == NULL || num_tracking_vars >= REGISTRY_MAX_CHANNELS)
+    {
+        printk("Cannot register channel %s\n", name);
+        return COMM_NO_INDEX;
+    }
+    commToken_t token = {name, (uint8_t)length};
+    uint8_t slot = name_slot(&token);
+    if (tracking_vars_names.slot[slot] != COMM_HASH_EMPTY)
+    {
+        printk("Channel %s already registered\n", name);
+        return COMM_NO_INDEX;
+    }
+
+    uint8_t i = num_tracking_vars++;
+    tracking_vars[i] = {name, address, channel_reference, calibrated};
+    tracking_vars_names.slot[slot] = i;
+    return i;
+}
+
+
+void registry_init()
+{
+    memcpy(tracking_vars, twist_channels, sizeof(twist_channels));
+    memcpy(power_leg_settings, twist_legs, sizeof(twist_legs));
+    num_tracking_vars = TWIST_CHANNELS_NUMBER;
+    num_power_legs = TWIST_LEGS_NUMBER;
+    tracking_vars_names = twist_names;
+}
+
+
+uint8_t registry_add_channel(const char *name, float32_t *address, channel_t channel_reference)
+{
+    return add_channel(name, address, channel_reference, true);
+}
+
+
+uint8_t registry_add_derived(const char *name, float32_t *address)
+{
+    return add_channel(name, address, (channel_t)0, false);
+}
+
+
+uint8_t registry_add_leg(pin_t capa_switch, pin_t driver_switch, uint8_t tracking_variable)
+{
+    if (tracking_variable >= num_tracking_vars || num_power_legs >= REGISTRY_MAX_LEGS)
+    {
+        printk("Cannot register leg %d\n", num_power_legs + 1);
+        return COMM_NO_INDEX;
+    }
+
+    uint8_t i = num_power_legs++;
+    PowerLegSettings *leg = &power_leg_settings[i];
+    memset(leg->settings, BOOL_SETTING_OFF, sizeof(leg->settings));
+    leg->switches[CAPA_SWITCH_INDEX] = capa_switch;
+    leg->switches[DRIVER_SWITCH_INDEX] = driver_switch;
+    leg->tracking_variable = tracking_vars[tracking_variable].address;
+    leg->tracking_var_name = tracking_vars[tracking_variable].name;
+    leg->reference_value = 0;
+    leg->duty_cycle = 0.1;
+    return i;
+}
+
+
+uint8_t find_tracking_var(const commToken_t *name)
+{
+    if (name->length == 0 || name->length > REGISTRY_NAME_LENGTH) return COMM_NO_INDEX;
+    return tracking_vars_names.slot[name_slot(name)];
+}
+
+
+uint8_t find_power_leg(const commToken_t *name)
+{
+    const char *text = name->text;
+    if (name->length != 4 || strncmp(text, "LEG", 3) != 0 || text[3] < '1' || text[3] > '9')
+    {
+        return COMM_NO_INDEX;
+    }
+    uint8_t i = text[3] - '1';
+    return (i < num_power_legs) ? i : COMM_NO_INDEX;
+}
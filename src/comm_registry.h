@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Registry of the measurement channels and power legs of the twist board.
+ *
+ * tracking_vars[] and power_leg_settings[] are static pools of REGISTRY_MAX_CHANNELS and REGISTRY_MAX_LEGS
+ * entries. They are initialized with the six channels and the two legs of the Twist board, so no startup call
+ * is needed, then the application can register its own, for instance derived quantities computed by its
+ * control task. Registration must be done before comm_task_start(), the pools being read without locking
+ * afterwards.
+ *
+ * The binary protocol addresses channels and legs by their index in the pools, which is returned by the
+ * registration. The text protocol keeps using names: a channel is found by name through a hash table filled
+ * at registration, and the legs are named "LEG1", "LEG2", ... in registration order. Nothing is allocated
+ * from the heap, a registration failing once the pool is full.
+ */
+
+
+#ifndef COMM_REGISTRY_H
+#define COMM_REGISTRY_H
+
+#include "comm_protocol.h"
+
+#define REGISTRY_MAX_CHANNELS 16
+#define REGISTRY_MAX_LEGS 4
+#define REGISTRY_NAME_LENGTH 2  // Length of the variable field of the text commands ("_V1_g_...")
+
+extern TrackingVariables tracking_vars[REGISTRY_MAX_CHANNELS];
+extern PowerLegSettings power_leg_settings[REGISTRY_MAX_LEGS];
+
+extern uint8_t num_tracking_vars;
+extern uint8_t num_power_legs;
+
+/**
+ * @brief Restores the registry to the measurement channels and the power legs of the Twist board.
+ *
+ * The channels V1, V2, VH, I1, I2 and IH have the indexes 0 to 5, the legs LEG1 and LEG2 the indexes 0 and 1,
+ * which the pools already hold at startup. The channels and legs registered since are removed, and the legs
+ * are set back off with a duty cycle of 0.1.
+ */
+void registry_init();
+
+/**
+ * @brief Registers a measurement channel.
+ *
+ * @param name The name of the channel, REGISTRY_NAME_LENGTH characters at most, which must stay valid.
+ * @param address The address of the value of the channel, updated by the control task.
+ * @param channel_reference The channel of the DataAPI calibrated by the calibration commands.
+ * @return The index of the channel, or COMM_NO_INDEX if the name is invalid or taken, or the pool is full.
+ */
+uint8_t registry_add_channel(const char *name, float32_t *address, channel_t channel_reference);
+
+/**
+ * @brief Registers a derived quantity, a value computed by the application rather than measured.
+ *
+ * A derived quantity can be tracked, captured and sent in the telemetry like a measurement channel, but it
+ * cannot be calibrated.
+ *
+ * @param name The name of the quantity, REGISTRY_NAME_LENGTH characters at most, which must stay valid.
+ * @param address The address of the value, updated by the control task.
+ * @return The index of the channel, or COMM_NO_INDEX if the name is invalid or taken, or the pool is full.
+ */
+uint8_t registry_add_derived(const char *name, float32_t *address);
+
+/**
+ * @brief Registers a power leg, initially off with a duty cycle of 0.1.
+ *
+ * @param capa_switch The pin of the capacitor switch of the leg.
+ * @param driver_switch The pin of the driver switch of the leg.
+ * @param tracking_variable The index of the channel initially tracked by the leg.
+ * @return The index of the leg, or COMM_NO_INDEX if the channel does not exist or the pool is full.
+ */
+uint8_t registry_add_leg(pin_t capa_switch, pin_t driver_switch, uint8_t tracking_variable);
+
+/**
+ * @brief Finds a tracking variable from its name.
+ *
+ * @param name The field holding the name of the variable ("V1", "IH", ...).
+ * @return The index of the variable in tracking_vars[], or COMM_NO_INDEX if it does not exist.
+ */
+uint8_t find_tracking_var(const commToken_t *name);
+
+/**
+ * @brief Finds a power leg from its name.
+ *
+ * @param name The field holding the name of the leg ("LEG2").
+ * @return The index of the leg in power_leg_settings[], or COMM_NO_INDEX if it does not exist.
+ */
+uint8_t find_power_leg(const commToken_t *name);
+
+
+#endif  //COMM_REGISTRY_H
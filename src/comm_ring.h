@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Lock-free single-producer / single-consumer byte ring.
+ *
+ * The producer (UART/USB RX interrupt or reception task) only writes the head and the consumer
+ * (protocol polling) only writes the tail, so no lock is needed as long as there is a single
+ * context on each side.
+ */
+
+
+#ifndef COMM_RING_H
+#define COMM_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define COMM_RING_SIZE 1024 // must be a power of two
+#define COMM_RING_MASK (COMM_RING_SIZE - 1)
+
+/**
+ * @brief Structure representing a byte ring.
+ */
+typedef struct {
+    uint8_t buffer[COMM_RING_SIZE]; /**< Storage of the ring */
+    uint16_t head;                  /**< Next position written by the producer */
+    uint16_t tail;                  /**< Next position read by the consumer */
+    uint32_t overruns;              /**< Number of bytes dropped because the ring was full */
+} commRing_t;
+
+/**
+ * @brief Returns the number of bytes available in the ring.
+ */
+static inline uint16_t ring_count(const commRing_t *ring)
+{
+    uint16_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint16_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    return (uint16_t)(head - tail);
+}
+
+/**
+ * @brief Returns the number of bytes that can still be added to the ring.
+ */
+static inline uint16_t ring_space(const commRing_t *ring)
+{
+    return COMM_RING_SIZE - ring_count(ring);
+}
+
+/**
+ * @brief Adds a byte to the ring. Must only be called from the producer context.
+ *
+ * @return false if the ring is full, in which case the byte is dropped.
+ */
+static inline bool ring_push(commRing_t *ring, uint8_t byte)
+{
+    uint16_t head = ring->head;
+    if ((uint16_t)(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) >= COMM_RING_SIZE)
+    {
+        ring->overruns++;
+        return false;
+    }
+    ring->buffer[head & COMM_RING_MASK] = byte;
+    __atomic_store_n(&ring->head, (uint16_t)(head + 1), __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * @brief Adds a block of bytes to the ring. Must only be called from the producer context.
+ *
+ * The block is published at once: the consumer sees either all of its bytes or none of them.
+ *
+ * @return false if the block does not fit in the ring, in which case it is dropped.
+ */
+static inline bool ring_write(commRing_t *ring, const uint8_t *data, uint16_t length)
+{
+    if (ring_space(ring) < length)
+    {
+        ring->overruns += length;
+        return false;
+    }
+    uint16_t head = ring->head;
+    for (uint16_t i = 0; i < length; i++)
+    {
+        ring->buffer[(uint16_t)(head + i) & COMM_RING_MASK] = data[i];
+    }
+    __atomic_store_n(&ring->head, (uint16_t)(head + length), __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * @brief Reads the byte at the given position from the tail without removing it. Must only be called
+ * from the consumer context, with a position lower than ring_count().
+ */
+static inline uint8_t ring_peek(const commRing_t *ring, uint16_t position)
+{
+    return ring->buffer[(uint16_t)(ring->tail + position) & COMM_RING_MASK];
+}
+
+/**
+ * @brief Removes a byte from the ring. Must only be called from the consumer context.
+ *
+ * @return false if the ring is empty.
+ */
+static inline bool ring_pop(commRing_t *ring, uint8_t *byte)
+{
+    uint16_t tail = ring->tail;
+    if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) return false;
+    *byte = ring->buffer[tail & COMM_RING_MASK];
+    __atomic_store_n(&ring->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+    return true;
+}
+
+#endif  //COMM_RING_H
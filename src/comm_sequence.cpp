@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  On-device playback of setpoint sequences.
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include "comm_sequence.h"
+#include "comm_setpoints.h"
+#include "comm_transmitter.h"
+
+#define SEQUENCE_TARGETS (REGISTRY_MAX_LEGS * SEQUENCE_MAX_SETTINGS)
+
+static_assert(SEQUENCE_TARGETS <= 32, "the driven settings are tracked by the bits of a u32");
+static_assert(REGISTRY_MAX_LEGS <= 16, "leg indexes must fit in the high nibble of sequenceEntry_t.target");
+static_assert(sizeof(sequenceEntry_t) == 12, "sequenceEntry_t must stay compact");
+
+/**
+ * @brief Structure representing a setting driven by the sequence.
+ */
+typedef struct {
+    float32_t value;        /**< Current value */
+    float32_t ramp_start;   /**< Value at the beginning of the ramp in progress */
+    float32_t ramp_end;     /**< Value at the end of the ramp in progress */
+    uint32_t ramp_begin;    /**< Period of the beginning of the ramp in progress */
+    uint16_t ramp_length;   /**< Length of the ramp in progress, 0 if none */
+    uint8_t variable;       /**< Tracking variable, for the reference setting */
+} sequenceTarget_t;
+
+sequence_states_t sequence_state = SEQUENCE_IDLE;
+
+// Table, only written by the task handling the commands while the sequence is idle
+static sequenceEntry_t sequence_entries[SEQUENCE_MAX_ENTRIES];
+static uint16_t sequence_length = 0;
+static uint32_t sequence_duration = 0;
+static uint16_t sequence_loops = 1;
+static uint32_t loaded_targets = 0;
+static bool stop_request = false;
+
+// Playback, only written by the control task
+static sequenceTarget_t targets[SEQUENCE_TARGETS];
+static uint32_t driven_targets = 0;
+static uint16_t position = 0;
+static uint32_t period = 0;
+static uint16_t loop = 0;
+
+static commFrame_t sequence_frame;
+
+
+/**
+ * @brief Applies the current values of the given driven settings.
+ *
+ * @param legs The settings of the power legs to update.
+ * @param mask The driven settings to apply, the bit i being the target i.
+ * @param drive_switches Whether to drive the switches of the boolean settings that change.
+ */
+static void apply_targets(PowerLegSettings *legs, uint32_t mask, bool drive_switches)
+{
+    for (uint8_t i = 0; i < SEQUENCE_TARGETS; i++)
+    {
+        if (!(mask & (1U << i))) continue;
+        uint8_t leg = i / SEQUENCE_MAX_SETTINGS;
+        uint8_t setting = i % SEQUENCE_MAX_SETTINGS;
+        bool was_on = (setting < BOOL_SETTINGS_NUMBER) && legs[leg].settings[setting];
+        power_settings[setting].apply(&legs[leg], setting, targets[i].variable, targets[i].value);
+        if (drive_switches && setting < BOOL_SETTINGS_NUMBER && legs[leg].settings[setting] != was_on)
+        {
+            legSwitchesApply(&legs[leg], setting);
+        }
+    }
+}
+
+
+bool sequence_overriding()
+{
+    sequence_states_t state = __atomic_load_n(&sequence_state, __ATOMIC_ACQUIRE);
+    return state == SEQUENCE_PLAYING || state == SEQUENCE_DONE;
+}
+
+
+void sequence_override(PowerLegSettings *legs)
+{
+    apply_targets(legs, driven_targets, false);
+}
+
+
+void sequence_tick()
+{
+    sequence_states_t state = __atomic_load_n(&sequence_state, __ATOMIC_ACQUIRE);
+    if (state == SEQUENCE_ARMED)
+    {
+        if (__atomic_exchange_n(&stop_request, false, __ATOMIC_ACQ_REL))
+        {
+            __atomic_store_n(&sequence_state, SEQUENCE_IDLE, __ATOMIC_RELEASE);
+            return;
+        }
+        driven_targets = 0;
+        position = 0;
+        period = 0;
+        loop = 0;
+        state = SEQUENCE_PLAYING;
+        __atomic_store_n(&sequence_state, state, __ATOMIC_RELEASE);
+    }
+    if (state != SEQUENCE_PLAYING) return;
+    if (__atomic_exchange_n(&stop_request, false, __ATOMIC_ACQ_REL))
+    {
+        __atomic_store_n(&sequence_state, SEQUENCE_DONE, __ATOMIC_RELEASE);
+        return;
+    }
+
+    uint32_t changed = 0;
+    while (position < sequence_length && sequence_entries[position].period <= period)
+    {
+        const sequenceEntry_t *entry = &sequence_entries[position++];
+        uint8_t i = (entry->target >> 4) * SEQUENCE_MAX_SETTINGS + (entry->target & 0x0F);
+        sequenceTarget_t *target = &targets[i];
+        target->variable = entry->variable;
+        if (entry->ramp == 0)
+        {
+            target->value = entry->value;
+            target->ramp_length = 0;
+        }
+        else
+        {
+            target->ramp_start = target->value;
+            target->ramp_end = entry->value;
+            target->ramp_begin = period;
+            target->ramp_length = entry->ramp;
+        }
+        driven_targets |= 1U << i;
+        changed |= 1U << i;
+    }
+
+    for (uint8_t i = 0; i < SEQUENCE_TARGETS; i++)
+    {
+        sequenceTarget_t *target = &targets[i];
+        if (target->ramp_length == 0) continue;
+        uint32_t elapsed = period - target->ramp_begin;
+        if (elapsed >= target->ramp_length)
+        {
+            target->value = target->ramp_end;
+            target->ramp_length = 0;
+        }
+        else
+        {
+            target->value = target->ramp_start
+                            + (target->ramp_end - target->ramp_start) * (float32_t)elapsed / target->ramp_length;
+        }
+        changed |= 1U << i;
+    }
+    apply_targets(control_setpoints.legs, changed, true);
+
+    if (++period > sequence_duration)
+    {
+        if (sequence_loops != 0 && ++loop >= sequence_loops)
+        {
+            __atomic_store_n(&sequence_state, SEQUENCE_DONE, __ATOMIC_RELEASE);
+            return;
+        }
+        position = 0;
+        period = 0;
+    }
+}
+
+
+void sequence_release_step()
+{
+    if (__atomic_load_n(&sequence_state, __ATOMIC_ACQUIRE) != SEQUENCE_DONE) return;
+    apply_targets(power_leg_settings, driven_targets, false);
+    setpoints_publish();
+    __atomic_store_n(&sequence_state, SEQUENCE_IDLE, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @brief Validates and appends the entries of a load command.
+ */
+static comm_status_t sequence_load(const commFrame_t *frame)
+{
+    if (frame->length < 3 || (frame->length - 3) % SEQUENCE_ENTRY_SIZE != 0)
+    {
+        printk("Invalid sequence frame\n");
+        return COMM_ERROR_FORMAT;
+    }
+    uint16_t index;
+    memcpy(&index, frame->payload + 1, sizeof(uint16_t));
+    uint8_t count = (frame->length - 3) / SEQUENCE_ENTRY_SIZE;
+    if (index != sequence_length || sequence_length + count > SEQUENCE_MAX_ENTRIES)
+    {
+        printk("Invalid sequence index: %d\n", index);
+        return COMM_ERROR_RANGE;
+    }
+
+    // All the entries are checked before any of them is appended
+    uint32_t loaded = loaded_targets;
+    uint32_t duration = sequence_duration;
+    uint32_t last_period = (sequence_length > 0) ? sequence_entries[sequence_length - 1].period : 0;
+    for (uint8_t n = 0; n < count; n++)
+    {
+        const uint8_t *raw = frame->payload + 3 + n * SEQUENCE_ENTRY_SIZE;
+        sequenceEntry_t *entry = &sequence_entries[sequence_length + n];
+        memcpy(&entry->period, raw, sizeof(uint32_t));
+        memcpy(&entry->ramp, raw + 4, sizeof(uint16_t));
+        uint8_t setting = find_power_setting(raw[6]);
+        uint8_t leg = raw[7];
+        entry->variable = raw[8];
+        memcpy(&entry->value, raw + 9, sizeof(float32_t));
+
+        if (setting == COMM_NO_INDEX || power_settings[setting].apply == NULL) return COMM_ERROR_UNKNOWN_COMMAND;
+        if (leg >= num_power_legs) return COMM_ERROR_LEG;
+        if (entry->period < last_period)
+        {
+            printk("Sequence entries must be sorted by period\n");
+            return COMM_ERROR_RANGE;
+        }
+        uint32_t bit = 1U << (leg * SEQUENCE_MAX_SETTINGS + setting);
+        if (entry->ramp != 0 && (setting < BOOL_SETTINGS_NUMBER || !(loaded & bit)))
+        {
+            printk("A ramp must follow a value of the same setting\n");
+            return COMM_ERROR_RANGE;
+        }
+
+        // The value is checked by the apply function, on a copy of the leg
+        PowerLegSettings scratch = power_leg_settings[leg];
+        comm_status_t status = power_settings[setting].apply(&scratch, setting, entry->variable, entry->value);
+        if (status != COMM_OK) return status;
+
+        entry->target = (leg << 4) | setting;
+        last_period = entry->period;
+        loaded |= bit;
+        if (entry->period + entry->ramp > duration) duration = entry->period + entry->ramp;
+    }
+
+    sequence_length += count;
+    sequence_duration = duration;
+    loaded_targets = loaded;
+    return COMM_OK;
+}
+
+
+/**
+ * @brief Fills sequence_frame with the status of the sequence.
+ */
+static void build_status()
+{
+    uint16_t current_loop = loop;
+    uint32_t current_period = period;
+    sequence_frame.opcode = COMM_OP_SEQUENCE;
+    sequence_frame.leg = COMM_NO_INDEX;
+    sequence_frame.variable = COMM_NO_INDEX;
+    sequence_frame.length = 12;
+    sequence_frame.payload[0] = SEQUENCE_CMD_STATUS;
+    sequence_frame.payload[1] = __atomic_load_n(&sequence_state, __ATOMIC_ACQUIRE);
+    memcpy(sequence_frame.payload + 2, &sequence_length, sizeof(uint16_t));
+    memcpy(sequence_frame.payload + 4, &position, sizeof(uint16_t));
+    memcpy(sequence_frame.payload + 6, &current_period, sizeof(uint32_t));
+    memcpy(sequence_frame.payload + 10, &current_loop, sizeof(uint16_t));
+}
+
+
+comm_status_t sequenceHandler(const commFrame_t *frame)
+{
+    if (frame->length < 1)
+    {
+        printk("Invalid sequence frame\n");
+        return COMM_ERROR_FORMAT;
+    }
+
+    // A finished sequence hands its settings back before the table can change
+    sequence_release_step();
+    sequence_states_t state = __atomic_load_n(&sequence_state, __ATOMIC_ACQUIRE);
+
+    switch (frame->payload[0])
+    {
+    case SEQUENCE_CMD_CLEAR:
+        if (state != SEQUENCE_IDLE) return COMM_ERROR_BUSY;
+        sequence_length = 0;
+        sequence_duration = 0;
+        loaded_targets = 0;
+        break;
+    case SEQUENCE_CMD_LOAD:
+        if (state != SEQUENCE_IDLE) return COMM_ERROR_BUSY;
+        return sequence_load(frame);
+    case SEQUENCE_CMD_START:
+        if (state != SEQUENCE_IDLE) return COMM_ERROR_BUSY;
+        if (sequence_length == 0)
+        {
+            printk("Empty sequence\n");
+            return COMM_ERROR_RANGE;
+        }
+        sequence_loops = 1;
+        if (frame->length >= 3) memcpy(&sequence_loops, frame->payload + 1, sizeof(uint16_t));
+        __atomic_store_n(&stop_request, false, __ATOMIC_RELAXED);
+        __atomic_store_n(&sequence_state, SEQUENCE_ARMED, __ATOMIC_RELEASE);
+        break;
+    case SEQUENCE_CMD_STOP:
+        if (state == SEQUENCE_ARMED || state == SEQUENCE_PLAYING)
+        {
+            __atomic_store_n(&stop_request, true, __ATOMIC_RELEASE);
+        }
+        break;
+    case SEQUENCE_CMD_STATUS:
+        build_status();
+        if (!transmitter_send_response(&sequence_frame)) return COMM_ERROR_BUSY;
+        break;
+    default:
+        printk("Unknown sequence command: %d\n", frame->payload[0]);
+        return COMM_ERROR_UNKNOWN_COMMAND;
+    }
+    return COMM_OK;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  On-device playback of setpoint sequences.
+ *
+ * A sequence is a table of entries, each one applying a setting of power_settings[] to a power leg at a given
+ * control period, counted from the start of the sequence. An entry is either a step, applied at its period,
+ * or a linear ramp from the value of the previous entry of the same setting, which reaches its value after
+ * RAMP periods. Entries go through the apply functions of power_settings[], so they have the same meaning
+ * and the same valid ranges as the commands.
+ *
+ * sequence_tick(), called by the control task at each period right after setpoints_acquire(), plays the
+ * sequence back. While the sequence plays, the settings it drives override the ones published by the
+ * commands. Once it ends, or is stopped, its last values are copied into the working copies by the task
+ * handling the commands, so they are kept as if they had been sent as commands.
+ *
+ * The sequence is controlled with frames of opcode COMM_OP_SEQUENCE whose first payload byte is a command:
+ *
+ * - SEQUENCE_CMD_CLEAR:  | CMD |
+ * - SEQUENCE_CMD_LOAD:   | CMD | INDEX (u16) | entries |
+ * - SEQUENCE_CMD_START:  | CMD | LOOPS (u16) |
+ * - SEQUENCE_CMD_STOP:   | CMD |
+ * - SEQUENCE_CMD_STATUS: | CMD |
+ *
+ * where each entry of a load is encoded on SEQUENCE_ENTRY_SIZE bytes:
+ *
+ *   | PERIOD (u32) | RAMP (u16) | OPCODE (u8) | LEG (u8) | VARIABLE (u8) | VALUE (f32) |
+ *
+ * INDEX is the number of entries already loaded, entries being appended in order of PERIOD. LOOPS is the
+ * number of times the sequence is played, 0 playing it until stopped. The board answers the status command
+ * with a frame of the same opcode:
+ *
+ *   | CMD | STATE (u8) | ENTRIES (u16) | POSITION (u16) | PERIOD (u32) | LOOP (u16) |
+ *
+ * where POSITION is the index of the next entry, PERIOD the current period and LOOP the current loop.
+ */
+
+
+#ifndef COMM_SEQUENCE_H
+#define COMM_SEQUENCE_H
+
+#include "comm_frame.h"
+
+#define COMM_OP_SEQUENCE 'W'
+
+#define SEQUENCE_MAX_ENTRIES 256
+#define SEQUENCE_ENTRY_SIZE 13
+#define SEQUENCE_MAX_SETTINGS 8
+
+typedef enum
+{
+    SEQUENCE_CMD_CLEAR = 1, SEQUENCE_CMD_LOAD, SEQUENCE_CMD_START, SEQUENCE_CMD_STOP, SEQUENCE_CMD_STATUS
+} sequence_commands_t;
+
+typedef enum
+{
+    SEQUENCE_IDLE, SEQUENCE_ARMED, SEQUENCE_PLAYING, SEQUENCE_DONE
+} sequence_states_t;
+
+/**
+ * @brief Structure representing an entry of a sequence, as stored in RAM.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t period;        /**< Control period of the entry, counted from the start of the sequence */
+    uint16_t ramp;          /**< Length of the ramp in periods, 0 for a step */
+    uint8_t target;         /**< Power leg in the high nibble, index in power_settings[] in the low nibble */
+    uint8_t variable;       /**< Index of the tracking variable, for the reference setting */
+    float32_t value;        /**< Value passed to the apply function */
+} sequenceEntry_t;
+
+extern sequence_states_t sequence_state;
+
+/**
+ * @brief Plays the sequence back.
+ *
+ * This function is meant to be called by the control task at each control period, right after
+ * setpoints_acquire(). It updates control_setpoints with the settings driven by the sequence.
+ */
+void sequence_tick();
+
+/**
+ * @brief Tells whether the sequence overrides the published setpoints.
+ *
+ * This function is called by setpoints_acquire() from the control task, before it picks up new setpoints.
+ */
+bool sequence_overriding();
+
+/**
+ * @brief Applies the settings driven by the sequence to setpoints picked up by the control task.
+ *
+ * @param legs The settings of the power legs.
+ */
+void sequence_override(PowerLegSettings *legs);
+
+/**
+ * @brief Copies the last values of a finished sequence into the working copies, if any.
+ *
+ * This function is meant to be called from the task handling the commands. The settings are then
+ * published and the sequence becomes idle.
+ */
+void sequence_release_step();
+
+/**
+ * @brief Handles a sequence frame.
+ *
+ * @param frame The frame, whose first payload byte is the command.
+ * @return The result of the command, COMM_ERROR_BUSY for a load or a start while a sequence plays.
+ */
+comm_status_t sequenceHandler(const commFrame_t *frame);
+
+#endif  //COMM_SEQUENCE_H
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Handoff of the setpoints from the command task to the control task.
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include "comm_setpoints.h"
+#include "comm_receiver.h"
+#include "comm_transmitter.h"
+#include "comm_sequence.h"
+#include "comm_calibration.h"
+#include "comm_events.h"
+#include "comm_link.h"
+#include "comm_stats.h"
+
+// The index of the shared buffer, with SETPOINTS_FRESH set if the command task has published it
+#define SETPOINTS_INDEX_MASK 0x03
+#define SETPOINTS_FRESH 0x04
+
+commSetpoints_t control_setpoints;
+
+static commSetpoints_t setpoints_buffers[3];
+static uint8_t write_index = 0;     // Owned by the command task
+static uint8_t shared_index = 1;    // Exchanged atomically
+static uint8_t read_index = 2;      // Owned by the control task
+
+static commCalibration_t calibrations[REGISTRY_MAX_CHANNELS];
+
+
+void setpoints_init()
+{
+    setpoints_publish();
+    read_index = __atomic_exchange_n(&shared_index, read_index, __ATOMIC_ACQ_REL) & SETPOINTS_INDEX_MASK;
+    memcpy(&control_setpoints, &setpoints_buffers[read_index], sizeof(control_setpoints));
+}
+
+
+void setpoints_calibrate(uint8_t variable, float32_t gain, float32_t offset)
+{
+    if (variable >= REGISTRY_MAX_CHANNELS) return;
+    calibrations[variable].gain = gain;
+    calibrations[variable].offset = offset;
+    calibrations[variable].updates++;
+}
+
+
+const commCalibration_t *setpoints_calibration(uint8_t variable)
+{
+    return (variable < REGISTRY_MAX_CHANNELS) ? &calibrations[variable] : NULL;
+}
+
+
+void setpoints_publish()
+{
+    commSetpoints_t *setpoints = &setpoints_buffers[write_index];
+    memcpy(setpoints->legs, power_leg_settings, sizeof(setpoints->legs));
+    setpoints->mode = mode;
+    setpoints->reference_value = reference_value;
+    memcpy(setpoints->calibrations, calibrations, sizeof(setpoints->calibrations));
+    setpoints->telemetry = telemetry_config;
+    events_check(setpoints);
+
+    write_index = __atomic_exchange_n(&shared_index, write_index | SETPOINTS_FRESH, __ATOMIC_ACQ_REL)
+                  & SETPOINTS_INDEX_MASK;
+}
+
+
+bool setpoints_acquire()
+{
+    // Checked first: a sequence handing its settings back publishes them before it stops overriding
+    bool overriding = sequence_overriding();
+    if (!(__atomic_load_n(&shared_index, __ATOMIC_ACQUIRE) & SETPOINTS_FRESH)) return false;
+    read_index = __atomic_exchange_n(&shared_index, read_index, __ATOMIC_ACQ_REL) & SETPOINTS_INDEX_MASK;
+    commSetpoints_t *setpoints = &setpoints_buffers[read_index];
+    if (overriding) sequence_override(setpoints->legs);
+
+    for (uint8_t leg = 0; leg < num_power_legs; leg++)
+    {
+        for (uint8_t setting = 0; setting < BOOL_SETTINGS_NUMBER; setting++)
+        {
+            if (setpoints->legs[leg].settings[setting] != control_setpoints.legs[leg].settings[setting])
+            {
+                legSwitchesApply(&setpoints->legs[leg], setting);
+            }
+        }
+    }
+    for (uint8_t i = 0; i < num_tracking_vars; i++)
+    {
+        const commCalibration_t *calibration = &setpoints->calibrations[i];
+        if (calibration->updates != control_setpoints.calibrations[i].updates)
+        {
+            data.setParameters(tracking_vars[i].channel_reference, calibration->gain, calibration->offset);
+        }
+    }
+
+    memcpy(&control_setpoints, setpoints, sizeof(control_setpoints));
+    return true;
+}
+
+
+void comm_background_task()
+{
+    bool handled = receiver_poll();
+    transmitter_flush();
+    link_step();
+    if (!handled && ring_count(&rx_ring) == 0 && ring_count(&tx_ring) == 0 && ring_count(&response_ring) == 0)
+    {
+        task.suspendBackgroundUs(COMM_TASK_IDLE_US);
+    }
+}
+
+
+void comm_init(uint32_t control_period_us)
+{
+    stats_init();
+    link_init(control_period_us);
+}
+
+
+void comm_task_start()
+{
+    calibration_restore();
+    setpoints_init();
+    int8_t rx_task = task.createBackground(receiver_rx_task);
+    int8_t command_task = task.createBackground(comm_background_task);
+    task.startBackground(rx_task);
+    task.startBackground(command_task);
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Handoff of the setpoints from the command task to the control task.
+ *
+ * The handlers only modify working copies: power_leg_settings[], reference_value, mode, telemetry_config and
+ * the calibrations staged by calibrationApply(). Once a command has been handled, setpoints_publish() copies them into a
+ * triple buffer. The control task calls setpoints_acquire() at the beginning of each period, which makes
+ * the latest published setpoints visible in control_setpoints, drives the switches whose settings changed
+ * and applies the new calibrations.
+ *
+ * Neither side ever waits for the other: the command task always owns a buffer to write, the control task
+ * always owns a buffer to read, and they exchange the third one with a single atomic operation. Setpoints
+ * published twice before the control task picks them up are simply replaced by the latest ones, so the
+ * control task never observes a partially updated command. While a sequence plays (see comm_sequence.h),
+ * the settings it drives take precedence over the published ones. The changes of the published setpoints are
+ * reported to the host as events (see comm_events.h).
+ *
+ * comm_init() prepares the communication at startup, then comm_task_start() restores the saved calibrations
+ * (see comm_calibration.h) and runs the parsing in TaskAPI background tasks, away from the control task.
+ */
+
+
+#ifndef COMM_SETPOINTS_H
+#define COMM_SETPOINTS_H
+
+#include "comm_registry.h"
+#include "comm_telemetry.h"
+
+#define COMM_TASK_IDLE_US 100
+
+/**
+ * @brief Structure representing the calibration of a tracking variable.
+ */
+typedef struct {
+    float32_t gain;             /**< Gain of the channel */
+    float32_t offset;           /**< Offset of the channel */
+    uint32_t updates;           /**< Number of calibrations of the channel, so each one is applied once */
+} commCalibration_t;
+
+/**
+ * @brief Structure representing everything the control task reads from the commands.
+ */
+typedef struct {
+    PowerLegSettings legs[REGISTRY_MAX_LEGS];                       /**< Settings of the power legs */
+    tester_states_t mode;                                           /**< Tester state */
+    float32_t reference_value;                                      /**< Last reference parsed from a text command */
+    commCalibration_t calibrations[REGISTRY_MAX_CHANNELS];          /**< Calibrations of tracking_vars[] */
+    telemetryConfig_t telemetry;                                    /**< Configuration of the telemetry stream */
+} commSetpoints_t;
+
+/**
+ * @brief The setpoints of the control task, only written by setpoints_acquire().
+ */
+extern commSetpoints_t control_setpoints;
+
+/**
+ * @brief Publishes the initial working copies and makes them visible in control_setpoints.
+ *
+ * This function must be called once at startup, before the control task starts.
+ */
+void setpoints_init();
+
+/**
+ * @brief Stages the calibration of a tracking variable, applied by the control task once published.
+ *
+ * @param variable The index of the variable in tracking_vars[].
+ * @param gain The gain of the channel.
+ * @param offset The offset of the channel.
+ */
+void setpoints_calibrate(uint8_t variable, float32_t gain, float32_t offset);
+
+/**
+ * @brief Returns the latest calibration staged for a tracking variable.
+ *
+ * @param variable The index of the variable in tracking_vars[].
+ * @return The calibration, whose updates count is 0 if the variable has never been calibrated, or NULL if the
+ * index is out of range.
+ */
+const commCalibration_t *setpoints_calibration(uint8_t variable);
+
+/**
+ * @brief Publishes the working copies of the setpoints.
+ *
+ * This function must always be called from the task handling the commands. It never blocks.
+ */
+void setpoints_publish();
+
+/**
+ * @brief Picks up the latest published setpoints, if any.
+ *
+ * This function is meant to be called by the control task at the beginning of each control period. It never
+ * blocks. It updates control_setpoints, drives the switches whose settings changed and applies the new
+ * calibrations.
+ *
+ * @return true if new setpoints have been picked up.
+ */
+bool setpoints_acquire();
+
+/**
+ * @brief Routine of the background task handling the commands.
+ *
+ * It handles the received bytes, publishes the setpoints, writes the queued frames and steps a baud rate change
+ * (see link_step()), then sleeps COMM_TASK_IDLE_US if there is nothing left to do.
+ */
+void comm_background_task();
+
+/**
+ * @brief Initializes the communication. To be called once at startup.
+ *
+ * It starts the cycle counter (see stats_init()) and gives the control period to the link (see link_init()).
+ * The channels and the legs of the Twist board are registered statically (see comm_registry.h). The
+ * application then registers its own channels and legs and calls comm_task_start(), or calibration_restore()
+ * and setpoints_init() if it handles the commands with the blocking initial_handle().
+ *
+ * @param control_period_us The period of the control task in microseconds.
+ */
+void comm_init(uint32_t control_period_us);
+
+/**
+ * @brief Starts the communication in TaskAPI background tasks.
+ *
+ * One task reads the console into the reception ring (see receiver_rx_task()), the other runs
+ * comm_background_task(). calibration_restore() and setpoints_init() are called first.
+ */
+void comm_task_start();
+
+#endif  //COMM_SETPOINTS_H
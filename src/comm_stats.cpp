@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Instrumentation of the twist board communication protocol.
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include "comm_stats.h"
+#include "comm_receiver.h"
+#include "comm_transmitter.h"
+
+static_assert((STATS_COUNTERS_NUMBER + 3 * STATS_SECTIONS_NUMBER) * sizeof(uint32_t) <= COMM_FRAME_MAX_PAYLOAD,
+              "The statistics must fit in a frame");
+
+commCycleStats_t comm_cycle_stats[STATS_SECTIONS_NUMBER];
+commCounters_t comm_counters;
+
+static commFrame_t stats_frame;
+
+// Counters of the other modules at the last reset, which are only written by their own task
+static uint32_t rx_overruns_reset = 0;
+static uint32_t tx_dropped_reset = 0;
+
+// Set by stats_reset() in the command task, the sections measured by the control task are cleared by
+// stats_control_tick() in that task
+static bool control_reset_pending = false;
+
+
+/**
+ * @brief Tells whether a section is measured by the control task.
+ */
+static bool control_task_section(uint8_t section)
+{
+    return section == STATS_TELEMETRY_TICK;
+}
+
+
+/**
+ * @brief Clears the cycles spent in a section.
+ */
+static void clear_section(uint8_t section)
+{
+    comm_cycle_stats[section].calls = 0;
+    comm_cycle_stats[section].min_cycles = UINT32_MAX;
+    comm_cycle_stats[section].max_cycles = 0;
+    comm_cycle_stats[section].total_cycles = 0;
+}
+
+
+void stats_init()
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    // No task runs yet, every section is cleared at once
+    for (uint8_t i = 0; i < STATS_SECTIONS_NUMBER; i++) clear_section(i);
+    stats_reset();
+}
+
+
+void stats_reset()
+{
+    for (uint8_t i = 0; i < STATS_SECTIONS_NUMBER; i++)
+    {
+        if (!control_task_section(i)) clear_section(i);
+    }
+    __atomic_store_n(&control_reset_pending, true, __ATOMIC_RELEASE);
+    memset(&comm_counters, 0, sizeof(comm_counters));
+    rx_overruns_reset = rx_ring.overruns;
+    tx_dropped_reset = __atomic_load_n(&tx_dropped_frames, __ATOMIC_RELAXED);
+}
+
+
+void stats_control_tick()
+{
+    if (!__atomic_exchange_n(&control_reset_pending, false, __ATOMIC_ACQUIRE)) return;
+    for (uint8_t i = 0; i < STATS_SECTIONS_NUMBER; i++)
+    {
+        if (control_task_section(i)) clear_section(i);
+    }
+}
+
+
+void stats_record(comm_stats_sections_t section, uint32_t start_cycles)
+{
+    uint32_t cycles = stats_cycles() - start_cycles;
+    commCycleStats_t *stats = &comm_cycle_stats[section];
+    if (cycles < stats->min_cycles) stats->min_cycles = cycles;
+    if (cycles > stats->max_cycles) stats->max_cycles = cycles;
+    stats->total_cycles += cycles;
+    stats->calls++;
+}
+
+
+void stats_count_command(comm_status_t status)
+{
+    if (status == COMM_ERROR_UNKNOWN_COMMAND) comm_counters.unknown_commands++;
+    else if (status != COMM_OK) comm_counters.rejected_commands++;
+}
+
+
+/**
+ * @brief Appends a little endian u32 to stats_frame.
+ */
+static void put_u32(uint32_t value)
+{
+    memcpy(stats_frame.payload + stats_frame.length, &value, sizeof(uint32_t));
+    stats_frame.length += sizeof(uint32_t);
+}
+
+
+comm_status_t statsHandler(const commFrame_t *frame)
+{
+    stats_frame.opcode = COMM_OP_STATS;
+    stats_frame.leg = COMM_NO_INDEX;
+    stats_frame.variable = COMM_NO_INDEX;
+    stats_frame.length = 0;
+
+    put_u32(comm_counters.bytes_received);
+    put_u32(comm_counters.lines);
+    put_u32(comm_counters.frames);
+    put_u32(comm_counters.parse_errors);
+    put_u32(comm_counters.unknown_commands);
+    put_u32(comm_counters.rejected_commands);
+    put_u32(rx_ring.overruns - rx_overruns_reset);
+    put_u32(__atomic_load_n(&tx_dropped_frames, __ATOMIC_RELAXED) - tx_dropped_reset);
+
+    for (uint8_t i = 0; i < STATS_SECTIONS_NUMBER; i++)
+    {
+        const commCycleStats_t *stats = &comm_cycle_stats[i];
+        put_u32(stats->calls ? stats->min_cycles : 0);
+        put_u32(stats->max_cycles);
+        put_u32(stats->calls ? (uint32_t)(stats->total_cycles / stats->calls) : 0);
+    }
+
+    if (!transmitter_send_response(&stats_frame)) return COMM_ERROR_BUSY;
+    if (frame->length >= 1 && frame->payload[0] != 0) stats_reset();
+    return COMM_OK;
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Instrumentation of the twist board communication protocol.
+ *
+ * The time spent in the hot paths of the protocol is measured with the DWT cycle counter of the Cortex-M
+ * core, and the traffic is summarized by counters. The host asks for them with a frame of opcode COMM_OP_STATS,
+ * whose optional payload | RESET (u8) | clears the statistics once sent if not null. The board answers with
+ * a frame of the same opcode holding the little endian payload:
+ *
+ *   | BYTES | LINES | FRAMES | PARSE ERRORS | UNKNOWN COMMANDS | REJECTED COMMANDS | RX OVERRUNS | TX DROPPED |
+ *   | MIN | MAX | MEAN cycles of each section of comm_stats_sections_t, in enum order |
+ *
+ * all the fields being u32. A section never measured reports 0 cycles. Sections are nested: initial_handle()
+ * includes console_read_line() and the handlers it dispatches, receiver_poll() the handlers it dispatches.
+ */
+
+
+#ifndef COMM_STATS_H
+#define COMM_STATS_H
+
+#include <cmsis_core.h>
+
+#include "comm_frame.h"
+
+#define COMM_OP_STATS 'Q'
+#define STATS_COUNTERS_NUMBER 8
+
+typedef enum
+{
+    STATS_INITIAL_HANDLE,               /**< initial_handle(), blocking reception */
+    STATS_CONSOLE_READ_LINE,            /**< console_read_line() */
+    STATS_RECEIVER_POLL,                /**< receiver_poll() calls that completed a command */
+    STATS_DEFAULT_HANDLER,              /**< defaultHandler(), 'd' lines */
+    STATS_POWER_LEG_SETTINGS_HANDLER,   /**< powerLegSettingsHandler(), 's' lines */
+    STATS_CALIBRATION_HANDLER,          /**< calibrationHandler(), 'k' lines */
+    STATS_FRAME_HANDLER,                /**< frameHandler(), binary frames */
+    STATS_TELEMETRY_TICK,               /**< telemetry_tick() periods building a record, in the control task */
+    STATS_SECTIONS_NUMBER
+} comm_stats_sections_t;
+
+/**
+ * @brief Structure holding the cycles spent in a section.
+ */
+typedef struct {
+    uint32_t calls;             /**< Number of measures */
+    uint32_t min_cycles;        /**< Shortest measure */
+    uint32_t max_cycles;        /**< Longest measure */
+    uint64_t total_cycles;      /**< Sum of the measures */
+} commCycleStats_t;
+
+/**
+ * @brief Structure holding the traffic counters.
+ */
+typedef struct {
+    uint32_t bytes_received;    /**< Bytes read from the console */
+    uint32_t lines;             /**< Text commands received */
+    uint32_t frames;            /**< Binary frames with a valid CRC */
+    uint32_t parse_errors;      /**< Frames with an invalid length or CRC, lines too long */
+    uint32_t unknown_commands;  /**< Commands answered COMM_ERROR_UNKNOWN_COMMAND */
+    uint32_t rejected_commands; /**< Commands answered by another error */
+} commCounters_t;
+
+extern commCycleStats_t comm_cycle_stats[STATS_SECTIONS_NUMBER];
+extern commCounters_t comm_counters;
+
+/**
+ * @brief Reads the cycle counter.
+ */
+static inline uint32_t stats_cycles()
+{
+    return DWT->CYCCNT;
+}
+
+/**
+ * @brief Starts the cycle counter and clears the statistics. To be called once at startup.
+ */
+void stats_init();
+
+/**
+ * @brief Clears the statistics.
+ *
+ * The sections measured by the control task are only cleared at its next stats_control_tick(), until then
+ * they report the measures taken before the reset.
+ */
+void stats_reset();
+
+/**
+ * @brief Applies a pending stats_reset() to the sections measured by the control task. To be called by the
+ * control task once per period, before measuring them.
+ */
+void stats_control_tick();
+
+/**
+ * @brief Records the cycles spent in a section.
+ *
+ * Each section must always be measured from the same task.
+ *
+ * @param section The measured section.
+ * @param start_cycles The value of stats_cycles() at the beginning of the section.
+ */
+void stats_record(comm_stats_sections_t section, uint32_t start_cycles);
+
+/**
+ * @brief Counts the result of a command.
+ *
+ * @param status The status returned by the handler of the command.
+ */
+void stats_count_command(comm_status_t status);
+
+/**
+ * @brief Handles a statistics frame, answering with the statistics.
+ *
+ * @param frame The frame, whose optional payload byte requests a reset.
+ * @return COMM_ERROR_BUSY if the answer does not fit in the transmission ring, COMM_OK otherwise.
+ */
+comm_status_t statsHandler(const commFrame_t *frame);
+
+#endif  //COMM_STATS_H
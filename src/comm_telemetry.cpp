@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Binary telemetry streaming of the twist board.
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include "comm_telemetry.h"
+#include "comm_transmitter.h"
+#include "comm_stats.h"
+#include "comm_setpoints.h"
+
+extern float32_t V1_low_value;
+extern float32_t V2_low_value;
+extern float32_t I1_low_value;
+extern float32_t I2_low_value;
+extern float32_t I_high_value;
+extern float32_t V_high_value;
+
+static_assert(sizeof(telemetryRecord_t) == 44, "telemetryRecord_t must match the documented layout");
+
+// Channels that can be subscribed to, the position in the table being the bit of the subscription mask.
+// Setpoints are those applied by the control task, which builds the records.
+constexpr telemetryChannel_t telemetry_channels[] = {
+    {"V1", &V1_low_value, CHANNEL_FLOAT32},
+    {"V2", &V2_low_value, CHANNEL_FLOAT32},
+    {"VH", &V_high_value, CHANNEL_FLOAT32},
+    {"I1", &I1_low_value, CHANNEL_FLOAT32},
+    {"I2", &I2_low_value, CHANNEL_FLOAT32},
+    {"IH", &I_high_value, CHANNEL_FLOAT32},
+    {"D1", &control_setpoints.legs[0].duty_cycle, CHANNEL_FLOAT32},
+    {"D2", &control_setpoints.legs[1].duty_cycle, CHANNEL_FLOAT32},
+    {"R1", &control_setpoints.legs[0].reference_value, CHANNEL_FLOAT32},
+    {"R2", &control_setpoints.legs[1].reference_value, CHANNEL_FLOAT32},
+    {"S1", &control_setpoints.legs[0].settings, CHANNEL_SETTINGS},
+    {"S2", &control_setpoints.legs[1].settings, CHANNEL_SETTINGS},
+    {"MO", &control_setpoints.mode, CHANNEL_MODE},
+    {"RS", &rx_consigne.test_RS485, CHANNEL_UINT8},
+    {"SY", &rx_consigne.test_Sync, CHANNEL_UINT8},
+    {"CT", &rx_consigne.test_CAN, CHANNEL_UINT16},
+    {"CB", &rx_consigne.test_bool_CAN, CHANNEL_BOOL},
+    {"AM", &rx_consigne.analog_value_measure, CHANNEL_UINT16},
+    {"ST", &rx_consigne.id_and_status, CHANNEL_UINT8},
+    {"AN", &analog_value, CHANNEL_UINT16},
+    {"CR", &CAN_Bus_receive, CHANNEL_UINT16},
+};
+
+const uint8_t num_telemetry_channels = sizeof(telemetry_channels)/sizeof(telemetry_channels[0]);
+
+static_assert(sizeof(telemetry_channels)/sizeof(telemetry_channels[0]) <= 32, "telemetry_channels[] must fit in a 32-bit mask");
+
+/**
+ * @brief Bit of a channel of telemetry_channels[] in the subscription mask, 0 if there is no such channel.
+ */
+static constexpr uint32_t channel_bit(const char *name)
+{
+    for (uint8_t i = 0; i < sizeof(telemetry_channels)/sizeof(telemetry_channels[0]); i++)
+    {
+        const char *channel = telemetry_channels[i].name;
+        if (channel[0] == name[0] && channel[1] == name[1] && channel[2] == name[2]) return 1UL << i;
+    }
+    return 0;
+}
+
+// Channels of the full record, encoded by the compressed stream when no channel is subscribed
+static_assert(TELEMETRY_FULL_MASK == (channel_bit("V1") | channel_bit("V2") | channel_bit("VH") | channel_bit("I1") |
+                                      channel_bit("I2") | channel_bit("IH") | channel_bit("D1") | channel_bit("D2") |
+                                      channel_bit("S1") | channel_bit("S2") | channel_bit("MO")),
+              "TELEMETRY_FULL_MASK must select the channels of the full record in telemetry_channels[]");
+
+static_assert(TELEMETRY_COMPRESSED_HEADER_SIZE + COMM_VARINT_MAX_SIZE * sizeof(telemetry_channels)/sizeof(telemetry_channels[0])
+              <= COMM_FRAME_MAX_PAYLOAD, "A keyframe of all the channels must fit in a frame");
+
+telemetryConfig_t telemetry_config = {0, 0, 0, 0, 3};
+
+// Owned by the control task
+static uint16_t telemetry_counter = 0;
+static uint32_t telemetry_starts = 0;
+static uint32_t telemetry_sequence = 0;
+static commFrame_t telemetry_frame;
+
+// State of the compressed frame being filled
+static commFrame_t compressed_frame;
+static uint8_t compressed_records = 0;
+static uint32_t compressed_mask;
+static uint8_t compressed_exponent;
+static int32_t previous_values[32];
+static uint32_t previous_timestamp;
+static uint32_t previous_interval;
+
+static const float32_t quantum_scale[TELEMETRY_MAX_QUANTUM_EXPONENT + 1] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f
+};
+
+
+void telemetry_start(uint16_t decimation)
+{
+    telemetry_config.decimation = decimation;
+    telemetry_config.starts++;
+}
+
+
+void telemetry_subscribe(uint32_t mask)
+{
+    telemetry_config.mask = mask;
+}
+
+
+bool telemetry_compress(uint8_t records_per_frame, uint8_t quantum_exponent)
+{
+    if (quantum_exponent > TELEMETRY_MAX_QUANTUM_EXPONENT) return false;
+    telemetry_config.quantum_exponent = quantum_exponent;
+    telemetry_config.records_per_frame = records_per_frame;
+    return true;
+}
+
+
+/**
+ * @brief Packs the boolean settings of a leg, the bit i being the setting i.
+ */
+static uint8_t settings_bits(const bool *settings)
+{
+    uint8_t bits = 0;
+    for (uint8_t setting = 0; setting < BOOL_SETTINGS_NUMBER; setting++)
+    {
+        if (settings[setting] == BOOL_SETTING_ON) bits |= 1 << setting;
+    }
+    return bits;
+}
+
+
+/**
+ * @brief Fills telemetry_frame with the full record.
+ */
+static void build_full_record(uint32_t timestamp_us)
+{
+    // The channels and legs that are not registered are sent as 0
+    telemetryRecord_t record = {};
+    record.sequence = telemetry_sequence;
+    record.timestamp_us = timestamp_us;
+    for (uint8_t i = 0; i < TELEMETRY_VALUES_NUMBER && i < num_tracking_vars; i++)
+    {
+        record.values[i] = *tracking_vars[i].address;
+    }
+    for (uint8_t leg = 0; leg < TELEMETRY_LEGS_NUMBER && leg < num_power_legs; leg++)
+    {
+        record.duty_cycle[leg] = control_setpoints.legs[leg].duty_cycle;
+        record.settings[leg] = settings_bits(control_setpoints.legs[leg].settings);
+    }
+    record.mode = control_setpoints.mode;
+
+    telemetry_frame.opcode = COMM_OP_TELEMETRY;
+    telemetry_frame.length = sizeof(record);
+    memcpy(telemetry_frame.payload, &record, sizeof(record));
+}
+
+
+/**
+ * @brief Fills telemetry_frame with the channels of a mask.
+ */
+static void build_subscribed_record(uint32_t timestamp_us, uint32_t mask)
+{
+    uint8_t *payload = telemetry_frame.payload;
+    memcpy(payload, &telemetry_sequence, sizeof(uint32_t));
+    memcpy(payload + 4, &timestamp_us, sizeof(uint32_t));
+    memcpy(payload + 8, &mask, sizeof(uint32_t));
+    uint8_t length = 12;
+
+    for (uint8_t i = 0; i < num_telemetry_channels; i++)
+    {
+        if (!(mask & (1UL << i))) continue;
+
+        const telemetryChannel_t *channel = &telemetry_channels[i];
+        switch (channel->type)
+        {
+        case CHANNEL_FLOAT32:
+            memcpy(payload + length, channel->address, sizeof(float32_t));
+            length += sizeof(float32_t);
+            break;
+        case CHANNEL_UINT16:
+            memcpy(payload + length, channel->address, sizeof(uint16_t));
+            length += sizeof(uint16_t);
+            break;
+        case CHANNEL_UINT8:
+            payload[length++] = *(const uint8_t *)channel->address;
+            break;
+        case CHANNEL_BOOL:
+            payload[length++] = *(const bool *)channel->address;
+            break;
+        case CHANNEL_SETTINGS:
+            payload[length++] = settings_bits((const bool *)channel->address);
+            break;
+        case CHANNEL_MODE:
+            payload[length++] = *(const tester_states_t *)channel->address;
+            break;
+        }
+    }
+
+    telemetry_frame.opcode = COMM_OP_SUBSCRIBE;
+    telemetry_frame.length = length;
+}
+
+
+/**
+ * @brief Writes a variable-length unsigned integer, 7 bits per byte, least significant first.
+ *
+ * @return The number of bytes written, at most COMM_VARINT_MAX_SIZE.
+ */
+static uint8_t put_varint(uint8_t *out, uint32_t value)
+{
+    uint8_t length = 0;
+    while (value >= 0x80)
+    {
+        out[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    out[length++] = value;
+    return length;
+}
+
+
+/**
+ * @brief Maps a signed difference to an unsigned integer, small magnitudes giving small integers.
+ *
+ * Differences are computed modulo 2^32, which the decoder undoes with the same wrap around.
+ */
+static uint32_t zigzag(uint32_t difference)
+{
+    return (difference << 1) ^ (uint32_t)((int32_t)difference >> 31);
+}
+
+
+/**
+ * @brief Reads a channel as an integer, float channels being quantized with the given scale.
+ */
+static int32_t channel_quantized(const telemetryChannel_t *channel, float32_t scale)
+{
+    switch (channel->type)
+    {
+    case CHANNEL_FLOAT32:
+    {
+        float32_t value = *(const float32_t *)channel->address * scale;
+        if (value != value) return 0;
+        if (value >= 2147483648.0f) return INT32_MAX;
+        if (value <= -2147483648.0f) return INT32_MIN;
+        return (int32_t)(value + ((value >= 0) ? 0.5f : -0.5f));
+    }
+    case CHANNEL_UINT16:
+        return *(const uint16_t *)channel->address;
+    case CHANNEL_UINT8:
+        return *(const uint8_t *)channel->address;
+    case CHANNEL_BOOL:
+        return *(const bool *)channel->address;
+    case CHANNEL_SETTINGS:
+        return settings_bits((const bool *)channel->address);
+    case CHANNEL_MODE:
+        return *(const tester_states_t *)channel->address;
+    }
+    return 0;
+}
+
+
+static void compressed_flush()
+{
+    if (compressed_records == 0) return;
+    transmitter_send_frame(&compressed_frame);
+    compressed_frame.length = 0;
+    compressed_records = 0;
+}
+
+
+/**
+ * @brief Adds the current values to compressed_frame, sending it once full.
+ */
+static void add_compressed_record(uint32_t timestamp_us, const telemetryConfig_t *config)
+{
+    uint32_t mask = (config->mask != 0) ? config->mask : TELEMETRY_FULL_MASK;
+    uint8_t exponent = config->quantum_exponent;
+    if (mask != compressed_mask || exponent != compressed_exponent) compressed_flush();
+
+    int32_t values[32];
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < num_telemetry_channels; i++)
+    {
+        if (mask & (1UL << i)) values[count++] = channel_quantized(&telemetry_channels[i], quantum_scale[exponent]);
+    }
+
+    if (compressed_records > 0)
+    {
+        // Delta record: change of the sampling interval, then change of each value
+        uint8_t record[COMM_VARINT_MAX_SIZE * 33];
+        uint32_t interval = timestamp_us - previous_timestamp;
+        uint8_t length = put_varint(record, zigzag(interval - previous_interval));
+        for (uint8_t i = 0; i < count; i++)
+        {
+            length += put_varint(record + length, zigzag((uint32_t)values[i] - (uint32_t)previous_values[i]));
+        }
+
+        if (compressed_frame.length + length <= COMM_FRAME_MAX_PAYLOAD)
+        {
+            memcpy(compressed_frame.payload + compressed_frame.length, record, length);
+            compressed_frame.length += length;
+            previous_interval = interval;
+        }
+        else
+        {
+            compressed_flush();
+        }
+    }
+
+    if (compressed_records == 0)
+    {
+        // Keyframe: header, then the absolute values
+        uint8_t *payload = compressed_frame.payload;
+        memcpy(payload, &telemetry_sequence, sizeof(uint32_t));
+        memcpy(payload + 4, &timestamp_us, sizeof(uint32_t));
+        memcpy(payload + 8, &mask, sizeof(uint32_t));
+        payload[12] = exponent;
+        uint8_t length = TELEMETRY_COMPRESSED_HEADER_SIZE;
+        for (uint8_t i = 0; i < count; i++)
+        {
+            length += put_varint(payload + length, zigzag(values[i]));
+        }
+
+        compressed_frame.opcode = COMM_OP_COMPRESSED;
+        compressed_frame.leg = COMM_NO_INDEX;
+        compressed_frame.variable = COMM_NO_INDEX;
+        compressed_frame.length = length;
+        compressed_mask = mask;
+        compressed_exponent = exponent;
+        previous_interval = 0;
+    }
+
+    memcpy(previous_values, values, count * sizeof(int32_t));
+    previous_timestamp = timestamp_us;
+    if (++compressed_records >= config->records_per_frame) compressed_flush();
+}
+
+
+void telemetry_tick()
+{
+    stats_control_tick();
+
+    // Only the published configuration is read, it does not change until the next setpoints_acquire()
+    const telemetryConfig_t *config = &control_setpoints.telemetry;
+    if (config->starts != telemetry_starts)
+    {
+        telemetry_starts = config->starts;
+        telemetry_counter = 0;
+    }
+
+    // Records of a compressed frame are not held back once the stream stops or leaves the compressed mode
+    if (config->decimation == 0 || config->records_per_frame == 0) compressed_flush();
+
+    if (config->decimation == 0) return;
+    if (++telemetry_counter < config->decimation) return;
+    telemetry_counter = 0;
+
+    uint32_t start_cycles = stats_cycles();
+    uint32_t timestamp_us = telemetry_timestamp_us();
+    if (config->records_per_frame > 0)
+    {
+        add_compressed_record(timestamp_us, config);
+    }
+    else
+    {
+        if (config->mask == 0) build_full_record(timestamp_us);
+        else build_subscribed_record(timestamp_us, config->mask);
+
+        telemetry_frame.leg = COMM_NO_INDEX;
+        telemetry_frame.variable = COMM_NO_INDEX;
+        transmitter_send_frame(&telemetry_frame);
+    }
+    telemetry_sequence++;
+    stats_record(STATS_TELEMETRY_TICK, start_cycles);
+}
+
+
+comm_status_t compressHandler(const commFrame_t *frame)
+{
+    if (frame->length < 2)
+    {
+        printk("Invalid compression frame\n");
+        return COMM_ERROR_FORMAT;
+    }
+    if (!telemetry_compress(frame->payload[0], frame->payload[1]))
+    {
+        printk("Invalid quantum exponent: %d\n", frame->payload[1]);
+        return COMM_ERROR_RANGE;
+    }
+    return COMM_OK;
+}
+
+
+comm_status_t telemetryHandler(const commFrame_t *frame)
+{
+    if (frame->length < sizeof(uint16_t))
+    {
+        printk("Invalid telemetry frame\n");
+        return COMM_ERROR_FORMAT;
+    }
+    telemetry_start(frame->payload[0] | (frame->payload[1] << 8));
+    return COMM_OK;
+}
+
+
+comm_status_t subscribeHandler(const commFrame_t *frame)
+{
+    if (frame->length < sizeof(uint32_t))
+    {
+        printk("Invalid subscription frame\n");
+        return COMM_ERROR_FORMAT;
+    }
+    uint32_t mask;
+    memcpy(&mask, frame->payload, sizeof(uint32_t));
+    telemetry_subscribe(mask & ((1UL << num_telemetry_channels) - 1));
+    return COMM_OK;
+}
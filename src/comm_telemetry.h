@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Binary telemetry streaming of the twist board.
+ *
+ * When streaming is enabled, telemetry_tick() builds a fixed-layout record every `decimation` control
+ * periods and queues it as a frame of opcode COMM_OP_TELEMETRY (see comm_transmitter.h). The record is
+ * the little endian payload below, 44 bytes long:
+ *
+ *   | SEQUENCE (u32) | TIMESTAMP us (u32) | V1 | V2 | VH | I1 | I2 | IH (f32) | D1 | D2 (f32) |
+ *   | MODE (u8) | LEG1 SETTINGS (u8) | LEG2 SETTINGS (u8) | RESERVED (u8) |
+ *
+ * The bit i of the settings of a leg is its boolean setting i (BOOL_LEG, BOOL_CAPA, ...).
+ * The sequence number increments for each record built, so the host can detect dropped records.
+ * The timestamp wraps around every 2^32 microseconds, see telemetry_timestamp_us().
+ *
+ * The host controls the stream with a frame of the same opcode whose payload is the decimation as a
+ * little endian u16, 0 stopping the stream.
+ *
+ * Instead of the full record, the host can subscribe to a subset of telemetry_channels[] with a frame of
+ * opcode COMM_OP_SUBSCRIBE whose payload is a little endian u32 mask, the bit i selecting the channel i.
+ * Records are then sent as frames of opcode COMM_OP_SUBSCRIBE holding:
+ *
+ *   | SEQUENCE (u32) | TIMESTAMP us (u32) | MASK (u32) | selected channels, in table order |
+ *
+ * each channel being encoded on its own size (1, 2 or 4 bytes). A null mask returns to the full record.
+ *
+ * A frame of opcode COMM_OP_COMPRESSED whose payload is | RECORDS PER FRAME (u8) | QUANTUM EXPONENT (u8) |
+ * switches to the compressed stream, 0 records per frame returning to the records above. The subscribed
+ * channels (those of the full record if none) are then quantized, float channels being rounded to a
+ * multiple of 10^-QUANTUM EXPONENT, and up to RECORDS PER FRAME records are packed in each frame of opcode
+ * COMM_OP_COMPRESSED:
+ *
+ *   | SEQUENCE (u32) | TIMESTAMP us (u32) | MASK (u32) | QUANTUM EXPONENT (u8) | keyframe values | delta records |
+ *
+ * The first record of the frame is a keyframe: the values of its channels, in table order. Each following
+ * record holds the change of the sampling interval, then the change of each value since the previous record.
+ * All the values are zigzag encoded varints (7 bits per byte, least significant first) and the differences
+ * wrap around modulo 2^32. A frame never refers to another one, so a dropped frame only loses its records.
+ */
+
+
+#ifndef COMM_TELEMETRY_H
+#define COMM_TELEMETRY_H
+
+#include "comm_frame.h"
+
+#define COMM_OP_TELEMETRY 'T'
+#define COMM_OP_SUBSCRIBE 'S'
+#define COMM_OP_COMPRESSED 'Z'
+
+#define TELEMETRY_VALUES_NUMBER 6
+#define TELEMETRY_LEGS_NUMBER 2
+#define TELEMETRY_FULL_MASK 0x1CFF
+#define TELEMETRY_COMPRESSED_HEADER_SIZE 13
+#define TELEMETRY_MAX_QUANTUM_EXPONENT 9
+#define COMM_VARINT_MAX_SIZE 5
+
+typedef enum
+{
+    CHANNEL_FLOAT32, CHANNEL_UINT16, CHANNEL_UINT8, CHANNEL_BOOL, CHANNEL_SETTINGS, CHANNEL_MODE
+} channel_types_t;
+
+/**
+ * @brief Structure representing a channel that can be subscribed to.
+ */
+typedef struct {
+    const char *name;       /**< Name of the channel */
+    const void *address;    /**< Memory address of the value */
+    channel_types_t type;   /**< Type of the value, which defines its size in the records */
+} telemetryChannel_t;
+
+/**
+ * @brief Structure representing a telemetry record, as sent on the wire.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t sequence;                              /**< Number of the record */
+    uint32_t timestamp_us;                          /**< Time of the sample in microseconds */
+    float32_t values[TELEMETRY_VALUES_NUMBER];      /**< Values of the first tracking_vars[], 0 if not registered */
+    float32_t duty_cycle[TELEMETRY_LEGS_NUMBER];    /**< Duty cycles of the first power legs, 0 if not registered */
+    uint8_t mode;                                   /**< Tester state */
+    uint8_t settings[TELEMETRY_LEGS_NUMBER];        /**< Boolean settings of the first power legs, one bit each */
+    uint8_t reserved;                               /**< Padding, always 0 */
+} telemetryRecord_t;
+
+extern const telemetryChannel_t telemetry_channels[];
+extern const uint8_t num_telemetry_channels;
+
+/**
+ * @brief Structure representing the configuration of the stream.
+ *
+ * The commands modify the working copy telemetry_config, which is published to the control task with the
+ * other setpoints (see comm_setpoints.h). telemetry_tick() reads the published copy once per record, so the
+ * mask sent in a record always matches its payload.
+ */
+typedef struct {
+    uint32_t mask;                  /**< Subscribed channels, 0 for the full record */
+    uint32_t starts;                /**< Number of calls to telemetry_start(), so each one restarts the decimation */
+    uint16_t decimation;            /**< Number of control periods between two records, 0 if stopped */
+    uint8_t records_per_frame;      /**< Records packed in a compressed frame, 0 if not compressed */
+    uint8_t quantum_exponent;       /**< Float channels are rounded to a multiple of 10^-quantum_exponent */
+} telemetryConfig_t;
+
+extern telemetryConfig_t telemetry_config;
+
+/**
+ * @brief Reads the clock of the records, in microseconds.
+ *
+ * The 64-bit clock is converted before being truncated, so the timestamps wrap around every 2^32 microseconds
+ * (71 minutes) as the host expects, rather than with the 32-bit cycle counter (25 seconds at 170 MHz). Without
+ * a 64-bit cycle counter, the kernel ticks are used instead, at the resolution of a tick.
+ */
+static inline uint32_t telemetry_timestamp_us()
+{
+#ifdef CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER
+    return (uint32_t)k_cyc_to_us_floor64(k_cycle_get_64());
+#else
+    return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+#endif
+}
+
+/**
+ * @brief Starts or stops the telemetry stream.
+ *
+ * This function and the two below must be called from the task handling the commands, the change being
+ * applied by the control task once the setpoints are published.
+ *
+ * @param decimation The number of control periods between two records, 0 to stop the stream.
+ */
+void telemetry_start(uint16_t decimation);
+
+/**
+ * @brief Selects the channels sent in the records.
+ *
+ * @param mask The bit i selects the channel i of telemetry_channels[], 0 to send the full record.
+ */
+void telemetry_subscribe(uint32_t mask);
+
+/**
+ * @brief Selects the compressed stream.
+ *
+ * @param records_per_frame The maximum number of records packed in a frame, 0 to send uncompressed records.
+ * @param quantum_exponent The float channels are rounded to a multiple of 10^-quantum_exponent.
+ * @return false if the exponent is above TELEMETRY_MAX_QUANTUM_EXPONENT, in which case nothing changes.
+ */
+bool telemetry_compress(uint8_t records_per_frame, uint8_t quantum_exponent);
+
+/**
+ * @brief Builds and queues a record if one is due.
+ *
+ * This function is meant to be called by the control task at each control period. It never blocks: if
+ * the transmission ring is full, the record is dropped.
+ */
+void telemetry_tick();
+
+/**
+ * @brief Handles a telemetry control frame.
+ *
+ * @param frame The frame, whose payload holds the decimation.
+ * @return COMM_ERROR_FORMAT if the payload is too short, COMM_OK otherwise.
+ */
+comm_status_t telemetryHandler(const commFrame_t *frame);
+
+/**
+ * @brief Handles a compression frame.
+ *
+ * @param frame The frame, whose payload holds the number of records per frame and the quantum exponent.
+ * @return COMM_ERROR_FORMAT if the payload is too short, COMM_ERROR_RANGE if the exponent is too large.
+ */
+comm_status_t compressHandler(const commFrame_t *frame);
+
+/**
+ * @brief Handles a subscription frame.
+ *
+ * @param frame The frame, whose payload holds the mask of the channels.
+ * @return COMM_ERROR_FORMAT if the payload is too short, COMM_OK otherwise.
+ */
+comm_status_t subscribeHandler(const commFrame_t *frame);
+
+#endif  //COMM_TELEMETRY_H
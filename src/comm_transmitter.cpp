@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Non-blocking transmitter of the twist board communication protocol.
+ *
+ * @author Luiz Villa <luiz.villa@laas.fr>
+ */
+
+
+#include "comm_transmitter.h"
+
+commRing_t tx_ring;
+commRing_t response_ring;
+uint32_t tx_dropped_frames = 0;
+
+static commRing_t *flush_ring = NULL;
+static size_t flush_remaining = 0;
+
+
+static bool send_frame(commRing_t *ring, const commFrame_t *frame)
+{
+    uint8_t raw[COMM_FRAME_MAX_SIZE];
+    size_t size = frame_encode(frame, raw, sizeof(raw));
+
+    if (size == 0 || !ring_write(ring, raw, size))
+    {
+        // Both rings have their own producer task, so the counter is shared
+        __atomic_fetch_add(&tx_dropped_frames, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    return true;
+}
+
+
+bool transmitter_send_frame(const commFrame_t *frame)
+{
+    return send_frame(&tx_ring, frame);
+}
+
+
+bool transmitter_send_response(const commFrame_t *frame)
+{
+    return send_frame(&response_ring, frame);
+}
+
+
+bool transmitter_send_ack(uint16_t sequence, uint8_t opcode, comm_status_t status)
+{
+    commFrame_t ack;
+    ack.opcode = COMM_OP_ACK;
+    ack.leg = COMM_NO_INDEX;
+    ack.variable = COMM_NO_INDEX;
+    ack.length = 4;
+    ack.payload[0] = sequence & 0xFF;
+    ack.payload[1] = sequence >> 8;
+    ack.payload[2] = opcode;
+    ack.payload[3] = status;
+    return send_frame(&response_ring, &ack);
+}
+
+
+void transmitter_flush()
+{
+    uint8_t byte;
+    uint16_t written = 0;
+    // The frame being written is always completed, so the text printed between two calls never lands inside it
+    while (flush_remaining > 0 || written < COMM_TX_BYTES_PER_FLUSH)
+    {
+        if (flush_remaining == 0)
+        {
+            // Select the next frame, whose size is given by its header
+            if (ring_count(&response_ring) > 0) flush_ring = &response_ring;
+            else if (ring_count(&tx_ring) > 0) flush_ring = &tx_ring;
+            else return;
+            flush_remaining = COMM_FRAME_HEADER_SIZE + ring_peek(flush_ring, 4) + COMM_FRAME_CRC_SIZE;
+        }
+        if (!ring_pop(flush_ring, &byte)) return;
+        console_putchar(byte);
+        flush_remaining--;
+        written++;
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2021-2024 LAAS-CNRS
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as published by
+ *   the Free Software Foundation, either version 2.1 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGLPV2.1
+ */
+
+/**
+ * @brief  Non-blocking transmitter of the twist board communication protocol.
+ *
+ * Binary frames sent by the board are queued in a ring by the task producing them and written to the
+ * console by transmitter_flush(), called from a low priority task. The producer never waits for the
+ * console: a frame that does not fit in the ring is dropped as a whole.
+ *
+ * Each ring has a single producer: tx_ring is filled by the control task (telemetry stream) and
+ * response_ring by the task handling the commands (responses, capture dumps). The flush always writes
+ * whole frames, so frames of both rings are never interleaved, nor split by the text printed with printk() from
+ * the task calling transmitter_flush().
+ *
+ * Commands carrying a sequence number (a "#<sequence>" suffix for text lines, the COMM_FRAME_SEQUENCED bit
+ * for frames) are acknowledged with a frame of opcode COMM_OP_ACK holding the little endian payload:
+ *
+ *   | SEQUENCE (u16) | OPCODE (u8) | STATUS (u8) |
+ *
+ * where OPCODE is the command letter and STATUS a comm_status_t, COMM_OK meaning the command was applied.
+ */
+
+
+#ifndef COMM_TRANSMITTER_H
+#define COMM_TRANSMITTER_H
+
+#include "comm_frame.h"
+#include "comm_ring.h"
+
+#define COMM_TX_BYTES_PER_FLUSH 64
+
+extern commRing_t tx_ring;
+extern commRing_t response_ring;
+extern uint32_t tx_dropped_frames;
+
+/**
+ * @brief Queues a frame of the stream for transmission.
+ *
+ * This function must always be called from the control task, tx_ring having a single producer.
+ *
+ * @param frame The frame to send.
+ * @return false if the frame does not fit in the ring, in which case it is dropped.
+ */
+bool transmitter_send_frame(const commFrame_t *frame);
+
+/**
+ * @brief Queues a response frame for transmission.
+ *
+ * This function must always be called from the task handling the commands, response_ring having a single
+ * producer. Responses are sent before the frames of the stream.
+ *
+ * @param frame The frame to send.
+ * @return false if the frame does not fit in the ring, in which case it is dropped.
+ */
+bool transmitter_send_response(const commFrame_t *frame);
+
+/**
+ * @brief Queues the acknowledgement of a command.
+ *
+ * This function must always be called from the task handling the commands, like transmitter_send_response().
+ *
+ * @param sequence The sequence number of the command.
+ * @param opcode The command letter.
+ * @param status The result of the command.
+ * @return false if the frame does not fit in the ring, in which case it is dropped.
+ */
+bool transmitter_send_ack(uint16_t sequence, uint8_t opcode, comm_status_t status);
+
+/**
+ * @brief Writes the queued bytes to the console.
+ *
+ * This function is meant to be called repeatedly by a low priority task. It starts frames until
+ * COMM_TX_BYTES_PER_FLUSH bytes are written and always completes the last one, so it never returns in the
+ * middle of a frame.
+ */
+void transmitter_flush();
+
+#endif  //COMM_TRANSMITTER_H
@@ -27,6 +27,15 @@ SPDX-License-Identifier: LGLPV2.1
 from serial.tools import list_ports
 
 def find_twist_device_ports(target_vid=0x2fe3, target_pid=0x0100, num_devices = 1):
+    """
+    Finds the serial ports of the boards with the given VID and PID.
+
+    Args:
+        num_devices (int): The number of boards expected, or None to return all the boards found.
+
+    Returns:
+        list: The ports of the boards, or an empty list if fewer than num_devices boards are found.
+    """
     found_devices = []  # List to store the ports for the found devices
 
     # Get a list of all available ports
@@ -41,16 +50,21 @@ def find_twist_device_ports(target_vid=0x2fe3, target_pid=0x0100, num_devices =
             if len(found_devices) == num_devices:
                 return found_devices
 
+    if num_devices is None:
+        return sorted(found_devices)
+
     # If the loop completes without finding both devices, return an empty list
     return []
 
-target_vid = 0x2fe3
-target_pid = 0x0100
-num_devices = 1
 
-target_ports = find_twist_device_ports(target_vid, target_pid, num_devices)
+if __name__ == "__main__":
+    target_vid = 0x2fe3
+    target_pid = 0x0100
+    num_devices = 1
+
+    target_ports = find_twist_device_ports(target_vid, target_pid, num_devices)
 
-if len(target_ports) == num_devices:
-    print("Ports for devices with target VID and PID:", target_ports)
-else:
-    print("Unable to find ports for both devices.")
\ No newline at end of file
+    if len(target_ports) == num_devices:
+        print("Ports for devices with target VID and PID:", target_ports)
+    else:
+        print("Unable to find ports for both devices.")
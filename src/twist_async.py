@@ -0,0 +1,372 @@
+"""
+Copyright (c) 2021-2024 LAAS-CNRS
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 2.1 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGLPV2.1
+"""
+
+"""
+@brief  Asynchronous client of the Twist board, built on asyncio.
+
+        Unlike Twist_Device, nothing blocks the caller:
+
+        - a reader thread receives the bytes of the serial port and hands them to the event loop, which
+          separates the acknowledgements of the commands from the telemetry records and passes the events
+          to the callbacks of on_event();
+        - commands are sent with a sequence number through a write queue, the commands queued while a write
+          is in progress being coalesced into the next one;
+        - up to `window` commands are in flight, each setter returning once its command is acknowledged.
+
+        Configuration can therefore overlap with the acquisition:
+
+            async with AsyncTwistDevice("/dev/ttyACM0") as twist:
+                await twist.start_telemetry(decimation=10)
+                await asyncio.gather(twist.set_duty("LEG1", 0.3), twist.set_duty("LEG2", 0.3))
+                async for sample in twist.samples():
+                    print(sample["V1"])
+
+@author Luiz Villa <luiz.villa@laas.fr>
+"""
+
+import asyncio, threading
+import serial
+
+import twist_frame, twist_telemetry, twist_events, twist_link
+
+
+class CommandError(Exception):
+    """
+    Raised when the board rejects a command.
+
+    Attributes:
+        status (str): The result of the command, a name of twist_frame.STATUSES.
+    """
+
+    def __init__(self, action, status):
+        super().__init__(f"{action} rejected by the board: {status}")
+        self.status = status
+
+
+class AsyncTwistDevice:
+    """
+    Asynchronous client of the Twist board.
+
+    Args:
+        port (str): The serial port of the board, or the pseudo-terminal of host/twist_sim.cpp.
+        baudrate (int): The baud rate of the serial port.
+        window (int): The maximum number of commands waiting for their acknowledgement.
+        timeout (float): The time to wait for an acknowledgement, in seconds.
+        queue_size (int): The number of blocks of telemetry records kept for samples(), the oldest ones
+            being dropped when the consumer falls behind.
+        negotiate (bool): Whether to negotiate the link when opened, see Twist_Device.negotiateLink(). Off by
+            default, for a firmware without link negotiation.
+        max_baudrate (int): The highest baud rate the negotiation switches to.
+    """
+
+    def __init__(self, port, baudrate=115200, window=8, timeout=2.0, queue_size=256, negotiate=False, max_baudrate=None):
+        self.port = port
+        self.baudrate = baudrate
+        self.window = window
+        self.timeout = timeout
+        self.queue_size = queue_size
+        self.negotiate = negotiate
+        self.max_baudrate = max_baudrate
+        self.link = None
+
+        self.serial = None
+        self.next_sequence = 0
+        self.pending = {}
+        self.dropped_blocks = 0
+
+        self.ack_decoder = twist_frame.AckDecoder()
+        self.telemetry_decoder = twist_telemetry.TelemetryDecoder()
+        self.telemetry_channels = 0
+        self.telemetry_compressed = False
+        self.event_decoder = None
+        self.event_callbacks = []
+
+
+    async def open(self):
+        """
+        Open the serial port, negotiate the link and start the reader thread and the writer task.
+        """
+        self.loop = asyncio.get_running_loop()
+        self.serial = serial.Serial(port=self.port, baudrate=self.baudrate, timeout=0.1)
+        if self.negotiate:
+            # The handshake reads the port itself, before the reader thread starts
+            self.link = await self.loop.run_in_executor(None, twist_link.negotiate, self.serial, self.max_baudrate,
+                                                        self.next_sequence)
+            self.next_sequence += 1
+        self.credits = asyncio.Semaphore(self.window)
+        self.write_queue = asyncio.Queue()
+        self.telemetry_queue = asyncio.Queue(self.queue_size)
+
+        self.running = True
+        self.reader = threading.Thread(target=self._read_loop, daemon=True)
+        self.reader.start()
+        self.writer = asyncio.create_task(self._write_loop())
+
+
+    async def close(self):
+        """
+        Stop the reader and the writer and close the serial port. Commands still in flight are cancelled.
+        """
+        self.running = False
+        self.writer.cancel()
+        await asyncio.gather(self.writer, return_exceptions=True)
+        await self.loop.run_in_executor(None, self.reader.join)
+        for future in self.pending.values():
+            future.cancel()
+        self.pending.clear()
+        self.serial.close()
+
+
+    async def __aenter__(self):
+        await self.open()
+        return self
+
+
+    async def __aexit__(self, *exc):
+        await self.close()
+
+
+    def _read_loop(self):
+        """
+        Body of the reader thread: hands the received bytes to the event loop.
+        """
+        while self.running:
+            data = self.serial.read(max(1, self.serial.in_waiting))
+            if data:
+                self.loop.call_soon_threadsafe(self._dispatch, data)
+
+
+    def _dispatch(self, data):
+        """
+        Separates the acknowledgements, the events and the telemetry records of the received bytes, in the event loop.
+        """
+        for sequence, opcode, status in self.ack_decoder.feed(data):
+            future = self.pending.pop(sequence, None)
+            if future is not None and not future.done():
+                future.set_result(status)
+
+        if self.event_decoder is not None:
+            for event in self.event_decoder.feed(data):
+                for callback in self.event_callbacks:
+                    callback(event)
+
+        records = self.telemetry_decoder.feed(data)
+        if len(records):
+            if self.telemetry_queue.full():
+                self.telemetry_queue.get_nowait()
+                self.dropped_blocks += 1
+            self.telemetry_queue.put_nowait(records)
+
+
+    async def _write_loop(self):
+        """
+        Body of the writer task: writes the queued frames, coalescing the ones queued in the meantime.
+        """
+        while True:
+            chunks = [await self.write_queue.get()]
+            while not self.write_queue.empty():
+                chunks.append(self.write_queue.get_nowait())
+            await self.loop.run_in_executor(None, self.serial.write, b"".join(chunks))
+
+
+    def _write(self, data):
+        """
+        Queues bytes that are not acknowledged, such as the telemetry controls.
+        """
+        self.write_queue.put_nowait(data)
+
+
+    async def _send(self, name, encode):
+        """
+        Sends a command with the next sequence number and waits for its acknowledgement.
+
+        Args:
+            name (str): The name of the command, for the error messages.
+            encode (callable): Builds the frame from the sequence number.
+
+        Returns:
+            str: 'OK'
+
+        Raises:
+            CommandError: If the board rejects the command.
+            asyncio.TimeoutError: If the acknowledgement is not received in time.
+        """
+        async with self.credits:
+            sequence = self.next_sequence
+            self.next_sequence = (sequence + 1) % twist_frame.SEQUENCE_MODULO
+            future = self.loop.create_future()
+            self.pending[sequence] = future
+            self.write_queue.put_nowait(encode(sequence))
+            try:
+                status = await asyncio.wait_for(future, self.timeout)
+            finally:
+                self.pending.pop(sequence, None)
+
+        if status != "OK":
+            raise CommandError(name, status)
+        return status
+
+
+    async def command(self, action, *args):
+        """
+        Sends a command and waits for its acknowledgement.
+
+        Args:
+            action (str): The action to perform, with the same actions and arguments as Twist_Device.sendCommand().
+            *args: Optional arguments corresponding to the action.
+
+        Raises:
+            CommandError: If the board rejects the command.
+        """
+        return await self._send(action, lambda sequence: twist_frame.encode_command(action, *args, sequence=sequence))
+
+
+    async def batch(self, commands):
+        """
+        Sends several commands applied in the same control period (see Twist_Device.sendBatch()).
+
+        Returns once the batch is staged by the board.
+        """
+        return await self._send("BATCH", lambda sequence: twist_frame.encode_batch(commands, sequence=sequence))
+
+
+    async def idle(self):
+        return await self.command("IDLE")
+
+
+    async def power_on(self):
+        return await self.command("POWER_ON")
+
+
+    async def power_off(self):
+        return await self.command("POWER_OFF")
+
+
+    async def set_duty(self, leg, value):
+        return await self.command("DUTY", leg, value)
+
+
+    async def set_reference(self, leg, variable, value):
+        return await self.command("REFERENCE", leg, variable, value)
+
+
+    async def set_leg(self, leg, state):
+        return await self.command("LEG", leg, state)
+
+
+    async def set_capa(self, leg, state):
+        return await self.command("CAPA", leg, state)
+
+
+    async def set_driver(self, leg, state):
+        return await self.command("DRIVER", leg, state)
+
+
+    async def set_buck(self, leg, state):
+        return await self.command("BUCK", leg, state)
+
+
+    async def set_boost(self, leg, state):
+        return await self.command("BOOST", leg, state)
+
+
+    async def calibrate(self, variable, gain, offset):
+        return await self.command("CALIBRATE", variable, gain, offset)
+
+
+    def on_event(self, callback):
+        """
+        Registers a function called in the event loop with each event of the board (see subscribe_events()).
+
+        Args:
+            callback (callable): Called with a twist_events.Event, as soon as its frame is received.
+        """
+        self.event_callbacks.append(callback)
+
+
+    async def subscribe_events(self, kinds=None):
+        """
+        Selects the state changes reported as events (see Twist_Device.subscribeEvents()), all of them by default.
+        """
+        self.event_decoder = twist_events.EventDecoder() if twist_events.kinds_mask(kinds) else None
+        return await self._send("EVENTS", lambda sequence: twist_events.encode_subscribe(kinds, sequence=sequence))
+
+
+    async def start_telemetry(self, decimation=1, channels=0, records_per_frame=0, quantum_exponent=3):
+        """
+        Starts the telemetry stream.
+
+        Args:
+            decimation (int): The number of control periods between two records.
+            channels (list of str or int): The subscribed channels (see Twist_Device.subscribeTelemetry()),
+                the full record by default.
+            records_per_frame (int): The maximum number of records per frame of the compressed stream
+                (see Twist_Device.compressTelemetry()), 0 for uncompressed records.
+            quantum_exponent (int): The float channels of the compressed stream are rounded to a multiple
+                of 10^-quantum_exponent.
+        """
+        self.telemetry_channels = channels
+        self.telemetry_compressed = records_per_frame > 0
+        if records_per_frame:
+            self.telemetry_decoder = twist_telemetry.CompressedDecoder(channels)
+        else:
+            self.telemetry_decoder = twist_telemetry.TelemetryDecoder(channels)
+        self._write(twist_telemetry.encode_subscribe(channels))
+        self._write(twist_telemetry.encode_compress(records_per_frame, quantum_exponent))
+        self._write(twist_telemetry.encode_start(decimation))
+
+
+    async def set_telemetry_period(self, period_us=None):
+        """
+        Restarts the telemetry stream of start_telemetry() with one record every `period_us` microseconds, the
+        shortest period the negotiated link sustains by default (see Twist_Device.setTelemetryPeriod()).
+        """
+        if period_us is None:
+            if self.link is None:
+                raise ValueError("The link was not negotiated, the period must be given")
+            period_us = twist_link.fastest_period(self.link, self.telemetry_channels, self.telemetry_compressed)
+        return await self._send("RATE", lambda sequence: twist_link.encode_rate(period_us, sequence))
+
+
+    async def stop_telemetry(self):
+        """
+        Stops the telemetry stream.
+        """
+        self._write(twist_telemetry.encode_start(0))
+
+
+    async def blocks(self):
+        """
+        Iterates over the telemetry records, as structured arrays of the records received together.
+        """
+        while True:
+            yield await self.telemetry_queue.get()
+
+
+    async def samples(self):
+        """
+        Iterates over the telemetry records one by one.
+
+        Example:
+            >>> async for sample in twist.samples():
+            ...     print(sample["sequence"], sample["V1"])
+        """
+        async for records in self.blocks():
+            for sample in records:
+                yield sample
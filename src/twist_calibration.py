@@ -0,0 +1,84 @@
+"""
+Copyright (c) 2021-2024 LAAS-CNRS
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 2.1 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGLPV2.1
+"""
+
+"""
+@brief  Calibrations of the Twist board, saved in its flash (see comm_calibration.h)
+
+@author Luiz Villa <luiz.villa@laas.fr>
+"""
+
+import math
+import struct
+
+import twist_frame
+
+OPCODE_CALIBRATIONS = "K"
+
+CMD_GET = 1
+CMD_SET = 2
+CMD_COMMIT = 3
+CMD_ERASE = 4
+
+CHANNELS_PER_FRAME = (twist_frame.FRAME_MAX_PAYLOAD - 3) // 8
+
+# Calibration of a channel never calibrated, or to leave unchanged with a set command
+UNCHANGED = (math.nan, math.nan)
+
+
+def encode_get(first=0):
+    """
+    Builds the frame requesting the calibrations of the channels from the index `first`.
+    """
+    return twist_frame._build(OPCODE_CALIBRATIONS, twist_frame.NO_INDEX, twist_frame.NO_INDEX,
+                              bytes((CMD_GET, first)))
+
+
+def encode_set(calibrations, first=0, sequence=None):
+    """
+    Builds the frame calibrating the consecutive channels from the index `first`.
+
+    Args:
+        calibrations (list): (gain, offset) of each channel, UNCHANGED for the channels to leave as they are.
+    """
+    if len(calibrations) > CHANNELS_PER_FRAME:
+        raise ValueError(f"Too many channels in a frame, {CHANNELS_PER_FRAME} max")
+    payload = bytes((CMD_SET, first)) + b"".join(struct.pack("<ff", gain, offset) for gain, offset in calibrations)
+    return twist_frame._build(OPCODE_CALIBRATIONS, twist_frame.NO_INDEX, twist_frame.NO_INDEX, payload, sequence)
+
+
+def encode_command(command, sequence=None):
+    """
+    Builds the frame of a command without arguments (CMD_COMMIT or CMD_ERASE).
+    """
+    return twist_frame._build(OPCODE_CALIBRATIONS, twist_frame.NO_INDEX, twist_frame.NO_INDEX, bytes((command,)),
+                              sequence)
+
+
+def decode_get(payload):
+    """
+    Decodes the answer to a get request.
+
+    Returns:
+        tuple: (first, channels, calibrations), channels being the number of channels of the board and
+        calibrations the (gain, offset) of the channels from the index first, UNCHANGED for the channels never
+        calibrated and the derived quantities.
+    """
+    _, first, channels = struct.unpack_from("<BBB", payload)
+    values = struct.unpack_from(f"<{(len(payload) - 3) // 4}f", payload, 3)
+    return first, channels, list(zip(values[0::2], values[1::2]))
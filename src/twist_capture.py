@@ -0,0 +1,133 @@
+"""
+Copyright (c) 2021-2024 LAAS-CNRS
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 2.1 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGLPV2.1
+"""
+
+"""
+@brief  Control and upload of the on-device captures of the Twist board (see comm_capture.h)
+
+@author Luiz Villa <luiz.villa@laas.fr>
+"""
+
+import struct
+import numpy as np
+
+import twist_frame
+
+OPCODE_CAPTURE = "C"
+
+CMD_ARM = 1
+CMD_TRIGGER = 2
+CMD_STATUS = 3
+CMD_DUMP = 4
+CMD_DATA = 5
+CMD_END = 6
+
+TRIGGERS = {"MANUAL": 0, "RISING": 1, "FALLING": 2, "MODE": 3}
+STATES = {0: "IDLE", 1: "ARMED", 2: "TRIGGERED", 3: "DONE"}
+
+# Captured channels, in the order of tracking_vars[] on the board
+CHANNELS = ["V1", "V2", "VH", "I1", "I2", "IH"]
+
+
+def _frame(payload):
+    body = bytes((ord(OPCODE_CAPTURE), twist_frame.NO_INDEX, twist_frame.NO_INDEX, len(payload))) + payload
+    return bytes((twist_frame.FRAME_SYNC,)) + body + struct.pack("<H", twist_frame.crc16(body))
+
+
+def channel_mask(channels):
+    """
+    Converts a list of names of CHANNELS to a capture mask.
+    """
+    mask = 0
+    for channel in channels:
+        mask |= 1 << CHANNELS.index(channel.upper())
+    return mask
+
+
+def encode_arm(channels, pre_trigger, post_trigger, trigger="MANUAL", channel="V1", threshold=0.0):
+    """
+    Builds the frame arming a capture.
+
+    Args:
+        channels (list of str): The captured channels.
+        pre_trigger (int): The number of samples kept before the trigger.
+        post_trigger (int): The number of samples recorded after the trigger.
+        trigger (str): "MANUAL", "RISING", "FALLING" or "MODE".
+        channel (str): The channel compared to the threshold for "RISING" and "FALLING".
+        threshold (float): The threshold for "RISING" and "FALLING".
+    """
+    return _frame(struct.pack("<BBBBfHH", CMD_ARM, channel_mask(channels), TRIGGERS[trigger.upper()],
+                              CHANNELS.index(channel.upper()), threshold, pre_trigger, post_trigger))
+
+
+def encode_command(command):
+    """
+    Builds the frame of a capture command without arguments (CMD_TRIGGER, CMD_STATUS or CMD_DUMP).
+    """
+    return _frame(bytes((command,)))
+
+
+def decode_status(payload):
+    """
+    Decodes the payload of a status frame.
+
+    Returns:
+        dict: state, mask, pre_trigger (samples before the trigger) and samples (total samples).
+    """
+    _, state, mask, pre_trigger, samples = struct.unpack_from("<BBBHH", payload)
+    return {"state": STATES.get(state, state), "mask": mask, "pre_trigger": pre_trigger, "samples": samples}
+
+
+class CaptureDump:
+    """
+    Reassembles a dump from the capture frames received from the board.
+    """
+
+    def __init__(self):
+        self.status = None
+        self.data = bytearray()
+        self.complete = False
+
+    def feed(self, frame):
+        """
+        Adds a frame, as returned by twist_frame.FrameDecoder. Frames of other opcodes are ignored.
+        """
+        opcode, _, _, payload = frame
+        if opcode != ord(OPCODE_CAPTURE) or not payload:
+            return
+        if payload[0] == CMD_STATUS and self.status is None:
+            self.status = decode_status(payload)
+            if self.status["state"] != "DONE":
+                self.complete = True
+        elif payload[0] == CMD_DATA:
+            (offset,) = struct.unpack_from("<H", payload, 1)
+            if offset == len(self.data):
+                self.data += payload[3:]
+        elif payload[0] == CMD_END:
+            self.complete = True
+
+    def samples(self):
+        """
+        Returns the captured samples as a structured array with one field per captured channel. The sample
+        of index status["pre_trigger"] is the first one recorded after the trigger.
+        """
+        mask = self.status["mask"] if self.status else 0
+        dtype = np.dtype([(name, "<f4") for i, name in enumerate(CHANNELS) if mask & (1 << i)])
+        if not dtype.names:
+            return np.empty(0, dtype=dtype)
+        return np.frombuffer(bytes(self.data[:len(self.data) // dtype.itemsize * dtype.itemsize]), dtype=dtype)
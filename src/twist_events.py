@@ -0,0 +1,144 @@
+"""
+Copyright (c) 2021-2024 LAAS-CNRS
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 2.1 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGLPV2.1
+"""
+
+"""
+@brief  State-change events of the Twist board (see comm_events.h)
+
+        Once subscribed, the board sends an event whenever its mode, a setting, a duty cycle, a reference or a
+        calibration changes, preceded by the current values of the subscribed kinds:
+
+        >>> twist.onEvent(lambda event: print(event.kind, event.leg, event.value))
+        >>> twist.subscribeEvents(["MODE", "SETTING"])
+
+@author Luiz Villa <luiz.villa@laas.fr>
+"""
+
+import collections, struct
+
+import twist_frame
+
+OPCODE_EVENTS = "E"
+
+# Kinds of events, in the order of events_kind_t on the board
+KINDS = ("MODE", "SETTING", "DUTY", "REFERENCE", "GAIN", "OFFSET")
+
+# Modes, in the order of tester_states_t, and boolean settings, in the order of power_settings[]
+MODES = ("IDLE", "POWER_ON", "POWER_OFF")
+SETTINGS = ("LEG", "CAPA", "DRIVER", "BUCK", "BOOST")
+
+HEADER = struct.Struct("<HI")
+EVENT = struct.Struct("<BBBf")
+
+Event = collections.namedtuple("Event", ["sequence", "timestamp_us", "kind", "leg", "index", "value"])
+Event.__doc__ = """
+An event of the board.
+
+Attributes:
+    sequence (int): The number of the event, modulo 2^16.
+    timestamp_us (int): The time of the change, on the clock of the telemetry records.
+    kind (str): A name of KINDS.
+    leg (int): The index of the power leg, None for the mode and the calibrations.
+    index (int or str): The setting of SETTINGS for a SETTING event, the index of the tracking variable for a
+        REFERENCE event or of the channel for a GAIN or OFFSET event, None otherwise.
+    value (float, int or str): The new value, a name of MODES for a MODE event, 0 or 1 for a SETTING event.
+"""
+
+
+def kinds_mask(kinds):
+    """
+    Converts a list of names of KINDS to a subscription mask. A mask is returned as is, None selects every kind.
+    """
+    if kinds is None:
+        return (1 << len(KINDS)) - 1
+    if isinstance(kinds, int):
+        return kinds
+    mask = 0
+    for kind in kinds:
+        if kind.upper() not in KINDS:
+            raise ValueError(f"Invalid event kind: {kind}")
+        mask |= 1 << KINDS.index(kind.upper())
+    return mask
+
+
+def encode_subscribe(kinds=None, sequence=None):
+    """
+    Builds the frame selecting the kinds of events sent by the board, an empty list stopping them.
+    """
+    return twist_frame._build(OPCODE_EVENTS, twist_frame.NO_INDEX, twist_frame.NO_INDEX, bytes((kinds_mask(kinds),)),
+                              sequence=sequence)
+
+
+def decode_events(payload):
+    """
+    Decodes the payload of an events frame.
+
+    Returns:
+        list: The events of the frame, as Event tuples.
+    """
+    if len(payload) < HEADER.size:
+        return []
+    sequence, timestamp = HEADER.unpack_from(payload)
+    events = []
+    for offset in range(HEADER.size, len(payload) - EVENT.size + 1, EVENT.size):
+        kind, leg, index, value = EVENT.unpack_from(payload, offset)
+        if kind >= len(KINDS):
+            continue
+        name = KINDS[kind]
+        if name == "MODE":
+            value = MODES[int(value)] if int(value) < len(MODES) else int(value)
+        elif name == "SETTING":
+            index = SETTINGS[index] if index < len(SETTINGS) else index
+            value = int(value)
+        events.append(Event((sequence + len(events)) % twist_frame.SEQUENCE_MODULO, timestamp, name,
+                            None if leg == twist_frame.NO_INDEX else leg,
+                            None if index == twist_frame.NO_INDEX else index, value))
+    return events
+
+
+class EventDecoder:
+    """
+    Incremental decoder extracting the events from a byte stream.
+
+    The number of events lost on the way, detected from the sequence numbers, is counted in `lost`.
+    """
+
+    def __init__(self):
+        self.frames = twist_frame.FrameDecoder()
+        self.next_sequence = None
+        self.lost = 0
+
+    def feed(self, data):
+        """
+        Adds received bytes to the decoder.
+
+        Returns:
+            list: The events completed by these bytes, as Event tuples.
+        """
+        events = []
+        for opcode, _, _, payload in self.frames.feed(data):
+            if opcode != ord(OPCODE_EVENTS):
+                continue
+            frame_events = decode_events(payload)
+            if not frame_events:
+                continue
+            if self.next_sequence is not None:
+                self.lost += (frame_events[0].sequence - self.next_sequence) % twist_frame.SEQUENCE_MODULO
+            self.next_sequence = (frame_events[-1].sequence + 1) % twist_frame.SEQUENCE_MODULO
+            events.extend(frame_events)
+        return events
@@ -0,0 +1,307 @@
+"""
+Copyright (c) 2021-2024 LAAS-CNRS
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 2.1 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGLPV2.1
+"""
+
+"""
+@brief  Drives several Twist boards concurrently from one host process.
+
+        Each board has its own I/O thread running an event loop with an AsyncTwistDevice (see twist_async.py),
+        so no serial port waits for another one and the throughput grows with the number of boards.
+        Commands are fanned out to all the boards in parallel and their telemetry is merged into a single
+        stream ordered in time:
+
+            with TwistFleet() as fleet:
+                fleet.command("DUTY", "LEG1", 0.3)
+                fleet.start_telemetry(decimation=10, channels=["V1", "I1"])
+                for records in fleet.samples():
+                    print(records["board"], records["time"], records["V1"])
+
+        The boards do not share a clock: the timestamps of each board are converted to the host clock with
+        an offset estimated from the records received with the smallest delay.
+
+@author Luiz Villa <luiz.villa@laas.fr>
+"""
+
+import asyncio, queue, threading, time
+import numpy as np
+
+import find_devices
+from twist_async import AsyncTwistDevice, CommandError
+
+TIMESTAMP_MODULO = 1 << 32
+
+# Fields of the telemetry frames that are not part of the records
+FRAME_FIELDS = ("sync", "opcode", "leg", "variable", "length", "crc")
+
+
+class BoardWorker:
+    """
+    I/O thread of a board, running its own event loop.
+
+    Args:
+        index (int): The index of the board in the fleet.
+        port (str): The serial port of the board.
+        output (queue.Queue): The queue receiving the telemetry, as tuples (index, records, times).
+        **kwargs: The arguments of AsyncTwistDevice.
+    """
+
+    def __init__(self, index, port, output, **kwargs):
+        self.index = index
+        self.port = port
+        self.output = output
+        self.device = AsyncTwistDevice(port, **kwargs)
+
+        self.offset = None
+        self.last_timestamp = None
+        self.wraps = 0
+
+        self.ready = threading.Event()
+        self.error = None
+        self.thread = threading.Thread(target=asyncio.run, args=(self._main(),), daemon=True)
+
+
+    def start(self):
+        self.thread.start()
+        self.ready.wait()
+        if self.error is not None:
+            raise self.error
+
+
+    async def _main(self):
+        try:
+            await self.device.open()
+        except Exception as error:
+            self.error = error
+            self.ready.set()
+            return
+
+        self.loop = asyncio.get_running_loop()
+        self.stopped = asyncio.Event()
+        pump = asyncio.create_task(self._pump())
+        self.ready.set()
+
+        await self.stopped.wait()
+        pump.cancel()
+        await asyncio.gather(pump, return_exceptions=True)
+        await self.device.close()
+
+
+    async def _pump(self):
+        """
+        Forwards the telemetry records of the board, with their time on the host clock.
+        """
+        async for records in self.device.blocks():
+            received = time.monotonic()
+            seconds = self._unwrap(records["timestamp_us"]) * 1e-6
+            # The record received with the smallest delay gives the best estimate of the clock offset
+            offset = received - seconds[-1]
+            if self.offset is None or offset < self.offset:
+                self.offset = offset
+            self.output.put((self.index, records, seconds + self.offset))
+
+
+    def _unwrap(self, timestamps):
+        """
+        Extends the 32 bit microsecond timestamps of the board, which wrap every 71 minutes.
+        """
+        timestamps = timestamps.astype(np.int64)
+        previous = timestamps[0] if self.last_timestamp is None else self.last_timestamp
+        wraps = self.wraps + np.cumsum(np.diff(timestamps, prepend=previous) < -TIMESTAMP_MODULO // 2)
+        self.last_timestamp = int(timestamps[-1])
+        self.wraps = int(wraps[-1])
+        return timestamps + wraps * TIMESTAMP_MODULO
+
+
+    def submit(self, coroutine):
+        """
+        Runs a coroutine in the event loop of the board.
+
+        Returns:
+            concurrent.futures.Future: The future of its result.
+        """
+        return asyncio.run_coroutine_threadsafe(coroutine, self.loop)
+
+
+    def stop(self):
+        self.loop.call_soon_threadsafe(self.stopped.set)
+        self.thread.join()
+
+
+class TwistFleet:
+    """
+    Set of Twist boards driven concurrently.
+
+    Args:
+        ports (list of str): The serial ports of the boards. By default, all the boards with the given VID
+            and PID are used.
+        target_vid (int): The vendor ID of the boards.
+        target_pid (int): The product ID of the boards.
+        **kwargs: The arguments of AsyncTwistDevice (window, timeout, queue_size).
+    """
+
+    def __init__(self, ports=None, target_vid=0x2fe3, target_pid=0x0100, **kwargs):
+        if ports is None:
+            ports = find_devices.find_twist_device_ports(target_vid, target_pid, num_devices=None)
+        if not ports:
+            raise ValueError("No Twist board found")
+        self.ports = list(ports)
+        self.telemetry = queue.Queue()
+        self.workers = [BoardWorker(index, port, self.telemetry, **kwargs) for index, port in enumerate(self.ports)]
+        self.pending = []
+
+
+    def open(self):
+        """
+        Opens all the boards.
+        """
+        for worker in self.workers:
+            worker.start()
+
+
+    def close(self):
+        """
+        Closes all the boards.
+        """
+        for worker in self.workers:
+            if worker.thread.is_alive():
+                worker.stop()
+
+
+    def __enter__(self):
+        self.open()
+        return self
+
+
+    def __exit__(self, *exc):
+        self.close()
+
+
+    def _fan_out(self, make_coroutine, boards, timeout):
+        """
+        Runs a coroutine on each board in parallel and collects the results.
+
+        Returns:
+            dict: The result of each board, by port: 'OK', the status of the rejection ('RANGE', ...) or
+            'TIMEOUT'.
+        """
+        workers = self.workers if boards is None else [self.workers[self.ports.index(port)] for port in boards]
+        futures = {worker.port: worker.submit(make_coroutine(worker.device)) for worker in workers}
+        results = {}
+        for port, future in futures.items():
+            try:
+                results[port] = future.result(timeout)
+            except CommandError as error:
+                results[port] = error.status
+            except (asyncio.TimeoutError, TimeoutError):
+                results[port] = "TIMEOUT"
+        return results
+
+
+    def command(self, action, *args, boards=None, timeout=None):
+        """
+        Sends a command to the boards in parallel and waits for all the acknowledgements.
+
+        Args:
+            action (str): The action to perform, with the same actions and arguments as Twist_Device.sendCommand().
+            *args: Optional arguments corresponding to the action.
+            boards (list of str): The ports of the boards, all of them by default.
+
+        Returns:
+            dict: The result of the command on each board, by port.
+
+        Example:
+            >>> fleet.command("DUTY", "LEG1", 0.3)
+            {'/dev/ttyACM0': 'OK', '/dev/ttyACM1': 'OK'}
+        """
+        return self._fan_out(lambda device: device.command(action, *args), boards, timeout)
+
+
+    def batch(self, commands, boards=None, timeout=None):
+        """
+        Sends a batch of commands to the boards in parallel (see Twist_Device.sendBatch()).
+        """
+        return self._fan_out(lambda device: device.batch(commands), boards, timeout)
+
+
+    def start_telemetry(self, decimation=1, channels=0, records_per_frame=0, quantum_exponent=3):
+        """
+        Starts the telemetry stream of all the boards, with the same channels so their records can be merged.
+        The compression options are those of AsyncTwistDevice.start_telemetry().
+        """
+        self.channels = channels
+        self._fan_out(lambda device: device.start_telemetry(decimation, channels, records_per_frame,
+                                                            quantum_exponent), None, None)
+
+
+    def stop_telemetry(self):
+        self._fan_out(lambda device: device.stop_telemetry(), None, None)
+
+
+    def samples(self, horizon=0.05, poll=0.01):
+        """
+        Iterates over the telemetry of all the boards, merged and ordered in time.
+
+        Records are released once no record of another board can be older, that is `horizon` seconds after
+        their reception. Each block is a structured array with the fields of the records plus `board`, the
+        index of the board in ports, and `time`, the time of the record on the host clock (time.monotonic()).
+
+        Args:
+            horizon (float): The maximum delay of a record between two boards, in seconds.
+            poll (float): The maximum time between two checks for records to release, in seconds.
+        """
+        while True:
+            deadline = time.monotonic() + poll
+            try:
+                while True:
+                    block = self.telemetry.get(timeout=max(0.0, deadline - time.monotonic()))
+                    self.pending.append(self._merge_layout(*block))
+                    if time.monotonic() >= deadline:
+                        break
+            except queue.Empty:
+                pass
+
+            ready = self._release(time.monotonic() - horizon)
+            if len(ready):
+                yield ready
+
+
+    @staticmethod
+    def _merge_layout(index, records, times):
+        """
+        Converts a block of records of a board to the layout of the merged stream.
+        """
+        fields = [(name, records.dtype.fields[name][0]) for name in records.dtype.names if name not in FRAME_FIELDS]
+        block = np.empty(len(records), dtype=[("time", "<f8"), ("board", "u1")] + fields)
+        block["time"] = times
+        block["board"] = index
+        for name, _ in fields:
+            block[name] = records[name]
+        return block
+
+
+    def _release(self, cutoff):
+        """
+        Returns the pending records older than cutoff in time order, keeping the others for the next call.
+        """
+        if not self.pending:
+            return np.empty(0)
+        merged = np.concatenate(self.pending) if len(self.pending) > 1 else self.pending[0]
+        merged = merged[np.argsort(merged["time"], kind="stable")]
+        split = np.searchsorted(merged["time"], cutoff, side="right")
+        self.pending = [merged[split:]] if split < len(merged) else []
+        return merged[:split]
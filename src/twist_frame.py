@@ -0,0 +1,318 @@
+"""
+Copyright (c) 2021-2024 LAAS-CNRS
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 2.1 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGLPV2.1
+"""
+
+"""
+@brief  Encoder and decoder of the binary frames of the Twist board protocol (see comm_frame.h)
+
+        | SYNC | OPCODE | LEG | VARIABLE | LENGTH | PAYLOAD | CRC16 |
+
+        This module only depends on the standard library so that it can be used and tested without a board.
+
+@author Luiz Villa <luiz.villa@laas.fr>
+"""
+
+import struct
+
+FRAME_SYNC = 0xA5
+FRAME_HEADER_SIZE = 5
+FRAME_CRC_SIZE = 2
+FRAME_MAX_PAYLOAD = 128
+
+OPCODE_BATCH = "B"
+BATCH_ENTRY_SIZE = 7
+
+# Commands with this bit set in their opcode start their payload with a u16 sequence number and are acknowledged
+FRAME_SEQUENCED = 0x80
+OPCODE_ACK = "A"
+ACK_HEADER = bytes((FRAME_SYNC, ord(OPCODE_ACK), 0xFF, 0xFF, 4))
+ACK_FRAME_SIZE = FRAME_HEADER_SIZE + 4 + FRAME_CRC_SIZE
+SEQUENCE_MODULO = 1 << 16
+
+# Results of the commands, in the order of comm_status_t
+STATUSES = ("OK", "UNKNOWN_COMMAND", "FORMAT", "LEG", "VARIABLE", "RANGE", "BUSY", "STORAGE")
+
+NO_INDEX = 0xFF
+
+# Parts of a duty cycle sent with "DUTY_SCALED"
+DUTY_SCALE = 100000
+
+LEGS = {"LEG1": 0, "LEG2": 1}
+VARIABLES = {"V1": 0, "V2": 1, "VH": 2, "I1": 3, "I2": 4, "IH": 5}
+STATES = {"ON": 1.0, "OFF": 0.0}
+
+# Opcodes are the command letters of the text protocol
+OPCODES = {"IDLE": "i",
+           "POWER_OFF": "f",
+           "POWER_ON": "o",
+           "LEG": "l",
+           "CAPA": "c",
+           "DRIVER": "v",
+           "BUCK": "b",
+           "BOOST": "t",
+           "REFERENCE": "r",
+           "DUTY": "d",
+           "DUTY_SCALED": "p",
+           "CALIBRATE": "k"}
+
+
+def crc16(data, crc=0xFFFF):
+    """
+    Computes the CRC-16/CCITT-FALSE of a bytes-like object, as done by frame_crc16() on the board.
+    """
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def encode_frame(opcode, leg=NO_INDEX, variable=NO_INDEX, values=(), sequence=None):
+    """
+    Builds a binary frame.
+
+    Args:
+        opcode (str or int): The command letter of the frame.
+        leg (int): The index of the power leg.
+        variable (int): The index of the tracking variable.
+        values (iterable of float): The float32 values of the payload.
+        sequence (int): If given, the board acknowledges the command with this sequence number.
+
+    Returns:
+        bytes: The frame, including the sync byte and the CRC.
+    """
+    return _build(opcode, leg, variable, struct.pack(f"<{len(values)}f", *values), sequence)
+
+
+def _build(opcode, leg, variable, payload, sequence=None):
+    """
+    Builds a binary frame from its raw payload, adding the sequence number if any.
+    """
+    if isinstance(opcode, str):
+        opcode = ord(opcode)
+    if sequence is not None:
+        opcode |= FRAME_SEQUENCED
+        payload = struct.pack("<H", sequence % SEQUENCE_MODULO) + payload
+    if len(payload) > FRAME_MAX_PAYLOAD:
+        raise ValueError("Frame payload too long")
+    body = bytes((opcode, leg, variable, len(payload))) + payload
+    return bytes((FRAME_SYNC,)) + body + struct.pack("<H", crc16(body))
+
+
+def decode_frame(raw):
+    """
+    Decodes a single binary frame starting with the sync byte.
+
+    Returns:
+        tuple: (opcode, leg, variable, payload) where payload is the raw payload as bytes.
+
+    Raises:
+        ValueError: If the buffer does not hold a valid frame.
+    """
+    frame, size = _parse(raw)
+    if frame is None:
+        raise ValueError("Invalid frame")
+    return frame
+
+
+def payload_floats(payload):
+    """
+    Unpacks the float32 values of a frame payload.
+    """
+    return struct.unpack(f"<{len(payload) // 4}f", payload[:len(payload) // 4 * 4])
+
+
+def _parse(raw):
+    """
+    Tries to parse a frame at the beginning of raw.
+
+    Returns:
+        tuple: (frame, size) with frame set to None if the frame is invalid and size set to 0 if it is incomplete.
+    """
+    if len(raw) < FRAME_HEADER_SIZE:
+        return None, 0
+    if raw[0] != FRAME_SYNC or raw[4] > FRAME_MAX_PAYLOAD:
+        return None, 1
+    size = FRAME_HEADER_SIZE + raw[4] + FRAME_CRC_SIZE
+    if len(raw) < size:
+        return None, 0
+    body = bytes(raw[1:size - FRAME_CRC_SIZE])
+    (crc,) = struct.unpack_from("<H", raw, size - FRAME_CRC_SIZE)
+    if crc != crc16(body):
+        return None, 1
+    return (body[0], body[1], body[2], body[FRAME_HEADER_SIZE - 1:]), size
+
+
+class FrameDecoder:
+    """
+    Incremental decoder extracting frames from a byte stream.
+
+    Bytes that do not belong to a valid frame (text lines, corrupted frames) are skipped
+    until the next sync byte.
+    """
+
+    def __init__(self):
+        self.buffer = bytearray()
+
+    def feed(self, data):
+        """
+        Adds received bytes to the decoder.
+
+        Returns:
+            list: The frames completed by these bytes, as returned by decode_frame().
+        """
+        self.buffer += data
+        frames = []
+        while True:
+            start = self.buffer.find(FRAME_SYNC)
+            if start < 0:
+                self.buffer.clear()
+                break
+            del self.buffer[:start]
+            frame, size = _parse(self.buffer)
+            if size == 0:
+                break
+            del self.buffer[:size]
+            if frame is not None:
+                frames.append(frame)
+        return frames
+
+
+class AckDecoder:
+    """
+    Incremental decoder extracting the acknowledgements from a byte stream.
+
+    Only the acknowledgement frames are decoded, so the rest of the stream (telemetry, text) costs a single
+    search per call.
+    """
+
+    def __init__(self):
+        self.buffer = b""
+
+    def feed(self, data):
+        """
+        Adds received bytes to the decoder.
+
+        Returns:
+            list: The acknowledgements completed by these bytes, as tuples (sequence, opcode, status) where
+            opcode is the command letter and status a name of STATUSES.
+        """
+        buffer = self.buffer + bytes(data) if self.buffer else bytes(data)
+        acks = []
+        position = 0
+        start = buffer.find(ACK_HEADER)
+        while 0 <= start <= len(buffer) - ACK_FRAME_SIZE:
+            frame, size = _parse(buffer[start:start + ACK_FRAME_SIZE])
+            if frame is not None:
+                sequence, opcode, status = struct.unpack("<HBB", frame[3])
+                acks.append((sequence, chr(opcode), STATUSES[status] if status < len(STATUSES) else str(status)))
+            position = start + size
+            start = buffer.find(ACK_HEADER, position)
+        # Keeps a frame not received completely yet, or the bytes that may begin one
+        self.buffer = buffer[start:] if start >= 0 else buffer[max(position, len(buffer) - len(ACK_HEADER) + 1):]
+        return acks
+
+
+def leg_index(leg):
+    """
+    Returns the index of a power leg, given by its name ("LEG1", "LEG3", ...) or directly by its index.
+    """
+    if isinstance(leg, int):
+        return leg
+    name = leg.upper()
+    if name.startswith("LEG") and name[3:].isdigit() and int(name[3:]) > 0:
+        return int(name[3:]) - 1
+    raise KeyError(leg)
+
+
+def variable_index(variable):
+    """
+    Returns the index of a channel, given by the name of a channel of the Twist board or by the index returned by
+    its registration on the board.
+    """
+    return variable if isinstance(variable, int) else VARIABLES[variable.upper()]
+
+
+def command_fields(action, *args):
+    """
+    Converts a command, with the same arguments as Twist_Device.sendCommand(), to the fields of its frame.
+
+    Returns:
+        tuple: (opcode, leg, variable, values)
+    """
+    if action not in OPCODES:
+        raise ValueError(f"Invalid action: {action}")
+    opcode = OPCODES[action]
+
+    if action in ("IDLE", "POWER_OFF", "POWER_ON"):
+        return opcode, NO_INDEX, NO_INDEX, ()
+    if action in ("LEG", "CAPA", "DRIVER", "BUCK", "BOOST"):
+        leg, state = args
+        return opcode, leg_index(leg), NO_INDEX, (STATES[state.upper()],)
+    if action == "REFERENCE":
+        leg, variable, value = args
+        return opcode, leg_index(leg), variable_index(variable), (value,)
+    if action == "DUTY":
+        leg, value = args
+        return opcode, leg_index(leg), NO_INDEX, (value,)
+    if action == "DUTY_SCALED":
+        leg, value = args
+        return opcode, leg_index(leg), NO_INDEX, (round(value * DUTY_SCALE),)
+    variable, gain, offset = args
+    return opcode, NO_INDEX, variable_index(variable), (gain, offset)
+
+
+def encode_command(action, *args, sequence=None):
+    """
+    Builds the binary frame of a command, taking the same arguments as Twist_Device.sendCommand().
+
+    Args:
+        sequence (int): If given, the board acknowledges the command with this sequence number.
+
+    Example:
+        >>> encode_command("DUTY", "LEG1", 0.02233)
+    """
+    return encode_frame(*command_fields(action, *args), sequence=sequence)
+
+
+def encode_batch(commands, sequence=None):
+    """
+    Builds a batch frame applying several commands in the same control period (see comm_batch.h).
+
+    Args:
+        commands (iterable of tuple): The commands, each one being a tuple (action, *args) with the same
+            arguments as Twist_Device.sendCommand(). Calibrations cannot be batched.
+        sequence (int): If given, the board acknowledges the batch with this sequence number once staged.
+
+    Returns:
+        bytes: The batch frame.
+
+    Example:
+        >>> encode_batch([("DUTY", "LEG1", 0.3), ("DUTY", "LEG2", 0.3), ("POWER_ON",)])
+    """
+    payload = bytearray()
+    for action, *args in commands:
+        if action == "CALIBRATE":
+            raise ValueError("Calibrations cannot be batched")
+        opcode, leg, variable, values = command_fields(action, *args)
+        payload += struct.pack("<BBBf", ord(opcode), leg, variable, values[0] if values else 0.0)
+    if len(payload) > FRAME_MAX_PAYLOAD:
+        raise ValueError(f"Too many commands in the batch, {FRAME_MAX_PAYLOAD // BATCH_ENTRY_SIZE} max")
+
+    return _build(OPCODE_BATCH, NO_INDEX, NO_INDEX, bytes(payload), sequence)
@@ -0,0 +1,235 @@
+"""
+Copyright (c) 2021-2024 LAAS-CNRS
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 2.1 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGLPV2.1
+"""
+
+"""
+@brief  Link negotiation of the Twist board (see comm_link.h)
+
+        At connection, the clients ask the board what the link can carry and switch to the highest baud rate
+        both sides support, then the telemetry can be started at the fastest period the link sustains:
+
+        >>> twist = Twist_Device(twist_port="/dev/ttyUSB0", negotiate=True)
+        >>> twist.setTelemetryPeriod()                           # one record as often as the link allows
+
+@author Luiz Villa <luiz.villa@laas.fr>
+"""
+
+import math, struct, time
+
+import twist_frame
+
+OPCODE_LINK = "N"
+CMD_INFO = 1
+CMD_RATE = 2
+CMD_BAUD = 3
+
+# Encodings, in the order of link_encodings_t on the board
+ENCODINGS = ("TEXT", "FRAMES", "TELEMETRY", "SUBSCRIBE", "COMPRESSED", "EVENTS")
+
+# Baud rates the host can set on its serial port
+HOST_BAUDS = (115200, 230400, 460800, 921600)
+
+INFO = struct.Struct("<BBBIIIHB")
+
+PROBE_TIMEOUT = 0.5     # Time to wait for the answer of a board, older firmwares not answering at all
+SEARCH_TIMEOUT = 0.2    # Time to wait for the answer at each of the other baud rates
+SWITCH_DELAY = 0.05     # Time the board takes to switch once the acknowledgement is sent (LINK_SWITCH_DELAY_MS)
+CONFIRM_TIMEOUT = 1.0   # Time after which the board returns to the previous baud rate (LINK_CONFIRM_MS)
+CONFIRM_ATTEMPTS = 3    # Requests sent at the new baud rate within CONFIRM_TIMEOUT
+POLL_INTERVAL = 0.01    # Serial timeout while waiting for an answer, so the timeouts above hold
+HEADROOM = 0.8          # Share of the link left to the telemetry, the rest being kept for the responses and events
+
+
+def encode_info():
+    """
+    Builds the frame requesting the capabilities of the link.
+    """
+    return twist_frame._build(OPCODE_LINK, twist_frame.NO_INDEX, twist_frame.NO_INDEX, bytes((CMD_INFO,)))
+
+
+def encode_rate(period_us, sequence=None):
+    """
+    Builds the frame starting the telemetry with one record every `period_us` microseconds, rounded up to a
+    multiple of the control period, or stopping it if `period_us` is 0.
+    """
+    return twist_frame._build(OPCODE_LINK, twist_frame.NO_INDEX, twist_frame.NO_INDEX,
+                              struct.pack("<BI", CMD_RATE, int(period_us)), sequence)
+
+
+def encode_baud(baud, sequence=None):
+    """
+    Builds the frame switching the board to another baud rate.
+    """
+    return twist_frame._build(OPCODE_LINK, twist_frame.NO_INDEX, twist_frame.NO_INDEX,
+                              struct.pack("<BI", CMD_BAUD, baud), sequence)
+
+
+def decode_info(payload):
+    """
+    Decodes the answer to an info request.
+
+    Returns:
+        dict: version, encodings (names of ENCODINGS), control_period_us, baudrate (None for a USB link),
+        bytes_per_second, decimation (of the telemetry stream, 0 if stopped) and bauds (the baud rates the board
+        can switch to).
+    """
+    _, version, encodings, control_period_us, baudrate, bytes_per_second, decimation, count = \
+        INFO.unpack_from(payload)
+    bauds = struct.unpack_from(f"<{count}I", payload, INFO.size)
+    return {"version": version,
+            "encodings": [name for i, name in enumerate(ENCODINGS) if encodings & (1 << i)],
+            "control_period_us": control_period_us,
+            "baudrate": baudrate or None,
+            "bytes_per_second": bytes_per_second,
+            "decimation": decimation,
+            "bauds": list(bauds)}
+
+
+def record_bytes(channels=0, compressed=False):
+    """
+    Returns the number of bytes a telemetry record takes on the link.
+
+    The compressed records are estimated at 2 bytes per channel and for the sampling interval, the changes of
+    slowly varying values taking 1 or 2 bytes.
+    """
+    import twist_telemetry  # needs numpy, unlike the negotiation run at every connection
+    mask = twist_telemetry.channel_mask(channels)
+    if compressed:
+        return 2 * (bin(mask or twist_telemetry.FULL_MASK).count("1") + 1)
+    if mask == 0:
+        return twist_telemetry.FRAME_SIZE
+    return twist_telemetry.subscription_dtype(mask).itemsize
+
+
+def fastest_period(info, channels=0, compressed=False):
+    """
+    Returns the shortest telemetry period, in microseconds, the link sustains for the given records, a multiple of
+    the control period.
+    """
+    control_period_us = info["control_period_us"]
+    period_us = record_bytes(channels, compressed) * 1e6 / (info["bytes_per_second"] * HEADROOM)
+    return max(1, math.ceil(period_us / control_period_us)) * control_period_us
+
+
+def choose_baud(info, current, max_baudrate=None):
+    """
+    Returns the highest baud rate both the board and the host support, if higher than the current one, None otherwise.
+    """
+    bauds = [baud for baud in info["bauds"] if baud in HOST_BAUDS and (max_baudrate is None or baud <= max_baudrate)]
+    if not bauds or max(bauds) <= current:
+        return None
+    return max(bauds)
+
+
+def _request(port, data, decoder, match, timeout):
+    """
+    Sends data and waits at most `timeout` seconds for an item decoded from the answer for which match() returns
+    a value.
+
+    Returns:
+        The value returned by match(), None on timeout.
+    """
+    serial_timeout = port.timeout
+    port.timeout = POLL_INTERVAL
+    try:
+        port.write(data)
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            for item in decoder.feed(port.read(max(1, port.in_waiting))):
+                value = match(item)
+                if value is not None:
+                    return value
+        return None
+    finally:
+        port.timeout = serial_timeout
+
+
+def request_info(port, timeout=PROBE_TIMEOUT):
+    """
+    Asks the capabilities of the link over an open serial port.
+
+    Returns:
+        dict: The capabilities, see decode_info(), None if the board does not answer.
+    """
+    def match(frame):
+        opcode, _, _, payload = frame
+        if opcode == ord(OPCODE_LINK) and payload[:1] == bytes((CMD_INFO,)) and len(payload) >= INFO.size:
+            return decode_info(payload)
+    return _request(port, encode_info(), twist_frame.FrameDecoder(), match, timeout)
+
+
+def switch_baud(port, baud, sequence=0):
+    """
+    Switches the board and the serial port to another baud rate, returning to the previous one if the board is
+    not reached at the new one.
+
+    Returns:
+        dict: The capabilities of the link at the baud rate in use, None if the board does not answer anymore.
+    """
+    def match(ack):
+        if ack[0] == sequence:
+            return ack[2]
+    previous = port.baudrate
+    if _request(port, encode_baud(baud, sequence), twist_frame.AckDecoder(), match, PROBE_TIMEOUT) != "OK":
+        return request_info(port)
+
+    port.baudrate = baud
+    time.sleep(SWITCH_DELAY)
+    port.reset_input_buffer()
+    for _ in range(CONFIRM_ATTEMPTS):
+        info = request_info(port, CONFIRM_TIMEOUT / (CONFIRM_ATTEMPTS + 1))
+        if info is not None:
+            return info
+
+    # The board returns to the previous baud rate on its own
+    port.baudrate = previous
+    time.sleep(CONFIRM_TIMEOUT)
+    port.reset_input_buffer()
+    return request_info(port)
+
+
+def negotiate(port, max_baudrate=None, sequence=0):
+    """
+    Runs the handshake at connection: asks the capabilities of the link and switches to the highest baud rate
+    both sides support, up to `max_baudrate`, the BAUD command carrying the given sequence number.
+
+    A board left at another baud rate by a previous connection is found by trying the baud rates of HOST_BAUDS.
+    A firmware without link negotiation reads the requests as text, and the bytes received at another baud rate
+    as garbage, which may start a line: an end of line is sent once back at the initial baud rate, so the first
+    command of the caller is not appended to it.
+
+    Returns:
+        dict: The capabilities of the link, see decode_info(), None for a firmware without link negotiation.
+    """
+    info = request_info(port)
+    initial = port.baudrate
+    for baud in sorted(HOST_BAUDS, reverse=True):
+        if info is not None:
+            break
+        if baud != initial:
+            port.baudrate = baud
+            info = request_info(port, SEARCH_TIMEOUT)
+    if info is None:
+        port.baudrate = initial
+        port.write(b"\n")
+        port.flush()
+        return None
+    baud = choose_baud(info, port.baudrate, max_baudrate)
+    if baud is None:
+        return info
+    return switch_baud(port, baud, sequence)
@@ -0,0 +1,363 @@
+"""
+Copyright (c) 2021-2024 LAAS-CNRS
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 2.1 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGLPV2.1
+"""
+
+"""
+@brief  Recorder of the Twist board data into a memory-mappable columnar recording.
+
+        A reader thread drains the serial port into a bounded queue, and a writer thread decodes the received
+        bytes in bulk and appends the records to one file per column, `chunk_records` records at a time:
+
+            twist.startTelemetry(decimation=10)
+            with TwistRecorder(twist.twist_serialObj, "run1") as recorder:
+                time.sleep(3600)
+
+            recording = open_recording("run1")        # {"V1": numpy.memmap, "timestamp_us": ..., ...}
+            print(recording["V1"][-1000:].mean())
+
+        A recording is a directory holding `recording.json`, which lists the columns and the number of complete
+        records, and a `<column>.bin` file of raw little endian values per column. The manifest is only updated
+        once a chunk is written to every column, so a recording interrupted at any time stays readable, and the
+        columns are mapped lazily, whatever the length of the run.
+
+        Two streams can be recorded:
+
+        - "telemetry": the binary telemetry records (see twist_telemetry.py), with their sequence number and
+          timestamp and the channels of the full record, of the subscription or of the compressed stream;
+        - "status": the status lines printed in POWER_ON mode and read by Twist_Device.getMeasurement(), with a
+          column per field of Twist_Device.twist_message_index (D1, V1, I1, ..., RS).
+
+@author Luiz Villa <luiz.villa@laas.fr>
+"""
+
+import argparse, json, os, queue, threading, time
+import numpy as np
+
+import twist_telemetry
+
+RECORDING_FORMAT = "twist-recording"
+RECORDING_VERSION = 1
+MANIFEST = "recording.json"
+READ_TIMEOUT = 0.1
+MAX_STATUS_LINE = 256
+
+# Fields of the status lines, in the order of Twist_Device.twist_message_index
+STATUS_COLUMNS = [("D1", "<f4"), ("V1", "<f4"), ("I1", "<f4"), ("M1", "u1"),
+                  ("D2", "<f4"), ("I2", "<f4"), ("V2", "<f4"), ("M2", "u1"),
+                  ("VH", "<f4"), ("IH", "<f4"), ("AN", "<u2"), ("CE", "u1"), ("CR", "<u2"), ("RS", "u1")]
+
+# Fields of the telemetry frames that are not recorded, the subscription mask being kept in the manifest
+FRAME_FIELDS = tuple(name for name, _ in twist_telemetry.HEADER_FIELDS) + ("mask", "crc")
+
+
+class StatusDecoder:
+    """
+    Incremental decoder of the status lines, "D1:V1:I1:...:RS".
+
+    Lines that do not have the fields of STATUS_COLUMNS, such as the mode messages, are skipped and counted in
+    `lost`.
+    """
+
+    def __init__(self):
+        self.buffer = b""
+        self.lost = 0
+        self.dtype = np.dtype(STATUS_COLUMNS)
+
+    def feed(self, data):
+        """
+        Adds received bytes to the decoder.
+
+        Returns:
+            numpy.ndarray: The records completed by these bytes, as a structured array of STATUS_COLUMNS.
+        """
+        lines = (self.buffer + bytes(data)).translate(None, b"{}\r").split(b"\n")
+        # The incomplete line is kept, unless it cannot be a status line any more
+        self.buffer = lines.pop()
+        if len(self.buffer) > MAX_STATUS_LINE:
+            self.buffer = b""
+
+        separators = len(STATUS_COLUMNS) - 1
+        status_lines = [line for line in lines if line.count(b":") == separators]
+        self.lost += len(lines) - len(status_lines)
+        if not status_lines:
+            return np.empty(0, dtype=self.dtype)
+        try:
+            values = np.array(b":".join(status_lines).split(b":")).astype(np.float64)
+        except ValueError:
+            # A corrupted field, the lines are converted one by one to only drop the corrupted ones
+            rows = []
+            for line in status_lines:
+                try:
+                    rows.append(np.array(line.split(b":")).astype(np.float64))
+                except ValueError:
+                    self.lost += 1
+            if not rows:
+                return np.empty(0, dtype=self.dtype)
+            values = np.concatenate(rows)
+        values = values.reshape(-1, len(STATUS_COLUMNS))
+
+        records = np.empty(len(values), dtype=self.dtype)
+        for column, name in enumerate(self.dtype.names):
+            records[name] = values[:, column]
+        return records
+
+
+class TwistRecorder:
+    """
+    Records the data received from a Twist board into a columnar recording (see open_recording()).
+
+    The serial port must not be read by anyone else while recording. The memory used is bounded by
+    `queue_size` blocks of received bytes and `chunk_records` decoded records: when the writer falls behind, the
+    received bytes that do not fit in the queue are dropped and counted in `dropped_bytes`.
+
+    Args:
+        port (serial.Serial): The open serial port of the board, for instance Twist_Device.twist_serialObj.
+        path (str): The directory of the recording, which must not hold a recording yet.
+        stream (str): The recorded stream, "telemetry" or "status".
+        channels (list of str or int): The subscribed telemetry channels (see Twist_Device.subscribeTelemetry()),
+            the full record by default.
+        compressed (bool): True if the telemetry stream is compressed (see Twist_Device.compressTelemetry()).
+        chunk_records (int): The number of records appended to the columns at once.
+        queue_size (int): The number of blocks of received bytes waiting for the writer.
+    """
+
+    def __init__(self, port, path, stream="telemetry", channels=0, compressed=False, chunk_records=4096, queue_size=256):
+        if stream == "telemetry":
+            self.decoder = (twist_telemetry.CompressedDecoder(channels) if compressed
+                            else twist_telemetry.TelemetryDecoder(channels))
+            dtype = self.decoder.dtype if compressed else self.decoder.frame_dtype
+        elif stream == "status":
+            self.decoder = StatusDecoder()
+            dtype = self.decoder.dtype
+        else:
+            raise ValueError(f"Invalid stream: {stream}")
+        if chunk_records <= 0:
+            raise ValueError(f"Invalid number of records per chunk: {chunk_records}")
+
+        self.serial = port
+        self.path = path
+        self.stream = stream
+        self.mask = twist_telemetry.channel_mask(channels)
+        self.chunk_records = chunk_records
+        self.columns = [(name, dtype[name]) for name in dtype.names if name not in FRAME_FIELDS]
+
+        self.queue = queue.Queue(queue_size)
+        self.pending = []
+        self.pending_records = 0
+        self.records = 0
+        self.dropped_bytes = 0
+        self.files = {}
+        self.running = False
+
+
+    def start(self):
+        """
+        Create the recording and start the reader and writer threads.
+        """
+        os.makedirs(self.path, exist_ok=True)
+        if os.path.exists(os.path.join(self.path, MANIFEST)):
+            raise FileExistsError(f"{self.path} already holds a recording")
+        self.files = {name: open(os.path.join(self.path, name + ".bin"), "wb") for name, _ in self.columns}
+        self._write_manifest()
+
+        self.timeout = self.serial.timeout
+        self.serial.timeout = READ_TIMEOUT
+        self.running = True
+        self.reader = threading.Thread(target=self._read_loop, daemon=True)
+        self.writer = threading.Thread(target=self._write_loop, daemon=True)
+        self.reader.start()
+        self.writer.start()
+
+
+    def stop(self):
+        """
+        Stop the threads once the received bytes are written, and close the recording.
+
+        Returns:
+            int: The number of records of the recording.
+        """
+        self.running = False
+        self.reader.join()
+        self.queue.put(None)
+        self.writer.join()
+        self.serial.timeout = self.timeout
+        for file in self.files.values():
+            file.close()
+        return self.records
+
+
+    def __enter__(self):
+        self.start()
+        return self
+
+
+    def __exit__(self, *exc):
+        self.stop()
+
+
+    @property
+    def lost(self):
+        """
+        The number of records lost on the link, or of malformed status lines.
+        """
+        return self.decoder.lost
+
+
+    def _read_loop(self):
+        """
+        Body of the reader thread: drains the serial port into the queue.
+        """
+        while self.running:
+            data = self.serial.read(max(1, self.serial.in_waiting))
+            if not data:
+                continue
+            try:
+                self.queue.put_nowait(data)
+            except queue.Full:
+                self.dropped_bytes += len(data)
+
+
+    def _write_loop(self):
+        """
+        Body of the writer thread: decodes all the queued bytes at once and appends the records.
+        """
+        while True:
+            blocks = [self.queue.get()]
+            while blocks[-1] is not None and not self.queue.empty():
+                blocks.append(self.queue.get_nowait())
+            done = blocks[-1] is None
+            if done:
+                blocks.pop()
+            if blocks:
+                self._append(self.decoder.feed(b"".join(blocks)))
+            if done:
+                break
+        self._flush()
+
+
+    def _append(self, records):
+        if len(records) == 0:
+            return
+        self.pending.append(records)
+        self.pending_records += len(records)
+        if self.pending_records >= self.chunk_records:
+            self._flush()
+
+
+    def _flush(self):
+        """
+        Appends the pending records to the columns, then records their number in the manifest.
+        """
+        if self.pending:
+            records = np.concatenate(self.pending) if len(self.pending) > 1 else self.pending[0]
+            for name, file in self.files.items():
+                records[name].tofile(file)
+                file.flush()
+            self.records += len(records)
+            self.pending = []
+            self.pending_records = 0
+        self._write_manifest()
+
+
+    def _write_manifest(self):
+        manifest = {"format": RECORDING_FORMAT,
+                    "version": RECORDING_VERSION,
+                    "stream": self.stream,
+                    "channels": self.mask,
+                    "records": self.records,
+                    "lost": self.decoder.lost,
+                    "dropped_bytes": self.dropped_bytes,
+                    "columns": [{"name": name, "dtype": dtype.str} for name, dtype in self.columns]}
+        # The manifest is replaced at once, a reader never sees it half written
+        temporary = os.path.join(self.path, MANIFEST + ".tmp")
+        with open(temporary, "w") as file:
+            json.dump(manifest, file, indent=2)
+        os.replace(temporary, os.path.join(self.path, MANIFEST))
+
+
+def load_manifest(path):
+    """
+    Reads the manifest of a recording.
+
+    Returns:
+        dict: The stream, the number of records, the records lost on the link, the bytes dropped by the
+        recorder and the name and dtype of each column.
+    """
+    with open(os.path.join(path, MANIFEST)) as file:
+        manifest = json.load(file)
+    if manifest.get("format") != RECORDING_FORMAT or manifest.get("version") != RECORDING_VERSION:
+        raise ValueError(f"{path} is not a recording of version {RECORDING_VERSION}")
+    return manifest
+
+
+def open_recording(path):
+    """
+    Maps the columns of a recording, which can still be in progress, without reading them.
+
+    Returns:
+        dict: A read-only numpy.memmap per column, holding the records complete when the manifest was read.
+    """
+    manifest = load_manifest(path)
+    records = manifest["records"]
+    recording = {}
+    for column in manifest["columns"]:
+        dtype = np.dtype(column["dtype"])
+        if records == 0:
+            recording[column["name"]] = np.empty(0, dtype=dtype)
+        else:
+            recording[column["name"]] = np.memmap(os.path.join(path, column["name"] + ".bin"), dtype=dtype,
+                                                  mode="r", shape=(records,))
+    return recording
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Records the telemetry or the status lines of a Twist board.")
+    parser.add_argument("--port", required=True, help="serial port of the board or of host/twist_sim.cpp")
+    parser.add_argument("--output", required=True, help="directory of the recording")
+    parser.add_argument("--stream", choices=("telemetry", "status"), default="telemetry")
+    parser.add_argument("--decimation", type=int, default=1, help="control periods between two telemetry records")
+    parser.add_argument("--channels", nargs="*", default=[], help="subscribed telemetry channels, all by default")
+    parser.add_argument("--duration", type=float, default=None, help="recording time in seconds, until Ctrl-C by default")
+    parser.add_argument("--chunk-records", type=int, default=4096)
+    args = parser.parse_args()
+
+    from Twist_Class import Twist_Device
+    twist = Twist_Device(twist_port=args.port)
+    if args.stream == "telemetry":
+        twist.subscribeTelemetry(args.channels)
+        twist.startTelemetry(args.decimation)
+
+    twist.startRecording(args.output, stream=args.stream, chunk_records=args.chunk_records)
+    start = time.perf_counter()
+    try:
+        while args.duration is None or time.perf_counter() - start < args.duration:
+            time.sleep(0.1)
+    except KeyboardInterrupt:
+        pass
+    recorder = twist.recorder
+    records = twist.stopRecording()
+    if args.stream == "telemetry":
+        twist.stopTelemetry()
+
+    elapsed = time.perf_counter() - start
+    print(json.dumps({"records": records, "records_per_second": records / elapsed, "lost": recorder.lost,
+                      "dropped_bytes": recorder.dropped_bytes}, indent=2))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,119 @@
+"""
+Copyright (c) 2021-2024 LAAS-CNRS
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 2.1 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGLPV2.1
+"""
+
+"""
+@brief  Setpoint sequences played back by the Twist board (see comm_sequence.h)
+
+        A sequence is a list of entries built with step() and ramp(), each one applying a setting to a power leg
+        at a given control period, counted from the start of the sequence.
+
+        >>> sequence = [step(0, "DUTY", "LEG1", 0.1), ramp(100, 1000, "DUTY", "LEG1", 0.5), step(2000, "LEG", "LEG1", "OFF")]
+
+@author Luiz Villa <luiz.villa@laas.fr>
+"""
+
+import struct
+
+import twist_frame
+
+OPCODE_SEQUENCE = "W"
+
+CMD_CLEAR = 1
+CMD_LOAD = 2
+CMD_START = 3
+CMD_STOP = 4
+CMD_STATUS = 5
+
+STATES = {0: "IDLE", 1: "ARMED", 2: "PLAYING", 3: "DONE"}
+
+ENTRY = struct.Struct("<IHBBBf")
+MAX_ENTRIES = 256
+ENTRIES_PER_FRAME = (twist_frame.FRAME_MAX_PAYLOAD - 3) // ENTRY.size
+
+# Settings that can be sequenced, the commands of power_settings[] on the board
+ACTIONS = ("LEG", "CAPA", "DRIVER", "BUCK", "BOOST", "REFERENCE", "DUTY", "DUTY_SCALED")
+
+
+def step(period, action, *args):
+    """
+    Builds an entry applying a setting at the given period, with the same arguments as Twist_Device.sendCommand().
+    """
+    return _entry(period, 0, action, *args)
+
+
+def ramp(period, length, action, *args):
+    """
+    Builds an entry ramping a setting linearly from its previous value in the sequence, starting at the given
+    period and reaching the value `length` periods later. Boolean settings cannot be ramped.
+    """
+    if length <= 0:
+        raise ValueError(f"Invalid ramp length: {length}")
+    return _entry(period, length, action, *args)
+
+
+def _entry(period, length, action, *args):
+    if action not in ACTIONS:
+        raise ValueError(f"Invalid sequence action: {action}")
+    opcode, leg, variable, values = twist_frame.command_fields(action, *args)
+    return ENTRY.pack(period, length, ord(opcode), leg, variable, values[0])
+
+
+def encode_payload(payload, sequence=None):
+    """
+    Builds a sequence frame from its payload, acknowledged with the given sequence number if any.
+    """
+    return twist_frame._build(OPCODE_SEQUENCE, twist_frame.NO_INDEX, twist_frame.NO_INDEX, payload, sequence)
+
+
+def load_payloads(entries):
+    """
+    Splits the loading of a sequence in frame payloads, the first one clearing the previous sequence.
+    """
+    if len(entries) > MAX_ENTRIES:
+        raise ValueError(f"Too many entries in the sequence, {MAX_ENTRIES} max")
+    payloads = [bytes((CMD_CLEAR,))]
+    for index in range(0, len(entries), ENTRIES_PER_FRAME):
+        payloads.append(struct.pack("<BH", CMD_LOAD, index) + b"".join(entries[index:index + ENTRIES_PER_FRAME]))
+    return payloads
+
+
+def encode_start(loops=1, sequence=None):
+    """
+    Builds the frame starting the sequence, played `loops` times or until stopped if 0.
+    """
+    return encode_payload(struct.pack("<BH", CMD_START, loops), sequence)
+
+
+def encode_command(command, sequence=None):
+    """
+    Builds the frame of a sequence command without arguments (CMD_CLEAR, CMD_STOP or CMD_STATUS).
+    """
+    return encode_payload(bytes((command,)), sequence)
+
+
+def decode_status(payload):
+    """
+    Decodes the payload of a status frame.
+
+    Returns:
+        dict: state, entries, position (index of the next entry), period and loop.
+    """
+    _, state, entries, position, period, loop = struct.unpack_from("<BBHHIH", payload)
+    return {"state": STATES.get(state, state), "entries": entries, "position": position, "period": period,
+            "loop": loop}
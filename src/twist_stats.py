@@ -0,0 +1,59 @@
+"""
+Copyright (c) 2021-2024 LAAS-CNRS
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 2.1 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGLPV2.1
+"""
+
+"""
+@brief  Protocol statistics of the Twist board (see comm_stats.h)
+
+@author Luiz Villa <luiz.villa@laas.fr>
+"""
+
+import struct
+
+import twist_frame
+
+OPCODE_STATS = "Q"
+
+# Counters and measured sections, in the order of the statistics frame
+COUNTERS = ["bytes_received", "lines", "frames", "parse_errors", "unknown_commands", "rejected_commands",
+            "rx_overruns", "tx_dropped"]
+SECTIONS = ["initial_handle", "console_read_line", "receiver_poll", "defaultHandler", "powerLegSettingsHandler",
+            "calibrationHandler", "frameHandler", "telemetry_tick"]
+
+
+def encode_request(reset=False):
+    """
+    Builds the frame requesting the statistics, cleared once sent if `reset` is True.
+    """
+    return twist_frame._build(OPCODE_STATS, twist_frame.NO_INDEX, twist_frame.NO_INDEX, bytes((int(reset),)))
+
+
+def decode_stats(payload):
+    """
+    Decodes the payload of a statistics frame.
+
+    Returns:
+        dict: The counters of COUNTERS, and "cycles", a dict giving the (min, max, mean) cycles of each section
+        of SECTIONS. The simulation reports nanoseconds instead of cycles.
+    """
+    values = struct.unpack_from(f"<{len(payload) // 4}I", payload)
+    stats = dict(zip(COUNTERS, values))
+    sections = values[len(COUNTERS):]
+    stats["cycles"] = {name: tuple(sections[3 * i:3 * i + 3]) for i, name in enumerate(SECTIONS)
+                       if 3 * i + 3 <= len(sections)}
+    return stats
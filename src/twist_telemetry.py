@@ -0,0 +1,357 @@
+"""
+Copyright (c) 2021-2024 LAAS-CNRS
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation, either version 2.1 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+SPDX-License-Identifier: LGLPV2.1
+"""
+
+"""
+@brief  Decoder of the binary telemetry stream of the Twist board (see comm_telemetry.h)
+
+        Records are decoded in bulk with numpy. When the received bytes are a contiguous sequence of
+        telemetry frames, which is the case of a stream without other traffic, the returned records are
+        a view of the received buffer and no byte is copied.
+
+@author Luiz Villa <luiz.villa@laas.fr>
+"""
+
+import struct
+import numpy as np
+
+import twist_frame
+
+OPCODE_TELEMETRY = "T"
+OPCODE_SUBSCRIBE = "S"
+OPCODE_COMPRESSED = "Z"
+RECORD_SIZE = 44
+FRAME_SIZE = twist_frame.FRAME_HEADER_SIZE + RECORD_SIZE + twist_frame.FRAME_CRC_SIZE
+COMPRESSED_HEADER = struct.Struct("<IIIB")
+MAX_QUANTUM_EXPONENT = 9
+
+# Channels that can be subscribed to, in the order of telemetry_channels[] on the board
+CHANNELS = [("V1", "<f4"), ("V2", "<f4"), ("VH", "<f4"), ("I1", "<f4"), ("I2", "<f4"), ("IH", "<f4"),
+            ("D1", "<f4"), ("D2", "<f4"), ("R1", "<f4"), ("R2", "<f4"),
+            ("S1", "u1"), ("S2", "u1"), ("MO", "u1"),
+            ("RS", "u1"), ("SY", "u1"), ("CT", "<u2"), ("CB", "u1"), ("AM", "<u2"), ("ST", "u1"),
+            ("AN", "<u2"), ("CR", "<u2")]
+
+HEADER_FIELDS = [("sync", "u1"),
+                 ("opcode", "u1"),
+                 ("leg", "u1"),
+                 ("variable", "u1"),
+                 ("length", "u1")]
+
+# Layout of a whole telemetry frame, header and CRC included
+FRAME_DTYPE = np.dtype(HEADER_FIELDS + [
+                        ("sequence", "<u4"),
+                        ("timestamp_us", "<u4"),
+                        ("V1", "<f4"),
+                        ("V2", "<f4"),
+                        ("VH", "<f4"),
+                        ("I1", "<f4"),
+                        ("I2", "<f4"),
+                        ("IH", "<f4"),
+                        ("D1", "<f4"),
+                        ("D2", "<f4"),
+                        ("mode", "u1"),
+                        ("settings1", "u1"),
+                        ("settings2", "u1"),
+                        ("reserved", "u1"),
+                        ("crc", "<u2")])
+
+assert FRAME_DTYPE.itemsize == FRAME_SIZE
+
+# Channels of the full record, encoded by the compressed stream when no channel is subscribed
+FULL_MASK = 0x1CFF
+
+
+def channel_mask(channels):
+    """
+    Converts a list of channel names of CHANNELS to a subscription mask. A mask is returned as is.
+    """
+    if isinstance(channels, int):
+        return channels
+    names = [name for name, _ in CHANNELS]
+    mask = 0
+    for channel in channels:
+        if channel.upper() not in names:
+            raise ValueError(f"Invalid channel: {channel}")
+        mask |= 1 << names.index(channel.upper())
+    return mask
+
+
+def subscription_dtype(mask):
+    """
+    Returns the layout of a whole subscription frame for the given mask, header and CRC included.
+    """
+    fields = [CHANNELS[i] for i in range(len(CHANNELS)) if mask & (1 << i)]
+    return np.dtype(HEADER_FIELDS + [("sequence", "<u4"), ("timestamp_us", "<u4"), ("mask", "<u4")]
+                    + fields + [("crc", "<u2")])
+
+
+def _crc16_table():
+    table = np.zeros(256, dtype=np.uint16)
+    for byte in range(256):
+        table[byte] = twist_frame.crc16(bytes((byte,)), crc=0)
+    return table
+
+
+# CRC of each byte value with a null initial value, used to compute the CRC of many frames at once
+CRC16_TABLE = _crc16_table()
+
+
+def crc16_rows(rows):
+    """
+    Computes the CRC-16/CCITT-FALSE of each row of a 2D uint8 array.
+    """
+    crc = np.full(rows.shape[0], 0xFFFF, dtype=np.uint16)
+    for column in range(rows.shape[1]):
+        crc = (crc << 8) ^ CRC16_TABLE[(crc >> 8) ^ rows[:, column]]
+    return crc
+
+
+def encode_start(decimation):
+    """
+    Builds the frame starting the telemetry stream with one record every `decimation` control periods,
+    or stopping it if `decimation` is 0.
+    """
+    payload = struct.pack("<H", decimation)
+    body = bytes((ord(OPCODE_TELEMETRY), twist_frame.NO_INDEX, twist_frame.NO_INDEX, len(payload))) + payload
+    return bytes((twist_frame.FRAME_SYNC,)) + body + struct.pack("<H", twist_frame.crc16(body))
+
+
+def encode_subscribe(channels):
+    """
+    Builds the frame subscribing to the given channels, as a list of names or a mask.
+    An empty subscription returns to the full record.
+    """
+    payload = struct.pack("<I", channel_mask(channels))
+    body = bytes((ord(OPCODE_SUBSCRIBE), twist_frame.NO_INDEX, twist_frame.NO_INDEX, len(payload))) + payload
+    return bytes((twist_frame.FRAME_SYNC,)) + body + struct.pack("<H", twist_frame.crc16(body))
+
+
+def encode_compress(records_per_frame, quantum_exponent=3):
+    """
+    Builds the frame selecting the compressed stream, with up to `records_per_frame` records per frame and
+    the float channels rounded to a multiple of 10^-quantum_exponent. 0 records per frame returns to the
+    uncompressed records.
+    """
+    if not 0 <= records_per_frame <= 255:
+        raise ValueError(f"Invalid number of records per frame: {records_per_frame}")
+    if not 0 <= quantum_exponent <= MAX_QUANTUM_EXPONENT:
+        raise ValueError(f"Invalid quantum exponent: {quantum_exponent}")
+    return twist_frame._build(OPCODE_COMPRESSED, twist_frame.NO_INDEX, twist_frame.NO_INDEX,
+                              bytes((records_per_frame, quantum_exponent)))
+
+
+def compressed_dtype(mask):
+    """
+    Returns the layout of the records decoded from the compressed stream for the given mask.
+    """
+    fields = [CHANNELS[i] for i in range(len(CHANNELS)) if mask & (1 << i)]
+    return np.dtype([("sequence", "<u4"), ("timestamp_us", "<u4")] + fields)
+
+
+def decode_varints(data):
+    """
+    Decodes a sequence of zigzag encoded varints at once.
+
+    Args:
+        data (numpy.ndarray): The encoded bytes, as uint8. Trailing bytes of an incomplete varint are ignored.
+
+    Returns:
+        numpy.ndarray: The signed values, as int64.
+    """
+    ends = np.flatnonzero(data < 0x80)
+    if len(ends) == 0:
+        return np.empty(0, dtype=np.int64)
+    data = data[:ends[-1] + 1]
+    starts = np.empty_like(ends)
+    starts[0] = 0
+    starts[1:] = ends[:-1] + 1
+    # Position of each byte in its varint
+    position = np.arange(len(data)) - np.repeat(starts, ends - starts + 1)
+    unsigned = np.add.reduceat((data & 0x7F).astype(np.int64) << (7 * position), starts)
+    return (unsigned >> 1) ^ -(unsigned & 1)
+
+
+def decode_compressed(payload, mask):
+    """
+    Decodes the records of a compressed frame.
+
+    Args:
+        payload (bytes): The payload of the frame.
+        mask (int): The expected mask, frames of another mask being ignored.
+
+    Returns:
+        numpy.ndarray: The records, as a structured array of compressed_dtype(mask), or None if the frame
+        does not hold records of this mask.
+    """
+    if len(payload) < COMPRESSED_HEADER.size:
+        return None
+    sequence, timestamp, frame_mask, exponent = COMPRESSED_HEADER.unpack_from(payload)
+    if frame_mask != mask or exponent > MAX_QUANTUM_EXPONENT:
+        return None
+    count = bin(mask).count("1")
+    values = decode_varints(np.frombuffer(payload, dtype=np.uint8, offset=COMPRESSED_HEADER.size))
+    if len(values) < count or (len(values) - count) % (count + 1):
+        return None
+
+    deltas = values[count:].reshape(-1, count + 1)
+    # Absolute values and intervals, wrapping around modulo 2^32 as on the board
+    quantized = np.cumsum(np.vstack((values[:count], deltas[:, 1:])), axis=0)
+    quantized = ((quantized + 2**31) & 0xFFFFFFFF) - 2**31
+    intervals = np.cumsum(deltas[:, 0])
+    timestamps = (timestamp + np.concatenate(([0], np.cumsum(intervals & 0xFFFFFFFF)))) & 0xFFFFFFFF
+
+    records = np.empty(len(quantized), dtype=compressed_dtype(mask))
+    records["sequence"] = (sequence + np.arange(len(records))) & 0xFFFFFFFF
+    records["timestamp_us"] = timestamps
+    for column, name in enumerate(records.dtype.names[2:]):
+        if records.dtype[name].kind == "f":
+            records[name] = quantized[:, column] / 10.0 ** exponent
+        else:
+            records[name] = quantized[:, column]
+    return records
+
+
+def decode_records(buffer, frame_dtype=FRAME_DTYPE, opcode=OPCODE_TELEMETRY, mask=0):
+    """
+    Decodes all the complete telemetry frames of a buffer.
+
+    Args:
+        buffer (bytes): The received bytes.
+        frame_dtype (numpy.dtype): The layout of the frames, FRAME_DTYPE or a subscription_dtype().
+        opcode (str): The opcode of the frames, OPCODE_TELEMETRY or OPCODE_SUBSCRIBE.
+        mask (int): The subscription mask of the frames, for OPCODE_SUBSCRIBE.
+
+    Returns:
+        tuple: (records, consumed) where records is a structured array of frame_dtype holding the valid
+        frames and consumed is the number of bytes of the buffer that do not need to be kept.
+    """
+    frame_size = frame_dtype.itemsize
+    record_size = frame_size - twist_frame.FRAME_HEADER_SIZE - twist_frame.FRAME_CRC_SIZE
+    raw = np.frombuffer(buffer, dtype=np.uint8)
+    candidates = len(raw) - frame_size + 1
+    if candidates <= 0:
+        return np.empty(0, dtype=frame_dtype), 0
+
+    starts = np.flatnonzero((raw[:candidates] == twist_frame.FRAME_SYNC)
+                            & (raw[1:candidates + 1] == ord(opcode))
+                            & (raw[4:candidates + 4] == record_size))
+    # Bytes that cannot be the beginning of a frame any more
+    consumed = candidates
+    if len(starts) == 0:
+        return np.empty(0, dtype=frame_dtype), consumed
+    consumed = max(consumed, int(starts[-1]) + frame_size)
+
+    if starts[-1] - starts[0] == (len(starts) - 1) * frame_size:
+        # Contiguous frames: view of the buffer
+        rows = raw[starts[0]:starts[-1] + frame_size].reshape(len(starts), frame_size)
+    else:
+        rows = raw[starts[:, None] + np.arange(frame_size)]
+
+    frames = rows.view(frame_dtype)[:, 0]
+    valid = crc16_rows(rows[:, 1:-twist_frame.FRAME_CRC_SIZE]) == frames["crc"]
+    if mask:
+        # Records sent before the subscription changed
+        valid &= frames["mask"] == mask
+    if not valid.all():
+        frames = frames[valid]
+    return frames, consumed
+
+
+class TelemetryDecoder:
+    """
+    Incremental decoder of the telemetry stream.
+
+    Bytes that do not belong to a telemetry frame are skipped. The number of records lost on the way,
+    detected from the sequence numbers, is counted in `lost`.
+
+    Args:
+        channels: The subscribed channels, as a list of names or a mask. By default, the full record is decoded.
+    """
+
+    def __init__(self, channels=0):
+        self.buffer = b""
+        self.next_sequence = None
+        self.lost = 0
+        self.mask = channel_mask(channels)
+        if self.mask:
+            self.frame_dtype, self.opcode = subscription_dtype(self.mask), OPCODE_SUBSCRIBE
+        else:
+            self.frame_dtype, self.opcode = FRAME_DTYPE, OPCODE_TELEMETRY
+
+    def feed(self, data):
+        """
+        Adds received bytes to the decoder.
+
+        Returns:
+            numpy.ndarray: The records completed by these bytes, as a structured array of the frame layout.
+        """
+        buffer = self.buffer + bytes(data) if self.buffer else bytes(data)
+        records, consumed = decode_records(buffer, self.frame_dtype, self.opcode, self.mask)
+        self.buffer = buffer[consumed:]
+
+        if len(records):
+            sequence = records["sequence"]
+            expected = self.next_sequence if self.next_sequence is not None else int(sequence[0])
+            self.lost += int(sequence[-1]) - expected + 1 - len(records)
+            self.next_sequence = int(sequence[-1]) + 1
+        return records
+
+
+class CompressedDecoder:
+    """
+    Incremental decoder of the compressed telemetry stream.
+
+    The records have the fields sequence, timestamp_us and the subscribed channels. Float channels hold the
+    quantized values. The number of records lost on the way, detected from the sequence numbers, is counted
+    in `lost`.
+
+    Args:
+        channels: The subscribed channels, as a list of names or a mask. By default, the channels of the full record.
+    """
+
+    def __init__(self, channels=0):
+        self.frames = twist_frame.FrameDecoder()
+        self.next_sequence = None
+        self.lost = 0
+        self.mask = channel_mask(channels) or FULL_MASK
+        self.dtype = compressed_dtype(self.mask)
+
+    def feed(self, data):
+        """
+        Adds received bytes to the decoder.
+
+        Returns:
+            numpy.ndarray: The records completed by these bytes, as a structured array of compressed_dtype().
+        """
+        blocks = []
+        for opcode, _, _, payload in self.frames.feed(data):
+            if opcode != ord(OPCODE_COMPRESSED):
+                continue
+            records = decode_compressed(payload, self.mask)
+            if records is not None and len(records):
+                blocks.append(records)
+        if not blocks:
+            return np.empty(0, dtype=self.dtype)
+        records = np.concatenate(blocks) if len(blocks) > 1 else blocks[0]
+
+        sequence = records["sequence"]
+        expected = self.next_sequence if self.next_sequence is not None else int(sequence[0])
+        self.lost += int(sequence[-1]) - expected + 1 - len(records)
+        self.next_sequence = int(sequence[-1]) + 1
+        return records